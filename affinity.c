@@ -0,0 +1,206 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+#include <dirent.h>
+#include <sched.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+
+#include "affinity.h"
+
+/*
+	The allowed CPUs, sorted by node, as found at the first call: later on
+	the mask of the calling thread may have been changed by pinning.
+*/
+
+static int nr_cpus=0;
+static int nr_nodes=1;
+static int cpus[CPU_SETSIZE];
+static int cpu_nodes[CPU_SETSIZE];
+static pthread_once_t discovery_once=PTHREAD_ONCE_INIT;
+
+/*
+	The node a CPU belongs to is found in sysfs, as a 'nodeN' entry in the
+	CPU directory. If there is none, the system is not NUMA.
+*/
+
+static int cpu_to_node(int cpu)
+{
+	char path[128];
+	DIR *dir;
+	struct dirent *entry;
+	int ret=0;
+
+	snprintf(path,128,"/sys/devices/system/cpu/cpu%d",cpu);
+
+	if(!(dir=opendir(path)))
+		return 0;
+
+	while((entry=readdir(dir))!=NULL)
+	{
+		if((strncmp(entry->d_name,"node",4)==0)&&(entry->d_name[4]>='0')&&(entry->d_name[4]<='9'))
+		{
+			ret=atoi(entry->d_name+4);
+			break;
+		}
+	}
+
+	closedir(dir);
+
+	return ret;
+}
+
+static void affinity_discover(void)
+{
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+
+	if(sched_getaffinity(0,sizeof(cpu_set_t),&set)!=0)
+	{
+		nr_cpus=0;
+		return;
+	}
+
+	for(int c=0;c<CPU_SETSIZE;c++)
+	{
+		if(CPU_ISSET(c,&set))
+		{
+			cpus[nr_cpus]=c;
+			cpu_nodes[nr_cpus]=cpu_to_node(c);
+
+			if(cpu_nodes[nr_cpus]+1>nr_nodes)
+				nr_nodes=cpu_nodes[nr_cpus]+1;
+
+			nr_cpus++;
+		}
+	}
+
+	/*
+		Insertion sort by node, keeping the CPU order within a node.
+	*/
+
+	for(int i=1;i<nr_cpus;i++)
+	{
+		int cpu=cpus[i],node=cpu_nodes[i],j;
+
+		for(j=i-1;(j>=0)&&(cpu_nodes[j]>node);j--)
+		{
+			cpus[j+1]=cpus[j];
+			cpu_nodes[j+1]=cpu_nodes[j];
+		}
+
+		cpus[j+1]=cpu;
+		cpu_nodes[j+1]=node;
+	}
+}
+
+int affinity_nr_cpus(void)
+{
+	pthread_once(&discovery_once,affinity_discover);
+
+	return nr_cpus;
+}
+
+int affinity_nr_nodes(void)
+{
+	pthread_once(&discovery_once,affinity_discover);
+
+	return nr_nodes;
+}
+
+/*
+	Pins the calling thread to a single CPU; if there are more
+	workers than CPUs they wrap around.
+*/
+
+bool affinity_pin_thread(int index)
+{
+	cpu_set_t set;
+
+	pthread_once(&discovery_once,affinity_discover);
+
+	if(nr_cpus==0)
+		return false;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpus[index%nr_cpus],&set);
+
+	return (pthread_setaffinity_np(pthread_self(),sizeof(cpu_set_t),&set)==0);
+}
+
+/*
+	Gives back to the calling thread all the CPUs the process started with.
+*/
+
+void affinity_unpin_thread(void)
+{
+	cpu_set_t set;
+
+	pthread_once(&discovery_once,affinity_discover);
+
+	if(nr_cpus==0)
+		return;
+
+	CPU_ZERO(&set);
+
+	for(int c=0;c<nr_cpus;c++)
+		CPU_SET(cpus[c],&set);
+
+	pthread_setaffinity_np(pthread_self(),sizeof(cpu_set_t),&set);
+}
+
+void affinity_get_location(int *cpu,int *node)
+{
+	unsigned int c=0,n=0;
+
+	if(syscall(SYS_getcpu,&c,&n,NULL)!=0)
+		c=n=0;
+
+	*cpu=c;
+	*node=n;
+}
+
+void worker_stats_reset(struct worker_stats_t *ws)
+{
+	ws->cpu=ws->node=-1;
+	ws->migrations=0;
+	ws->runs=ws->points=0;
+	ws->busy=0.0;
+	ws->memory=0;
+	ws->monitor=NULL;
+}
+
+void worker_stats_update_location(struct worker_stats_t *ws)
+{
+	int cpu,node;
+
+	affinity_get_location(&cpu,&node);
+
+	if((ws->cpu!=-1)&&(ws->node!=node))
+		ws->migrations++;
+
+	ws->cpu=cpu;
+	ws->node=node;
+}
+
+void worker_stats_report(struct worker_stats_t *ws,int nr_workers,FILE *out)
+{
+	for(int c=0;c<nr_workers;c++)
+	{
+		if(ws[c].cpu==-1)
+			continue;
+
+		fprintf(out,"Worker %d: cpu %d, node %d, %ld points, %ld runs, %.2f s busy",c,ws[c].cpu,ws[c].node,ws[c].points,ws[c].runs,ws[c].busy);
+
+		if(ws[c].migrations>0)
+			fprintf(out,", moved across nodes %d times",ws[c].migrations);
+
+		fprintf(out,"\n");
+	}
+}
@@ -0,0 +1,55 @@
+#ifndef __AFFINITY_H__
+#define __AFFINITY_H__
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+	Thread placement. The CPUs the process is allowed to run on are ordered
+	by NUMA node, and the n-th worker is pinned to the n-th CPU: consecutive
+	workers thus share a node, and they never migrate away from the memory
+	they have first touched.
+*/
+
+int affinity_nr_cpus(void);
+int affinity_nr_nodes(void);
+bool affinity_pin_thread(int index);
+void affinity_unpin_thread(void);
+void affinity_get_location(int *cpu,int *node);
+
+/*
+	What each worker did, and where. Every record sits on its own cache line,
+	so that updating it does not cause false sharing between workers.
+*/
+
+#define CACHE_LINE_SIZE		(64)
+
+struct monitor_slot_t;
+
+struct worker_stats_t
+{
+	_Alignas(CACHE_LINE_SIZE) int cpu,node;
+	int migrations;
+	long runs,points;
+
+	/*
+		The time spent on the runs, and the memory used by the simulation
+		contexts of the worker, if they live in an arena, see context.c.
+	*/
+
+	double busy;
+	size_t memory;
+
+	/*
+		Where the worker publishes its progress, if the monitor is running, see monitor.c.
+	*/
+
+	struct monitor_slot_t *monitor;
+};
+
+void worker_stats_reset(struct worker_stats_t *ws);
+void worker_stats_update_location(struct worker_stats_t *ws);
+void worker_stats_report(struct worker_stats_t *ws,int nr_workers,FILE *out);
+
+#endif //__AFFINITY_H__
@@ -0,0 +1,195 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <sys/mman.h>
+
+#include "arena.h"
+
+struct arena_t *arena_init(bool hugepages)
+{
+	struct arena_t *ret;
+
+	if(!(ret=malloc(sizeof(struct arena_t))))
+		return NULL;
+
+	ret->chunks=NULL;
+	ret->hugepages=hugepages;
+
+	for(int c=0;c<ARENA_NR_KINDS;c++)
+		ret->bytes[c]=0;
+
+	return ret;
+}
+
+void arena_fini(struct arena_t *arena)
+{
+	if(arena)
+	{
+		struct arena_chunk_t *chunk=arena->chunks;
+
+		while(chunk)
+		{
+			struct arena_chunk_t *next=chunk->next;
+
+			munmap(chunk->base,chunk->size);
+			free(chunk);
+
+			chunk=next;
+		}
+
+		free(arena);
+	}
+}
+
+/*
+	Maps a new chunk, trying first explicit huge pages, then transparent huge pages.
+*/
+
+static struct arena_chunk_t *arena_new_chunk(struct arena_t *arena,size_t size)
+{
+	struct arena_chunk_t *ret;
+
+	if(!(ret=malloc(sizeof(struct arena_chunk_t))))
+		return NULL;
+
+	size=((size+ARENA_HUGE_PAGE_SIZE-1)/ARENA_HUGE_PAGE_SIZE)*ARENA_HUGE_PAGE_SIZE;
+
+	void *base=MAP_FAILED;
+	int kind=ARENA_REGULAR;
+
+#ifdef MAP_HUGETLB
+	if(arena->hugepages==true)
+	{
+		base=mmap(NULL,size,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB,-1,0);
+		kind=ARENA_HUGETLB;
+	}
+#endif
+
+	if(base==MAP_FAILED)
+	{
+		base=mmap(NULL,size,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS,-1,0);
+		kind=ARENA_REGULAR;
+
+		if(base==MAP_FAILED)
+		{
+			free(ret);
+			return NULL;
+		}
+
+#ifdef MADV_HUGEPAGE
+		if((arena->hugepages==true)&&(madvise(base,size,MADV_HUGEPAGE)==0))
+			kind=ARENA_THP;
+#endif
+	}
+
+	ret->base=base;
+	ret->size=size;
+	ret->used=0;
+	ret->kind=kind;
+
+	ret->next=arena->chunks;
+	arena->chunks=ret;
+
+	arena->bytes[kind]+=size;
+
+	return ret;
+}
+
+void *arena_alloc(struct arena_t *arena,size_t size)
+{
+	assert(arena!=NULL);
+
+	size=((size+ARENA_ALIGNMENT-1)/ARENA_ALIGNMENT)*ARENA_ALIGNMENT;
+
+	/*
+		Only the most recent chunk is looked at: the buffers are large, so
+		the space left at the end of older chunks is not worth looking for.
+	*/
+
+	struct arena_chunk_t *chunk=arena->chunks;
+
+	if((chunk==NULL)||((chunk->size-chunk->used)<size))
+		if(!(chunk=arena_new_chunk(arena,size)))
+			return NULL;
+
+	void *ret=chunk->base+chunk->used;
+	chunk->used+=size;
+
+	return ret;
+}
+
+size_t arena_total_bytes(struct arena_t *arena)
+{
+	size_t ret=0;
+
+	for(int c=0;c<ARENA_NR_KINDS;c++)
+		ret+=arena->bytes[c];
+
+	return ret;
+}
+
+/*
+	Note that transparent huge pages are only a request to the kernel,
+	which will be honoured depending on the system settings and on
+	memory fragmentation.
+*/
+
+void arena_report(struct arena_t *arena,FILE *out)
+{
+	double mb=1024.0*1024.0;
+
+	fprintf(out,"Arena: %.1f MB on explicit huge pages, %.1f MB on transparent huge pages (requested), %.1f MB on regular pages\n",
+		arena->bytes[ARENA_HUGETLB]/mb,arena->bytes[ARENA_THP]/mb,arena->bytes[ARENA_REGULAR]/mb);
+}
+
+void *arena_or_malloc(struct arena_t *arena,size_t size)
+{
+	if(arena)
+		return arena_alloc(arena,size);
+
+	return malloc(size);
+}
+
+void arena_or_free(struct arena_t *arena,void *ptr)
+{
+	if((arena==NULL)&&(ptr!=NULL))
+		free(ptr);
+}
+
+void arena_estimate_init(struct arena_estimate_t *estimate,bool arena)
+{
+	estimate->arena=arena;
+	estimate->bytes=0;
+	estimate->chunk_free=0;
+}
+
+/*
+	The same rounding as arena_alloc() and arena_new_chunk().
+*/
+
+void arena_estimate_alloc(struct arena_estimate_t *estimate,size_t size)
+{
+	if(estimate->arena==false)
+	{
+		arena_estimate_malloc(estimate,size);
+		return;
+	}
+
+	size=((size+ARENA_ALIGNMENT-1)/ARENA_ALIGNMENT)*ARENA_ALIGNMENT;
+
+	if(estimate->chunk_free<size)
+	{
+		size_t chunk=((size+ARENA_HUGE_PAGE_SIZE-1)/ARENA_HUGE_PAGE_SIZE)*ARENA_HUGE_PAGE_SIZE;
+
+		estimate->bytes+=chunk;
+		estimate->chunk_free=chunk;
+	}
+
+	estimate->chunk_free-=size;
+}
+
+void arena_estimate_malloc(struct arena_estimate_t *estimate,size_t size)
+{
+	estimate->bytes+=size;
+}
@@ -0,0 +1,82 @@
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+	An arena allocator for the large lattice and label buffers, backed whenever
+	possible by 2 MB huge pages, so that the nearly random accesses made by the
+	union-find algorithm cause fewer TLB misses.
+
+	Memory is obtained in chunks, each one being a multiple of 2 MB, and it is
+	handed out by simply bumping a pointer. Nothing is freed until the whole
+	arena is released.
+*/
+
+#define ARENA_HUGE_PAGE_SIZE	(2*1024*1024)
+#define ARENA_ALIGNMENT		(64)
+
+/*
+	How each chunk has been obtained: explicit huge pages from the hugetlbfs
+	pool, transparent huge pages requested via madvise(), or regular pages.
+*/
+
+#define ARENA_HUGETLB		(0)
+#define ARENA_THP		(1)
+#define ARENA_REGULAR		(2)
+#define ARENA_NR_KINDS		(3)
+
+struct arena_chunk_t
+{
+	char *base;
+	size_t size,used;
+	int kind;
+
+	struct arena_chunk_t *next;
+};
+
+struct arena_t
+{
+	struct arena_chunk_t *chunks;
+
+	/*
+		When false, MAP_HUGETLB and madvise() are not even tried.
+	*/
+
+	bool hugepages;
+
+	size_t bytes[ARENA_NR_KINDS];
+};
+
+struct arena_t *arena_init(bool hugepages);
+void arena_fini(struct arena_t *arena);
+void *arena_alloc(struct arena_t *arena,size_t size);
+size_t arena_total_bytes(struct arena_t *arena);
+void arena_report(struct arena_t *arena,FILE *out);
+
+/*
+	Helpers for objects that may or may not live in an arena.
+*/
+
+void *arena_or_malloc(struct arena_t *arena,size_t size);
+void arena_or_free(struct arena_t *arena,void *ptr);
+
+/*
+	Estimates of the memory taken by a sequence of allocations, made without
+	allocating anything: arena_estimate_alloc() follows arena_or_malloc(), so
+	that the space left at the end of the chunks of an arena is counted too.
+*/
+
+struct arena_estimate_t
+{
+	bool arena;
+	size_t bytes,chunk_free;
+};
+
+void arena_estimate_init(struct arena_estimate_t *estimate,bool arena);
+void arena_estimate_alloc(struct arena_estimate_t *estimate,size_t size);
+void arena_estimate_malloc(struct arena_estimate_t *estimate,size_t size);
+
+#endif //__ARENA_H__
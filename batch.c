@@ -0,0 +1,956 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#else
+#define omp_get_max_threads()	(1)
+#define omp_get_thread_num()	(0)
+#endif
+
+#include <gsl/gsl_rng.h>
+
+#include "bonds.h"
+#include "clusters.h"
+#include "simulation.h"
+#include "context.h"
+#include "arena.h"
+#include "affinity.h"
+#include "pipeline.h"
+#include "refine.h"
+#include "budget.h"
+#include "scheduler.h"
+#include "checkpoint.h"
+#include "store.h"
+#include "evlog.h"
+#include "writer.h"
+#include "instrument.h"
+#include "monitor.h"
+#include "governor.h"
+#include "batch.h"
+
+/*
+	The exact fractions of the sites in percolating clusters, see nclusters_evaluate(),
+	followed by the statistical error on the one along either direction.
+*/
+
+static void write_strength(FILE *out,const double *strength,double strength_sq,double runs)
+{
+	for(int c=0;c<NR_OF_CROSSINGS;c++)
+		fprintf(out,"%f ",strength[c]/runs);
+
+	double mean=strength[CROSSING_EITHER]/runs;
+	double variance=(runs>1.0)?((strength_sq-runs*mean*mean)/(runs-1.0)):(0.0);
+
+	fprintf(out,"%f ",sqrt(MAX(variance,0.0)/runs));
+}
+
+/*
+	The cluster observables, see clusters.h: the mean cluster size with its
+	statistical error, the correlation length, then, for each bin of sizes,
+	the number of clusters per site and per unit size, i.e. n_s averaged over
+	the bin, and the root mean square radius of gyration.
+*/
+
+static void write_observables(FILE *out,const struct cluster_observables_t *observables,double runs,double nr_sites)
+{
+	double mean=observables->chi/runs;
+	double variance=(runs>1.0)?((observables->chi_sq-runs*mean*mean)/(runs-1.0)):(0.0);
+	double xi=(observables->xi_den>0.0)?(sqrt(observables->xi_num/observables->xi_den)):(0.0);
+
+	fprintf(out,"%f %f %f ",mean,sqrt(MAX(variance,0.0)/runs),xi);
+
+	for(int c=0;c<CLUSTER_NR_BINS;c++)
+		fprintf(out,"%g ",observables->clusters[c]/(runs*nr_sites*(1U<<c)));
+
+	for(int c=0;c<CLUSTER_NR_BINS;c++)
+	{
+		double rg=(observables->clusters[c]>0.0)?(sqrt(observables->rg2[c]/observables->clusters[c])):(0.0);
+
+		fprintf(out,"%f ",rg);
+	}
+}
+
+/*
+	A row of the main output file, and of the one with the cluster observables.
+*/
+
+static void write_main_row(struct config_t *config,FILE *out,double p,double pperp,struct statistics_t *total)
+{
+	double runs=total->runs;
+
+	fprintf(out,"%f %f ",p,pperp);
+	fprintf(out,"%f ",((double)(total->cntbilayer))/runs);
+	fprintf(out,"%f ",((double)(total->cntsingle))/runs);
+	fprintf(out,"%f ",((double)(total->jumps))/runs);
+	fprintf(out,"%f ",((double)(total->matches1))/runs);
+	fprintf(out,"%f ",((double)(total->matches2))/runs);
+	fprintf(out,"%f ",((double)(total->nr_percolating1))/runs);
+	fprintf(out,"%f ",((double)(total->nr_percolating2))/runs);
+
+	for(int z=0;z<config->nrlayers;z++)
+		fprintf(out,"%f ",((double)(total->matches1_by_layer[z]))/runs);
+
+	for(int z=0;z<config->nrlayers;z++)
+		fprintf(out,"%f ",((double)(total->matches2_by_layer[z]))/runs);
+
+	/*
+		The number of runs varies from point to point with adaptive sampling,
+		with a compute budget and when topping up a point from the store: it
+		is always written, so that the columns do not depend on the executor.
+	*/
+
+	fprintf(out,"%d ",total->runs);
+
+	/*
+		The exact fractions come last, so that the columns above keep their places.
+	*/
+
+	write_strength(out,total->strength1,total->strength1_sq,runs);
+	write_strength(out,total->strength2,total->strength2_sq,runs);
+
+	for(int z=0;z<config->nrlayers;z++)
+		fprintf(out,"%f ",total->strength1_by_layer[z]/runs);
+
+	for(int z=0;z<config->nrlayers;z++)
+		fprintf(out,"%f ",total->strength2_by_layer[z]/runs);
+
+	fprintf(out,"\n");
+}
+
+static void write_clusters_row(struct config_t *config,FILE *out,double p,double pperp,struct statistics_t *total)
+{
+	double runs=total->runs;
+	double nr_sites=((double)(config->xdim))*config->ydim*config->nrlayers;
+
+	fprintf(out,"%f %f ",p,pperp);
+	write_observables(out,&total->observables[0],runs,nr_sites);
+	write_observables(out,&total->observables[1],runs,nr_sites);
+	fprintf(out,"\n");
+}
+
+/*
+	Writes the results for a single point of the grid, called by the writer thread.
+*/
+
+void write_point(struct config_t *config,struct outputs_t *outputs,double p,double pperp,struct statistics_t *total)
+{
+	FILE *out2=outputs->out2;
+	FILE *out3=outputs->out3;
+
+	if(config->verbose==true)
+	{
+		fprintf(stderr,"%f %f\n",p,pperp);
+	}
+
+	write_main_row(config,outputs->out,p,pperp,total);
+
+	if(config->measure_jumps==true)
+	{
+
+		fprintf(out2, "%f %f ", p, pperp);
+
+		for(int c=0;c<ifactorial(config->nrlayers);c++)
+			fprintf(out2, "%d ", total->pbins[c]);
+
+		fprintf(out2, "\n");
+
+		fprintf(out3, "%f %f ", p, pperp);
+
+		for(int c=0;c<config->nrlayers;c++)
+			fprintf(out3, "%d ", total->ns[c]);
+
+		fprintf(out3, "\n");
+	}
+
+	if(config->cluster_observables==true)
+		write_clusters_row(config,outputs->out4,p,pperp,total);
+
+	/*
+		The rows for the other boundary condition, see analyze_bonds(), are
+		written by the same code, from a copy with the statistics swapped:
+		the totals may still be needed by the caller.
+	*/
+
+	if(config->dual_bc==true)
+	{
+		struct statistics_t other=*total;
+
+		stats_swap_dual(&other);
+
+		write_main_row(config,outputs->out5,p,pperp,&other);
+
+		if(config->cluster_observables==true)
+			write_clusters_row(config,outputs->out6,p,pperp,&other);
+	}
+
+#ifdef ML_INSTRUMENT
+	instrument_write(outputs->instr,p,pperp,total->runs,&total->instr);
+#endif
+}
+
+/*
+	Performs all the runs at a single point of the grid, accumulating the results
+	in 'total': either the number set for the point, see point_nr_runs(), or, with
+	adaptive sampling, as many as needed to satisfy point_converged().
+
+	The runs are added to the event log through 'evlog', if not NULL, and left
+	there for the caller, otherwise through a buffer flushed before returning.
+*/
+
+void do_point(struct simulation_ctx_t *ctx,struct config_t *config,struct point_t *point,struct statistics_t *total,struct worker_stats_t *worker,struct evlog_buffer_t *evlog)
+{
+	int max_runs=(config->adaptive==true)?(config->max_runs):(point_nr_runs(config,point));
+
+	gsl_rng *rng_ctx=gsl_rng_alloc(gsl_rng_mt19937);
+	assert(rng_ctx!=NULL);
+	seed_rng(rng_ctx);
+
+	struct evlog_buffer_t own;
+
+	if(evlog==NULL)
+	{
+		evlog_buffer_init(&own,config->evlog,false);
+		evlog=&own;
+	}
+
+	reset_stats(total);
+
+	for(int c=0;c<max_runs;c++)
+	{
+		struct statistics_t stats;
+		reset_stats(&stats);
+
+		double start=get_time();
+
+		int result=do_run(ctx, config, point->p, point->pperp, rng_ctx, &stats);
+		count_percolation(&stats,result);
+
+		stats.cpu_time=get_time()-start;
+
+		evlog_buffer_add(evlog,point->p,point->pperp,result,&stats);
+		add_stats(total,&stats);
+
+		worker->runs++;
+
+		if(worker->monitor!=NULL)
+			monitor_run_done(worker->monitor,point->p,point->pperp,&stats,stats.cpu_time);
+
+		if((config->verbose==true)&&((c%100)==0))
+			fprintf(stderr,"%d/%d\n",c,max_runs);
+
+		if((config->adaptive==true)&&(point_converged(config,total)==true))
+			break;
+
+		/*
+			The process is being stopped, see checkpoint.c.
+		*/
+
+		if(checkpoint_interrupted()==true)
+			break;
+	}
+
+	if(evlog==&own)
+		evlog_buffer_fini(&own);
+
+	gsl_rng_free(rng_ctx);
+}
+
+/*
+	The OpenMP executor, with the same interface as pipeline_run(): the points
+	are distributed dynamically among 'nr_workers' threads, or as many as
+	OpenMP chooses if it is 0.
+
+	Each thread is pinned first, if requested, then it creates its own
+	simulation context, which is then reused for all the runs at all the
+	points the thread works on.
+*/
+
+void openmp_run(struct config_t *config,struct point_t *points,int nr_points,point_done_t point_done,void *data)
+{
+	int nr_workers=(config->nr_workers>0)?(config->nr_workers):(omp_get_max_threads());
+	nr_workers=governor_workers(config,simulation_ctx_estimate(config),simulation_ctx_graph_estimate(config),nr_workers);
+
+	struct worker_stats_t *workers=aligned_alloc(CACHE_LINE_SIZE,sizeof(struct worker_stats_t)*nr_workers);
+	assert(workers);
+
+	for(int c=0;c<nr_workers;c++)
+		worker_stats_reset(&workers[c]);
+
+	long planned=0;
+
+	for(int c=0;c<nr_points;c++)
+		planned+=(config->adaptive==true)?(config->max_runs):(point_nr_runs(config,&points[c]));
+
+	monitor_plan(planned);
+
+#ifdef NDEBUG
+#pragma omp parallel default(none) shared(config,points,nr_points,point_done,data,workers,stderr) num_threads(nr_workers)
+#endif
+
+	{
+		struct worker_stats_t *worker=&workers[omp_get_thread_num()];
+
+		if(config->pin_threads==true)
+			affinity_pin_thread(omp_get_thread_num());
+
+		struct simulation_ctx_t *ctx=simulation_ctx_init(config);
+		assert(ctx!=NULL);
+
+		worker->memory=simulation_ctx_bytes(ctx);
+		worker->monitor=monitor_acquire();
+		monitor_set_memory(worker->monitor,worker->memory);
+
+#pragma omp master
+		{
+			if(ctx->arena!=NULL)
+				arena_report(ctx->arena,stderr);
+		}
+
+#ifdef NDEBUG
+#pragma omp for schedule(dynamic)
+#endif
+
+		for(int c=0;c<nr_points;c++)
+		{
+			worker_stats_update_location(worker);
+
+			struct statistics_t total;
+			double start=get_time();
+
+			do_point(ctx,config,&points[c],&total,worker,NULL);
+
+			worker->busy+=get_time()-start;
+			worker->points++;
+
+#pragma omp critical
+			{
+				point_done(c,&points[c],&total,data);
+			}
+		}
+
+		monitor_release(worker->monitor);
+		simulation_ctx_fini(ctx);
+	}
+
+	/*
+		The master thread takes part to the parallel region, so it
+		must get back all the CPUs for what comes next.
+	*/
+
+	if(config->pin_threads==true)
+		affinity_unpin_thread();
+
+	if((config->verbose==true)||(affinity_nr_nodes()>1))
+		worker_stats_report(workers,nr_workers,stderr);
+
+	if(config->worker_stats!=NULL)
+		memcpy(config->worker_stats,workers,sizeof(struct worker_stats_t)*nr_workers);
+
+	free(workers);
+}
+
+/*
+	Runs a list of points, with the executor selected by the configuration.
+*/
+
+void batch_run_points(struct config_t *config,struct point_t *points,int nr_points,point_done_t point_done,void *data)
+{
+	/*
+		In the pipelined executor the runs are generated ahead of
+		the analysis, so it cannot stop early at a given point.
+	*/
+
+	bool pipelined=(config->pipelined==true)&&(config->engine==ENGINE_REFERENCE)&&(config->adaptive==false);
+
+	if(pipelined==true)
+	{
+		pipeline_run(config,points,nr_points,point_done,data);
+	}
+	else if(config->scheduler==true)
+	{
+		struct scheduler_job_t job;
+
+		job.config=config;
+		job.points=points;
+		job.nr_points=nr_points;
+		job.point_done=point_done;
+		job.data=data;
+		job.outputs=NULL;
+
+		scheduler_run(&job,1,NULL);
+	}
+	else
+	{
+		openmp_run(config,points,nr_points,point_done,data);
+	}
+}
+
+/*
+	The values along one direction, either from an explicit list or from the grid.
+*/
+
+static double *grid_values(double *list,int nr_list,int min,int max,int inc,int *nr_values)
+{
+	int c=0;
+
+	if(nr_list>0)
+		c=nr_list;
+	else
+		for(int milli=min;milli<=max;milli+=inc)
+			c++;
+
+	double *ret=malloc(sizeof(double)*MAX(c,1));
+	assert(ret);
+
+	*nr_values=c;
+
+	if(nr_list>0)
+	{
+		for(c=0;c<nr_list;c++)
+			ret[c]=list[c];
+	}
+	else
+	{
+		c=0;
+
+		for(int milli=min;milli<=max;milli+=inc)
+			ret[c++]=0.001*milli;
+	}
+
+	return ret;
+}
+
+/*
+	All the points of the grid defined in the configuration, with pperp
+	varying more slowly.
+*/
+
+struct point_t *grid_points(struct config_t *config,int *nr_points)
+{
+	int nr_ps,nr_pperps;
+
+	double *ps=grid_values(config->ps,config->nr_ps,config->minmillip,config->maxmillip,config->incmillip,&nr_ps);
+	double *pperps=grid_values(config->pperps,config->nr_pperps,config->minmillipperp,config->maxmillipperp,config->incmillipperp,&nr_pperps);
+
+	struct point_t *ret=malloc(sizeof(struct point_t)*MAX(nr_ps*nr_pperps,1));
+	assert(ret);
+
+	*nr_points=nr_ps*nr_pperps;
+
+	for(int c=0;c<nr_pperps;c++)
+	{
+		for(int d=0;d<nr_ps;d++)
+		{
+			ret[c*nr_ps+d].p=ps[d];
+			ret[c*nr_ps+d].pperp=pperps[c];
+			ret[c*nr_ps+d].runs=0;
+		}
+	}
+
+	if(ps)
+		free(ps);
+
+	if(pperps)
+		free(pperps);
+
+	return ret;
+}
+
+/*
+	Each point is handed over to the writer as soon as it is done and, when
+	using the result store, saved there too if it got new runs.
+*/
+
+struct batch_data_t
+{
+	struct config_t *config;
+	struct outputs_t *outputs;
+
+	const char *store;
+	int *stored_runs;
+};
+
+static void batch_point_done(int index,struct point_t *point,struct statistics_t *total,void *data)
+{
+	struct batch_data_t *batch_data=data;
+	const char *store=NULL;
+
+	if((batch_data->stored_runs!=NULL)&&(total->runs>batch_data->stored_runs[index]))
+		store=batch_data->store;
+
+	writer_submit(batch_data->outputs->stream,index,point,total,store);
+}
+
+/*
+	The twin output files, with both boundary conditions along z, are named
+	after the boundary condition that they hold, i.e. the one not in 'pbcz'.
+*/
+
+static const char *dual_suffix(struct config_t *config)
+{
+	return (config->pbcz==true)?("open"):("pbcz");
+}
+
+/*
+	The output files are fully buffered: the writer flushes them as soon
+	as it has nothing else to do, so that partial results are not lost.
+
+	When resuming from a checkpoint, the files are kept, but truncated to
+	the lengths they had at the time of the checkpoint.
+*/
+
+#define OUTPUT_BUFFER_SIZE	(1<<16)
+
+static FILE *output_open(const char *filename,long offset)
+{
+	FILE *ret=fopen(filename,(offset>=0)?("r+"):("w+"));
+	assert(ret);
+
+	setvbuf(ret,(char *)(NULL),_IOFBF,OUTPUT_BUFFER_SIZE);
+
+	if(offset>=0)
+	{
+		if(ftruncate(fileno(ret),offset)!=0)
+			fprintf(stderr,"Warning: couldn't truncate %s.\n",filename);
+
+		fseek(ret,0,SEEK_END);
+	}
+
+	return ret;
+}
+
+/*
+	With 'nr_points' positive, the rows are written in the order of the points, see writer.c.
+*/
+
+static void outputs_open(struct config_t *config,const char *prefix,struct outputs_t *outputs,long *offsets,struct writer_t *writer,int nr_points)
+{
+	char outfile[1024],outfile2[1024],outfile3[1024],outfile4[1024],outfile5[1024],outfile6[1024],evlogfile[1024];
+
+	snprintf(outfile,1024,"%s.dat",prefix);
+	snprintf(outfile2,1024,"%s.bins.dat",prefix);
+	snprintf(outfile3,1024,"%s.ns.dat",prefix);
+	snprintf(outfile4,1024,"%s.clusters.dat",prefix);
+	snprintf(outfile5,1024,"%s.%s.dat",prefix,dual_suffix(config));
+	snprintf(outfile6,1024,"%s.%s.clusters.dat",prefix,dual_suffix(config));
+	snprintf(evlogfile,1024,"%s.events",prefix);
+
+	outputs->out=outputs->out2=outputs->out3=outputs->out4=outputs->out5=outputs->out6=NULL;
+	outputs->evlog=NULL;
+
+	if(config->event_log==true)
+		outputs->evlog=evlog_open(config,evlogfile,(offsets!=NULL)?(offsets[6]):(-1));
+
+	config->evlog=outputs->evlog;
+
+	outputs->out=output_open(outfile,(offsets!=NULL)?(offsets[0]):(-1));
+
+	if(config->measure_jumps==true)
+	{
+		outputs->out2=output_open(outfile2,(offsets!=NULL)?(offsets[1]):(-1));
+		outputs->out3=output_open(outfile3,(offsets!=NULL)?(offsets[2]):(-1));
+	}
+
+	if(config->cluster_observables==true)
+		outputs->out4=output_open(outfile4,(offsets!=NULL)?(offsets[3]):(-1));
+
+	if(config->dual_bc==true)
+		outputs->out5=output_open(outfile5,(offsets!=NULL)?(offsets[4]):(-1));
+
+	if((config->dual_bc==true)&&(config->cluster_observables==true))
+		outputs->out6=output_open(outfile6,(offsets!=NULL)?(offsets[5]):(-1));
+
+#ifdef ML_INSTRUMENT
+
+	/*
+		Not covered by the checkpoints: when resuming, the rows are appended, and
+		the points done after the last checkpoint may appear twice.
+	*/
+
+	char instrfile[1024];
+
+	snprintf(instrfile,1024,"%s.instr.dat",prefix);
+
+	outputs->instr=fopen(instrfile,(offsets!=NULL)?("a"):("w"));
+	assert(outputs->instr);
+
+	if(offsets==NULL)
+		instrument_write_header(outputs->instr);
+#endif
+
+	outputs->stream=writer_stream_open(writer,config,outputs,nr_points);
+}
+
+/*
+	Whether the output files are still there, at least as long as they were at the
+	time of the checkpoint: otherwise the batch cannot be resumed.
+*/
+
+static bool outputs_check(struct config_t *config,const char *prefix,long *offsets)
+{
+	char outfile[1024],dual[64],dual_clusters[64];
+
+	snprintf(dual,64,".%s.dat",dual_suffix(config));
+	snprintf(dual_clusters,64,".%s.clusters.dat",dual_suffix(config));
+
+	const char *suffixes[CHECKPOINT_NR_OUTPUTS]={".dat",".bins.dat",".ns.dat",".clusters.dat",dual,dual_clusters,".events"};
+	bool opened[CHECKPOINT_NR_OUTPUTS]={true,config->measure_jumps,config->measure_jumps,config->cluster_observables,
+		config->dual_bc,(config->dual_bc==true)&&(config->cluster_observables==true),config->event_log};
+
+	for(int c=0;c<CHECKPOINT_NR_OUTPUTS;c++)
+	{
+		struct stat st;
+
+		if(opened[c]==false)
+			continue;
+
+		snprintf(outfile,1024,"%s%s",prefix,suffixes[c]);
+
+		if((stat(outfile,&st)!=0)||(st.st_size<offsets[c]))
+			return false;
+	}
+
+	return true;
+}
+
+static void outputs_close(struct config_t *config,struct outputs_t *outputs)
+{
+	writer_sync(outputs->stream->writer);
+	writer_stream_close(outputs->stream);
+
+	evlog_close(outputs->evlog);
+	config->evlog=NULL;
+
+	if(outputs->out)
+		fclose(outputs->out);
+
+	if(outputs->out2)
+		fclose(outputs->out2);
+
+	if(outputs->out3)
+		fclose(outputs->out3);
+
+	if(outputs->out4)
+		fclose(outputs->out4);
+
+	if(outputs->out5)
+		fclose(outputs->out5);
+
+	if(outputs->out6)
+		fclose(outputs->out6);
+
+#ifdef ML_INSTRUMENT
+	if(outputs->instr)
+		fclose(outputs->instr);
+#endif
+}
+
+static void batch_warnings(struct config_t *config)
+{
+	if((config->pipelined==true)&&(config->engine!=ENGINE_REFERENCE))
+		fprintf(stderr,"Warning: the pipelined executor needs the reference engine, running sequentially.\n");
+	else if((config->pipelined==true)&&(config->adaptive==true)&&(config->budget<=0.0))
+		fprintf(stderr,"Warning: the pipelined executor does not support adaptive sampling, running sequentially.\n");
+}
+
+void do_batch(struct config_t *config,const char *prefix)
+{
+	struct writer_t *writer=writer_init();
+	struct outputs_t outputs;
+
+	governor_select_engine(config,prefix);
+	batch_warnings(config);
+
+	if(config->budget>0.0)
+	{
+		outputs_open(config,prefix,&outputs,NULL,writer,0);
+		do_batch_budgeted(config,&outputs);
+	}
+	else if(config->refine==true)
+	{
+		outputs_open(config,prefix,&outputs,NULL,writer,0);
+		do_batch_refined(config,&outputs);
+	}
+	else
+	{
+		int nr_points;
+		struct point_t *points=grid_points(config,&nr_points);
+
+		outputs_open(config,prefix,&outputs,NULL,writer,nr_points);
+
+		struct batch_data_t batch_data;
+
+		batch_data.config=config;
+		batch_data.outputs=&outputs;
+		batch_data.store=NULL;
+		batch_data.stored_runs=NULL;
+
+		batch_run_points(config,points,nr_points,batch_point_done,&batch_data);
+
+		if(points)
+			free(points);
+	}
+
+	outputs_close(config,&outputs);
+	writer_fini(writer);
+}
+
+/*
+	Several batches at once: the plain ones share the same pool of workers, so
+	that the expensive points of all the batches are started first. Batches with
+	a compute budget, grid refinement or the pipelined executor need to look at
+	their results as they go, and they are run one after the other afterwards,
+	as are the batches asking for the OpenMP executor instead of the scheduler.
+
+	If 'checkpoint' is not NULL, the state of the plain batches is saved there,
+	and they are resumed from it if it exists, see checkpoint.c. The checkpoint
+	is removed when all the batches are done.
+
+	If 'store' is not NULL, the plain batches without adaptive sampling start each
+	point from the runs in the result store, see store.c, running only the ones
+	that are missing. When resuming from a checkpoint, its state already includes
+	what came from the store.
+*/
+
+static bool batch_is_plain(struct config_t *config)
+{
+	if((config->budget>0.0)||(config->refine==true))
+		return false;
+
+	if((config->pipelined==true)&&(config->engine==ENGINE_REFERENCE)&&(config->adaptive==false))
+		return false;
+
+	if(config->scheduler==false)
+		return false;
+
+	return true;
+}
+
+/*
+	Looks up all the points in the store, returning the initial state of the points
+	in 'checkpoint', if it is empty, and how many runs are there in 'stored_runs'.
+*/
+
+static void batch_store_lookup(const char *store,struct scheduler_job_t *jobs,const char **prefixes,int nr_jobs,struct checkpoint_t *checkpoint)
+{
+	struct statistics_t *scratch=malloc(sizeof(struct statistics_t));
+	assert(scratch);
+
+	bool initial=(checkpoint->jobs==NULL);
+	int nr_complete=0,nr_partial=0,nr_new=0;
+
+	if(initial==true)
+	{
+		checkpoint->nr_jobs=nr_jobs;
+		checkpoint->jobs=calloc(nr_jobs,sizeof(struct checkpoint_job_t));
+		assert(checkpoint->jobs);
+	}
+
+	for(int c=0;c<nr_jobs;c++)
+	{
+		struct config_t *config=jobs[c].config;
+		struct batch_data_t *batch_data=jobs[c].data;
+
+		if(initial==true)
+		{
+			checkpoint->jobs[c].nr_points=jobs[c].nr_points;
+			checkpoint->jobs[c].points=calloc(MAX(jobs[c].nr_points,1),sizeof(struct checkpoint_point_t));
+			assert(checkpoint->jobs[c].points);
+		}
+
+		if(config->adaptive==true)
+		{
+			fprintf(stderr,"Warning: batch %s uses adaptive sampling, and does not use the result store.\n",prefixes[c]);
+			continue;
+		}
+
+		batch_data->store=store;
+		batch_data->stored_runs=calloc(MAX(jobs[c].nr_points,1),sizeof(int));
+		assert(batch_data->stored_runs);
+
+		for(int d=0;d<jobs[c].nr_points;d++)
+		{
+			char *total=malloc(stats_compact_size(config));
+			assert(total);
+
+			if(store_load(store,config,&jobs[c].points[d],total)==false)
+			{
+				free(total);
+				nr_new++;
+				continue;
+			}
+
+			stats_expand(config,total,scratch);
+			batch_data->stored_runs[d]=scratch->runs;
+
+			if(scratch->runs>=point_nr_runs(config,&jobs[c].points[d]))
+				nr_complete++;
+			else
+				nr_partial++;
+
+			if(initial==true)
+			{
+				checkpoint->jobs[c].points[d].status=CHECKPOINT_PARTIAL;
+				checkpoint->jobs[c].points[d].runs=scratch->runs;
+				checkpoint->jobs[c].points[d].total=total;
+			}
+			else
+			{
+				free(total);
+			}
+		}
+	}
+
+	fprintf(stderr,"Result store %s: %d points complete, %d to be topped up, %d new\n",store,nr_complete,nr_partial,nr_new);
+
+	free(scratch);
+}
+
+void do_batches(struct config_t *configs,const char **prefixes,int nr_batches,const char *checkpoint_file,const char *store)
+{
+	struct scheduler_job_t *jobs=malloc(sizeof(struct scheduler_job_t)*MAX(nr_batches,1));
+	struct outputs_t *outputs=malloc(sizeof(struct outputs_t)*MAX(nr_batches,1));
+	struct batch_data_t *batch_data=malloc(sizeof(struct batch_data_t)*MAX(nr_batches,1));
+	const char **job_prefixes=malloc(sizeof(char *)*MAX(nr_batches,1));
+	assert(jobs&&outputs&&batch_data&&job_prefixes);
+
+	int nr_jobs=0;
+
+	for(int c=0;c<nr_batches;c++)
+	{
+		/*
+			The engine is chosen first, since it selects the executor, and
+			it is part of the key of the points in the store.
+		*/
+
+		governor_select_engine(&configs[c],prefixes[c]);
+
+		if(batch_is_plain(&configs[c])==false)
+		{
+			if(checkpoint_file!=NULL)
+				fprintf(stderr,"Warning: batch %s is not saved in the checkpoint.\n",prefixes[c]);
+
+			if(store!=NULL)
+				fprintf(stderr,"Warning: batch %s does not use the result store.\n",prefixes[c]);
+
+			continue;
+		}
+
+		batch_data[nr_jobs].config=&configs[c];
+		batch_data[nr_jobs].outputs=&outputs[nr_jobs];
+		batch_data[nr_jobs].store=NULL;
+		batch_data[nr_jobs].stored_runs=NULL;
+
+		jobs[nr_jobs].config=&configs[c];
+		jobs[nr_jobs].points=grid_points(&configs[c],&jobs[nr_jobs].nr_points);
+		jobs[nr_jobs].point_done=batch_point_done;
+		jobs[nr_jobs].data=&batch_data[nr_jobs];
+		jobs[nr_jobs].outputs=&outputs[nr_jobs];
+		job_prefixes[nr_jobs]=prefixes[c];
+		nr_jobs++;
+	}
+
+	struct checkpoint_t checkpoint;
+	bool resume=false;
+
+	checkpoint_init(&checkpoint,checkpoint_file);
+
+	if(checkpoint_file!=NULL)
+	{
+		if((nr_jobs>0)&&(checkpoint_load(&checkpoint,jobs,nr_jobs)==true))
+		{
+			resume=true;
+
+			for(int c=0;c<nr_jobs;c++)
+				if(outputs_check(jobs[c].config,job_prefixes[c],checkpoint.jobs[c].offsets)==false)
+					resume=false;
+
+			if(resume==false)
+			{
+				fprintf(stderr,"Warning: the output files do not match %s, starting from scratch.\n",checkpoint_file);
+				checkpoint_fini(&checkpoint);
+			}
+			else
+			{
+				int nr_done=0,nr_partial=0;
+
+				for(int c=0;c<nr_jobs;c++)
+				{
+					for(int d=0;d<jobs[c].nr_points;d++)
+					{
+						nr_done+=(checkpoint.jobs[c].points[d].status==CHECKPOINT_DONE)?(1):(0);
+						nr_partial+=(checkpoint.jobs[c].points[d].status==CHECKPOINT_PARTIAL)?(1):(0);
+					}
+				}
+
+				fprintf(stderr,"Resuming from %s: %d points done, %d partial\n",checkpoint_file,nr_done,nr_partial);
+			}
+		}
+	}
+
+	if((store!=NULL)&&(nr_jobs>0)&&(store_init(store)==true))
+		batch_store_lookup(store,jobs,job_prefixes,nr_jobs,&checkpoint);
+
+	/*
+		The rows of the points that are done are already in the output files.
+	*/
+
+	struct writer_t *writer=writer_init();
+
+	for(int c=0;c<nr_jobs;c++)
+	{
+		outputs_open(jobs[c].config,job_prefixes[c],&outputs[c],(resume==true)?(checkpoint.jobs[c].offsets):(NULL),writer,jobs[c].nr_points);
+		batch_warnings(jobs[c].config);
+
+		for(int d=0;(resume==true)&&(d<jobs[c].nr_points);d++)
+			if(checkpoint.jobs[c].points[d].status==CHECKPOINT_DONE)
+				writer_stream_skip(outputs[c].stream,d);
+	}
+
+	if(nr_jobs>0)
+		scheduler_run(jobs,nr_jobs,&checkpoint);
+
+	for(int c=0;c<nr_jobs;c++)
+	{
+		outputs_close(jobs[c].config,&outputs[c]);
+
+		if(batch_data[c].stored_runs)
+			free(batch_data[c].stored_runs);
+
+		if(jobs[c].points)
+			free(jobs[c].points);
+	}
+
+	writer_fini(writer);
+
+	if(checkpoint_interrupted()==false)
+	{
+		for(int c=0;c<nr_batches;c++)
+			if(batch_is_plain(&configs[c])==false)
+				do_batch(&configs[c],prefixes[c]);
+
+		if(checkpoint_file!=NULL)
+			remove(checkpoint_file);
+	}
+
+	checkpoint_fini(&checkpoint);
+
+	if(jobs)
+		free(jobs);
+
+	if(outputs)
+		free(outputs);
+
+	if(batch_data)
+		free(batch_data);
+
+	if(job_prefixes)
+		free(job_prefixes);
+}
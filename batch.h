@@ -0,0 +1,49 @@
+#ifndef __BATCH_H__
+#define __BATCH_H__
+
+#include <stdio.h>
+
+#include "clusters.h"
+#include "simulation.h"
+#include "pipeline.h"
+
+struct simulation_ctx_t;
+struct worker_stats_t;
+struct writer_stream_t;
+struct evlog_buffer_t;
+
+/*
+	The output files of a batch: the main one, the ones with the bins
+	and the cluster sizes, which are only opened when measuring jumps,
+	the one with the cluster observables, only opened when measuring
+	them, the twins of the main one and of the one with the cluster
+	observables, for the other boundary condition along z, only opened when
+	evaluating both, and optionally the event log. The results are written to them by
+	the writer thread, through 'stream', see writer.c. Instrumented builds
+	also write the timers and counters of each point to 'instr', see
+	instrument.h.
+*/
+
+struct outputs_t
+{
+	FILE *out,*out2,*out3,*out4,*out5,*out6;
+
+#ifdef ML_INSTRUMENT
+	FILE *instr;
+#endif
+
+	struct evlog_t *evlog;
+	struct writer_stream_t *stream;
+};
+
+void write_point(struct config_t *config,struct outputs_t *outputs,double p,double pperp,struct statistics_t *total);
+void do_point(struct simulation_ctx_t *ctx,struct config_t *config,struct point_t *point,struct statistics_t *total,struct worker_stats_t *worker,struct evlog_buffer_t *evlog);
+
+void openmp_run(struct config_t *config,struct point_t *points,int nr_points,point_done_t point_done,void *data);
+void batch_run_points(struct config_t *config,struct point_t *points,int nr_points,point_done_t point_done,void *data);
+struct point_t *grid_points(struct config_t *config,int *nr_points);
+
+void do_batch(struct config_t *config,const char *prefix);
+void do_batches(struct config_t *configs,const char **prefixes,int nr_batches,const char *checkpoint,const char *store);
+
+#endif //__BATCH_H__
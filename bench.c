@@ -0,0 +1,1227 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <assert.h>
+
+#include <gsl/gsl_rng.h>
+#include <gsl/gsl_cdf.h>
+
+#include "common.h"
+#include "clusters.h"
+#include "simulation.h"
+#include "context.h"
+#include "affinity.h"
+#include "pipeline.h"
+#include "batch.h"
+#include "perf.h"
+
+/*
+	Microbenchmarks for the three phases of a run with the reference engine:
+	the generation of the bonds, the labeling of the clusters, and the
+	evaluation of the jumps on the spanning cluster, over a matrix of lattice
+	sizes, numbers of layers, boundary conditions along z and probabilities.
+
+	The jumps are evaluated inside nclusters_identify_percolation(), so their
+	cost is measured as the difference between labeling the same bonds with
+	and without them.
+
+	Each configuration is run until at least 'min_samples' samples and 'min_time'
+	seconds, after one sample to warm up, and the results are printed as one
+	line per configuration, with the columns named in a header line.
+
+	With --validate, the alternative engines are checked against the reference
+	one over the same matrix, see validate_kernels() and validate_fused(), the
+	exact observables against a brute-force computation, see validate_observables(),
+	both boundary conditions along z against a periodic run, see validate_dual(),
+	and the exit status is non-zero if any of them fails.
+
+	With --scaling, fixed workloads are run through batch_run_points(), as in
+	do_batch(), with an increasing number of threads, see scaling_run().
+
+	With --perf, the timing mode also reads the hardware performance counters
+	around each phase, see perf.c, and reports the instructions per cycle and
+	the events per site, to tell whether a phase is bound by the latency or
+	by the bandwidth of the memory.
+
+	Usage: multilayer_bench [options], see usage() below.
+*/
+
+#define BENCH_MAX_VALUES	(64)
+
+#define BENCH_MODE_TIMING	(0)
+#define BENCH_MODE_VALIDATE	(1)
+#define BENCH_MODE_SCALING	(2)
+
+struct bench_options_t
+{
+	int mode;
+
+	int ls[BENCH_MAX_VALUES],nr_ls;
+	int layers[BENCH_MAX_VALUES],nr_layers;
+	int pbczs[BENCH_MAX_VALUES],nr_pbczs;
+	double ps[BENCH_MAX_VALUES],pperps[BENCH_MAX_VALUES];
+	int nr_ps,nr_pperps;
+
+	bool jumps,generic,hugepages,perf;
+	int min_samples;
+	double min_time,alpha;
+
+	/*
+		For --scaling: the thread counts, the workload (or -1 for all of
+		them), the runs per point (or 0 for the default) and the executor.
+	*/
+
+	int threads[BENCH_MAX_VALUES],nr_threads;
+	int scaling_case,scaling_runs;
+	bool openmp;
+};
+
+#define BENCH_GENERATION	(0)
+#define BENCH_LABELING		(1)
+#define BENCH_JUMPS		(2)
+#define BENCH_NR_PHASES		(3)
+
+struct bench_result_t
+{
+	int samples;
+	double generation,labeling,jumps;
+	long memory;
+	bool specialized;
+
+	/*
+		The hardware events in each phase, with --perf.
+	*/
+
+	double events[BENCH_NR_PHASES][PERF_NR_EVENTS];
+};
+
+/*
+	The resident memory of the process, in bytes, or -1 if unknown.
+*/
+
+static long resident_bytes(void)
+{
+	FILE *in=fopen("/proc/self/statm","r");
+	long size,resident;
+
+	if(!in)
+		return -1;
+
+	if(fscanf(in,"%ld %ld",&size,&resident)!=2)
+		resident=-1;
+
+	fclose(in);
+
+	return (resident>=0)?(resident*sysconf(_SC_PAGESIZE)):(-1);
+}
+
+static void bench_config(struct config_t *config,struct bench_options_t *options,int l,int nrlayers,bool pbcz)
+{
+	config_defaults(config);
+
+	config->xdim=config->ydim=l;
+	config->nrlayers=nrlayers;
+	config->pbcz=pbcz;
+	config->measure_jumps=options->jumps;
+	config->specialized_kernels=!options->generic;
+	config->hugepages=options->hugepages;
+}
+
+static void bench_point(struct config_t *config,struct simulation_ctx_t *ctx,double p,double pperp,
+                        gsl_rng *rng,struct bench_options_t *options,struct bench_result_t *result)
+{
+	struct statistics_t *stats=malloc(sizeof(struct statistics_t));
+	assert(stats);
+
+	result->samples=0;
+	result->generation=result->labeling=result->jumps=0.0;
+
+	for(int c=0;c<BENCH_NR_PHASES;c++)
+		for(int d=0;d<PERF_NR_EVENTS;d++)
+			result->events[c][d]=0.0;
+
+	uint64_t e0[PERF_NR_EVENTS],e1[PERF_NR_EVENTS],e2[PERF_NR_EVENTS],e3[PERF_NR_EVENTS];
+
+	double start=get_time();
+
+	for(int c=-1;;c++)
+	{
+		perf_read(e0);
+		double t0=get_time();
+
+		generate_bonds(config,ctx->ncs,p,pperp,rng);
+
+		double t1=get_time();
+		perf_read(e1);
+
+		reset_stats(stats);
+		nclusters_identify_percolation(ctx->ncs,NULL,stats,1,rng,config->pbcz);
+
+		double t2=get_time(),t3=t2;
+		perf_read(e2);
+		memcpy(e3,e2,sizeof(uint64_t)*PERF_NR_EVENTS);
+
+		if(options->jumps==true)
+		{
+			reset_stats(stats);
+			nclusters_identify_percolation(ctx->ncs,&stats->jumps,stats,1,rng,config->pbcz);
+
+			t3=get_time();
+			perf_read(e3);
+		}
+
+		/*
+			The first sample only warms up the caches.
+		*/
+
+		if(c<0)
+		{
+			start=get_time();
+			continue;
+		}
+
+		result->samples++;
+		result->generation+=t1-t0;
+		result->labeling+=t2-t1;
+		result->jumps+=MAX((t3-t2)-(t2-t1),0.0);
+
+		for(int d=0;d<PERF_NR_EVENTS;d++)
+		{
+			double generation=e1[d]-e0[d],labeling=e2[d]-e1[d],jumps=e3[d]-e2[d];
+
+			result->events[BENCH_GENERATION][d]+=generation;
+			result->events[BENCH_LABELING][d]+=labeling;
+			result->events[BENCH_JUMPS][d]+=MAX(jumps-labeling,0.0);
+		}
+
+		if((result->samples>=options->min_samples)&&(get_time()-start>=options->min_time))
+			break;
+	}
+
+	free(stats);
+}
+
+static const char *phase_names[BENCH_NR_PHASES]={"generation","labeling","jumps"};
+
+static void print_header(bool perf)
+{
+	printf("# L layers pbcz p pperp samples sites kernel memory_bytes");
+	printf(" generation_ns_per_site labeling_ns_per_site jumps_ns_per_site");
+	printf(" generation_sites_per_s labeling_sites_per_s jumps_sites_per_s total_sites_per_s");
+
+	if(perf==true)
+	{
+		for(int c=0;c<BENCH_NR_PHASES;c++)
+		{
+			printf(" %s_ipc",phase_names[c]);
+
+			for(int d=0;d<PERF_NR_EVENTS;d++)
+				printf(" %s_%s_per_site",phase_names[c],perf_event_names[d]);
+		}
+	}
+
+	printf("\n");
+}
+
+/*
+	The hardware events of each phase: instructions per cycle, and events per site.
+*/
+
+static void print_events(struct bench_result_t *result,double total_sites,bool jumps)
+{
+	for(int c=0;c<BENCH_NR_PHASES;c++)
+	{
+		double *events=result->events[c];
+		bool measured=(c!=BENCH_JUMPS)||(jumps==true);
+
+		if((measured==true)&&(perf_event_available(PERF_CYCLES)==true)&&(perf_event_available(PERF_INSTRUCTIONS)==true)&&(events[PERF_CYCLES]>0.0))
+			printf(" %f",events[PERF_INSTRUCTIONS]/events[PERF_CYCLES]);
+		else
+			printf(" nan");
+
+		for(int d=0;d<PERF_NR_EVENTS;d++)
+		{
+			if((measured==true)&&(perf_event_available(d)==true))
+				printf(" %f",events[d]/total_sites);
+			else
+				printf(" nan");
+		}
+	}
+}
+
+static void print_result(struct config_t *config,double p,double pperp,struct bench_result_t *result,bool jumps)
+{
+	double sites=((double)(config->xdim))*config->ydim*config->nrlayers;
+	double total_sites=sites*result->samples;
+	double total=result->generation+result->labeling+result->jumps;
+
+	printf("%d %d %d %f %f %d %.0f %s %ld ",config->xdim,config->nrlayers,config->pbcz,p,pperp,result->samples,sites,
+		(result->specialized==true)?("specialized"):("generic"),result->memory);
+
+	printf("%f %f ",1e9*result->generation/total_sites,1e9*result->labeling/total_sites);
+
+	if(jumps==true)
+		printf("%f ",1e9*result->jumps/total_sites);
+	else
+		printf("nan ");
+
+	printf("%e %e ",total_sites/result->generation,total_sites/result->labeling);
+
+	if(jumps==true)
+		printf("%e ",total_sites/MAX(result->jumps,1e-12));
+	else
+		printf("nan ");
+
+	printf("%e",total_sites/total);
+
+	if(perf_active==true)
+		print_events(result,total_sites,jumps);
+
+	printf("\n");
+	fflush(stdout);
+}
+
+/*
+	The specialized kernels consume the random numbers exactly as the generic
+	code does, so they are checked sample by sample: the same random state is
+	used for a run with the generic code and one with the kernel, and all the
+	observables, including the jumps and their bins, must be the same.
+*/
+
+static bool validate_kernels(struct config_t *config,double p,double pperp,gsl_rng *rng,struct bench_options_t *options)
+{
+	struct simulation_ctx_t *ctx=simulation_ctx_init(config);
+	assert(ctx);
+
+	if(ctx->ncs->kernel==NULL)
+	{
+		printf("%d %d %d %f %f kernels 0 0 nan - nan skipped\n",config->xdim,config->nrlayers,config->pbcz,p,pperp);
+		simulation_ctx_fini(ctx);
+		return true;
+	}
+
+	struct statistics_t *stats=malloc(sizeof(struct statistics_t));
+	gsl_rng *saved=gsl_rng_clone(rng);
+	size_t size=stats_compact_size(config);
+	char *reference=calloc(1,size),*candidate=calloc(1,size);
+	assert(stats&&saved&&reference&&candidate);
+
+	hk_kernel_t kernel=ctx->ncs->kernel;
+	double reference_time=0.0,candidate_time=0.0;
+	int mismatches=0;
+
+	for(int c=0;c<options->min_samples;c++)
+	{
+		gsl_rng_memcpy(saved,rng);
+
+		ctx->ncs->kernel=NULL;
+		reset_stats(stats);
+
+		double start=get_time();
+		int reference_result=do_run(ctx,config,p,pperp,rng,stats);
+		reference_time+=get_time()-start;
+
+		stats->cpu_time=0.0;
+		stats_compact(config,stats,reference);
+
+		gsl_rng_memcpy(rng,saved);
+
+		ctx->ncs->kernel=kernel;
+		reset_stats(stats);
+
+		start=get_time();
+		int candidate_result=do_run(ctx,config,p,pperp,rng,stats);
+		candidate_time+=get_time()-start;
+
+		stats->cpu_time=0.0;
+		stats_compact(config,stats,candidate);
+
+		if((reference_result!=candidate_result)||(memcmp(reference,candidate,size)!=0))
+			mismatches++;
+	}
+
+	printf("%d %d %d %f %f kernels %d %d nan - %f %s\n",config->xdim,config->nrlayers,config->pbcz,p,pperp,
+		options->min_samples,mismatches,reference_time/candidate_time,(mismatches==0)?("PASS"):("FAIL"));
+	fflush(stdout);
+
+	simulation_ctx_fini(ctx);
+	gsl_rng_free(saved);
+	free(stats);
+	free(reference);
+	free(candidate);
+
+	return (mismatches==0);
+}
+
+/*
+	The exact strength fractions and the cluster observables are checked against
+	a brute-force computation on the same bonds, independent of the labeling:
+	each cluster is found by a flood fill, its sites are counted, and its radius
+	of gyration is taken from the distances to its center of mass. The spanning
+	clusters, those as wide or as long as the lattice, are excluded from the
+	observables, as in nclusters_evaluate().
+*/
+
+struct brute_force_t
+{
+	double strength[NR_OF_CROSSINGS];
+	double strength_by_layer[MAX_NR_OF_LAYERS];
+	struct cluster_observables_t observables;
+};
+
+static int brute_force_site(struct config_t *config,int x,int y,int l)
+{
+	return (l*config->xdim+x)*config->ydim+y;
+}
+
+/*
+	Adds to the stack the neighbours of a site that are joined to it by an
+	open bond, and not visited yet.
+*/
+
+static void brute_force_push(struct config_t *config,struct nclusters_t *ncs,bool vertical,int site,char *visited,int *stack,int *top)
+{
+	int lx=config->xdim,ly=config->ydim,nrlayers=config->nrlayers;
+	int y=site%ly,x=(site/ly)%lx,l=site/(lx*ly);
+	int neighbours[6],nr_neighbours=0;
+
+	if((x<lx-1)&&(ibond2d_get_value(ncs->bonds[l],x,y,DIR_X)==1))
+		neighbours[nr_neighbours++]=brute_force_site(config,x+1,y,l);
+
+	if((x>0)&&(ibond2d_get_value(ncs->bonds[l],x-1,y,DIR_X)==1))
+		neighbours[nr_neighbours++]=brute_force_site(config,x-1,y,l);
+
+	if((y<ly-1)&&(ibond2d_get_value(ncs->bonds[l],x,y,DIR_Y)==1))
+		neighbours[nr_neighbours++]=brute_force_site(config,x,y+1,l);
+
+	if((y>0)&&(ibond2d_get_value(ncs->bonds[l],x,y-1,DIR_Y)==1))
+		neighbours[nr_neighbours++]=brute_force_site(config,x,y-1,l);
+
+	if(vertical==true)
+	{
+		int up=(l+1)%nrlayers,down=(l+nrlayers-1)%nrlayers;
+
+		if(((l<nrlayers-1)||(config->pbcz==true))&&(ivbond2d_get_value(ncs->ivbonds[l],x,y)==1))
+			neighbours[nr_neighbours++]=brute_force_site(config,x,y,up);
+
+		if(((l>0)||(config->pbcz==true))&&(ivbond2d_get_value(ncs->ivbonds[down],x,y)==1))
+			neighbours[nr_neighbours++]=brute_force_site(config,x,y,down);
+	}
+
+	for(int c=0;c<nr_neighbours;c++)
+	{
+		if(visited[neighbours[c]]==0)
+		{
+			visited[neighbours[c]]=1;
+			stack[(*top)++]=neighbours[c];
+		}
+	}
+}
+
+static void brute_force(struct config_t *config,struct nclusters_t *ncs,bool vertical,struct brute_force_t *result)
+{
+	int lx=config->xdim,ly=config->ydim,nrlayers=config->nrlayers;
+	int nr_sites=lx*ly*nrlayers;
+
+	char *visited=calloc(nr_sites,sizeof(char));
+	int *cluster=malloc(sizeof(int)*nr_sites);
+	int *layer_count=malloc(sizeof(int)*nrlayers);
+	assert(visited&&cluster&&layer_count);
+
+	memset(result,0,sizeof(struct brute_force_t));
+
+	for(int start=0;start<nr_sites;start++)
+	{
+		if(visited[start]!=0)
+			continue;
+
+		/*
+			The stack ends up holding all the sites of the cluster.
+		*/
+
+		int size=0,top=0;
+
+		visited[start]=1;
+		cluster[top++]=start;
+
+		while(size<top)
+			brute_force_push(config,ncs,vertical,cluster[size++],visited,cluster,&top);
+
+		int minx=lx,maxx=-1,miny=ly,maxy=-1;
+		double cx=0.0,cy=0.0,cz=0.0;
+
+		for(int l=0;l<nrlayers;l++)
+			layer_count[l]=0;
+
+		for(int c=0;c<size;c++)
+		{
+			int y=cluster[c]%ly,x=(cluster[c]/ly)%lx,l=cluster[c]/(lx*ly);
+
+			minx=MIN(minx,x);
+			maxx=MAX(maxx,x);
+			miny=MIN(miny,y);
+			maxy=MAX(maxy,y);
+
+			cx+=x;
+			cy+=y;
+			cz+=l;
+			layer_count[l]++;
+		}
+
+		bool xcrossing=(maxx-minx+1==lx);
+		bool ycrossing=(maxy-miny+1==ly);
+		double fraction=((double)(size))/nr_sites;
+
+		result->strength[CROSSING_X]+=(xcrossing==true)?(fraction):(0.0);
+		result->strength[CROSSING_Y]+=(ycrossing==true)?(fraction):(0.0);
+		result->strength[CROSSING_EITHER]+=((xcrossing==true)||(ycrossing==true))?(fraction):(0.0);
+		result->strength[CROSSING_BOTH]+=((xcrossing==true)&&(ycrossing==true))?(fraction):(0.0);
+
+		if((xcrossing==true)||(ycrossing==true))
+		{
+			for(int l=0;l<nrlayers;l++)
+				result->strength_by_layer[l]+=((double)(layer_count[l]))/(lx*ly);
+
+			continue;
+		}
+
+		cx/=size;
+		cy/=size;
+		cz/=size;
+
+		double rg2=0.0;
+
+		for(int c=0;c<size;c++)
+		{
+			int y=cluster[c]%ly,x=(cluster[c]/ly)%lx,l=cluster[c]/(lx*ly);
+
+			rg2+=(x-cx)*(x-cx)+(y-cy)*(y-cy)+(l-cz)*(l-cz);
+		}
+
+		rg2/=size;
+
+		int bin=0;
+
+		while((bin<CLUSTER_NR_BINS-1)&&((2<<bin)<=size))
+			bin++;
+
+		double s=size;
+
+		result->observables.clusters[bin]+=1.0;
+		result->observables.rg2[bin]+=rg2;
+		result->observables.chi+=s*s/nr_sites;
+		result->observables.xi_num+=2.0*rg2*s*s;
+		result->observables.xi_den+=s*s;
+	}
+
+	free(visited);
+	free(cluster);
+	free(layer_count);
+}
+
+static bool brute_force_close(const double *a,const double *b,int n)
+{
+	for(int c=0;c<n;c++)
+		if(fabs(a[c]-b[c])>1e-9*(1.0+fabs(a[c])+fabs(b[c])))
+			return false;
+
+	return true;
+}
+
+static bool brute_force_matches(struct config_t *config,struct brute_force_t *expected,const double *strength,
+                                const double *strength_by_layer,const struct cluster_observables_t *observables)
+{
+	const struct cluster_observables_t *e=&expected->observables;
+
+	if(brute_force_close(expected->strength,strength,NR_OF_CROSSINGS)==false)
+		return false;
+
+	if(brute_force_close(expected->strength_by_layer,strength_by_layer,config->nrlayers)==false)
+		return false;
+
+	if((brute_force_close(e->clusters,observables->clusters,CLUSTER_NR_BINS)==false)||
+	   (brute_force_close(e->rg2,observables->rg2,CLUSTER_NR_BINS)==false))
+		return false;
+
+	return (brute_force_close(&e->chi,&observables->chi,1)==true)&&
+	       (brute_force_close(&e->xi_num,&observables->xi_num,1)==true)&&
+	       (brute_force_close(&e->xi_den,&observables->xi_den,1)==true);
+}
+
+static bool validate_observables(struct config_t *config,double p,double pperp,gsl_rng *rng,struct bench_options_t *options)
+{
+	struct config_t observables_config=*config;
+
+	observables_config.measure_jumps=false;
+	observables_config.cluster_observables=true;
+
+	struct simulation_ctx_t *ctx=simulation_ctx_init(&observables_config);
+	struct statistics_t *stats=malloc(sizeof(struct statistics_t));
+	assert(ctx&&stats);
+
+	struct brute_force_t multi,single;
+	int mismatches=0;
+
+	for(int c=0;c<options->min_samples;c++)
+	{
+		generate_bonds(&observables_config,ctx->ncs,p,pperp,rng);
+
+		brute_force(&observables_config,ctx->ncs,true,&multi);
+		brute_force(&observables_config,ctx->ncs,false,&single);
+
+		reset_stats(stats);
+		analyze_bonds(&observables_config,ctx->ncs,rng,stats);
+
+		if((brute_force_matches(&observables_config,&multi,stats->strength1,stats->strength1_by_layer,&stats->observables[0])==false)||
+		   (brute_force_matches(&observables_config,&single,stats->strength2,stats->strength2_by_layer,&stats->observables[1])==false))
+			mismatches++;
+	}
+
+	printf("%d %d %d %f %f observables %d %d nan - nan %s\n",config->xdim,config->nrlayers,config->pbcz,p,pperp,
+		options->min_samples,mismatches,(mismatches==0)?("PASS"):("FAIL"));
+	fflush(stdout);
+
+	simulation_ctx_fini(ctx);
+	free(stats);
+
+	return (mismatches==0);
+}
+
+/*
+	With both boundary conditions along z, the periodic one comes from merging
+	the clusters of the open one, see nclusters_identify_percolation_wrapped().
+	The bonds are drawn as with periodic boundary conditions, and the same random
+	sites are tested, so the periodic half of each sample must be the same as a
+	run with 'pbcz' on the same random state, all its observables included. The
+	speedup is over two separate runs, each taken as long as the periodic one.
+*/
+
+static bool validate_dual(struct config_t *config,double p,double pperp,gsl_rng *rng,struct bench_options_t *options)
+{
+	struct config_t dual_config=*config,periodic_config=*config;
+
+	dual_config.measure_jumps=periodic_config.measure_jumps=false;
+	dual_config.cluster_observables=periodic_config.cluster_observables=true;
+	dual_config.dual_bc=true;
+	periodic_config.pbcz=true;
+
+	struct simulation_ctx_t *dual_ctx=simulation_ctx_init(&dual_config);
+	struct simulation_ctx_t *periodic_ctx=simulation_ctx_init(&periodic_config);
+	struct statistics_t *stats=malloc(sizeof(struct statistics_t));
+	gsl_rng *saved=gsl_rng_clone(rng);
+	size_t size=stats_compact_size(&periodic_config);
+	char *reference=calloc(1,size),*candidate=calloc(1,size);
+	assert(dual_ctx&&periodic_ctx&&stats&&saved&&reference&&candidate);
+
+	double reference_time=0.0,candidate_time=0.0;
+	int mismatches=0;
+
+	for(int c=0;c<options->min_samples;c++)
+	{
+		gsl_rng_memcpy(saved,rng);
+		reset_stats(stats);
+
+		double start=get_time();
+		int reference_result=do_run(periodic_ctx,&periodic_config,p,pperp,rng,stats);
+		reference_time+=get_time()-start;
+
+		stats->cpu_time=0.0;
+		stats_compact(&periodic_config,stats,reference);
+
+		gsl_rng_memcpy(rng,saved);
+		reset_stats(stats);
+
+		start=get_time();
+		int candidate_result=do_run(dual_ctx,&dual_config,p,pperp,rng,stats);
+		candidate_time+=get_time()-start;
+
+		/*
+			The periodic half is in the dual statistics when 'pbcz' is false, and
+			then the vertical bonds between the last and the first layer are not
+			counted with the others.
+		*/
+
+		if(dual_config.pbcz==false)
+		{
+			stats_swap_dual(stats);
+			stats->vbonds+=dual_ctx->ncs->nr_wrap_vbonds;
+			candidate_result=(candidate_result&SINGLE_LAYER_PERCOLATION)|((stats->cntbilayer>0)?(TWO_LAYER_PERCOLATION):(0));
+		}
+
+		stats->cntbilayer=0;
+		stats->cpu_time=0.0;
+		stats_compact(&periodic_config,stats,candidate);
+
+		if((reference_result!=candidate_result)||(memcmp(reference,candidate,size)!=0))
+			mismatches++;
+	}
+
+	printf("%d %d %d %f %f dual_bc %d %d nan - %f %s\n",config->xdim,config->nrlayers,config->pbcz,p,pperp,
+		options->min_samples,mismatches,2.0*reference_time/candidate_time,(mismatches==0)?("PASS"):("FAIL"));
+	fflush(stdout);
+
+	simulation_ctx_fini(dual_ctx);
+	simulation_ctx_fini(periodic_ctx);
+	gsl_rng_free(saved);
+	free(stats);
+	free(reference);
+	free(candidate);
+
+	return (mismatches==0);
+}
+
+/*
+	The fused engine draws the bonds in a different order, so it can only be
+	compared statistically: the distribution of the spanning flags with a
+	chi-squared test of homogeneity, and the mean of the other observables
+	with Welch's test. The engine fails if any p-value is below 'alpha',
+	divided by the number of tests.
+*/
+
+#define VALIDATE_NR_FIELDS	(6)
+
+static const char *validate_fields[VALIDATE_NR_FIELDS]={"nr_percolating1","nr_percolating2","matches1","matches2","bonds","vbonds"};
+
+struct validate_sums_t
+{
+	long n;
+	long flags[4];
+	double sum[VALIDATE_NR_FIELDS],sum_sq[VALIDATE_NR_FIELDS];
+	double time;
+};
+
+static void validate_sample(struct simulation_ctx_t *ctx,struct config_t *config,double p,double pperp,
+                            gsl_rng *rng,struct statistics_t *stats,struct validate_sums_t *sums)
+{
+	reset_stats(stats);
+
+	double start=get_time();
+	int result=do_run(ctx,config,p,pperp,rng,stats);
+	sums->time+=get_time()-start;
+
+	double values[VALIDATE_NR_FIELDS]={stats->nr_percolating1,stats->nr_percolating2,stats->matches1,stats->matches2,stats->bonds,stats->vbonds};
+
+	sums->n++;
+	sums->flags[result&3]++;
+
+	for(int c=0;c<VALIDATE_NR_FIELDS;c++)
+	{
+		sums->sum[c]+=values[c];
+		sums->sum_sq[c]+=values[c]*values[c];
+	}
+}
+
+static double chisq_pvalue(struct validate_sums_t *a,struct validate_sums_t *b)
+{
+	double n=a->n+b->n,chisq=0.0;
+	int nr_columns=0;
+
+	for(int c=0;c<4;c++)
+	{
+		double column=a->flags[c]+b->flags[c];
+
+		if(column==0)
+			continue;
+
+		double expected_a=column*a->n/n;
+		double expected_b=column*b->n/n;
+
+		chisq+=(a->flags[c]-expected_a)*(a->flags[c]-expected_a)/expected_a;
+		chisq+=(b->flags[c]-expected_b)*(b->flags[c]-expected_b)/expected_b;
+		nr_columns++;
+	}
+
+	return (nr_columns>1)?(gsl_cdf_chisq_Q(chisq,nr_columns-1)):(1.0);
+}
+
+static double welch_pvalue(struct validate_sums_t *a,struct validate_sums_t *b,int field)
+{
+	double mean_a=a->sum[field]/a->n;
+	double mean_b=b->sum[field]/b->n;
+	double var_a=MAX(a->sum_sq[field]/a->n-mean_a*mean_a,0.0)*a->n/MAX(a->n-1,1);
+	double var_b=MAX(b->sum_sq[field]/b->n-mean_b*mean_b,0.0)*b->n/MAX(b->n-1,1);
+	double error=sqrt(var_a/a->n+var_b/b->n);
+
+	if(error<=0.0)
+		return (mean_a==mean_b)?(1.0):(0.0);
+
+	return 2.0*gsl_cdf_ugaussian_Q(fabs(mean_a-mean_b)/error);
+}
+
+static bool validate_fused(struct config_t *config,double p,double pperp,gsl_rng *rng,struct bench_options_t *options)
+{
+	struct config_t reference_config=*config,fused_config=*config;
+
+	reference_config.measure_jumps=false;
+	fused_config.measure_jumps=false;
+	fused_config.engine=ENGINE_FUSED;
+
+	struct simulation_ctx_t *reference_ctx=simulation_ctx_init(&reference_config);
+	struct simulation_ctx_t *fused_ctx=simulation_ctx_init(&fused_config);
+	struct statistics_t *stats=malloc(sizeof(struct statistics_t));
+	assert(reference_ctx&&fused_ctx&&stats);
+
+	struct validate_sums_t reference,fused;
+
+	memset(&reference,0,sizeof(struct validate_sums_t));
+	memset(&fused,0,sizeof(struct validate_sums_t));
+
+	/*
+		Interleaved, so that both engines see the same conditions.
+	*/
+
+	for(int c=0;c<options->min_samples;c++)
+	{
+		validate_sample(reference_ctx,&reference_config,p,pperp,rng,stats,&reference);
+		validate_sample(fused_ctx,&fused_config,p,pperp,rng,stats,&fused);
+	}
+
+	double min_pvalue=chisq_pvalue(&reference,&fused);
+	const char *worst="flags";
+
+	for(int c=0;c<VALIDATE_NR_FIELDS;c++)
+	{
+		double pvalue=welch_pvalue(&reference,&fused,c);
+
+		if(pvalue<min_pvalue)
+		{
+			min_pvalue=pvalue;
+			worst=validate_fields[c];
+		}
+	}
+
+	bool pass=(min_pvalue>=options->alpha/(VALIDATE_NR_FIELDS+1));
+
+	printf("%d %d %d %f %f fused %d -1 %e %s %f %s\n",config->xdim,config->nrlayers,config->pbcz,p,pperp,
+		options->min_samples,min_pvalue,worst,reference.time/fused.time,(pass==true)?("PASS"):("FAIL"));
+	fflush(stdout);
+
+	simulation_ctx_fini(reference_ctx);
+	simulation_ctx_fini(fused_ctx);
+	free(stats);
+
+	return pass;
+}
+
+/*
+	The workloads for the scaling runs, one for each class of cases: small
+	lattices with jumps, large lattices with percolation only, and stacks
+	of many layers. Each one is a line of 11 points across the threshold.
+*/
+
+struct scaling_case_t
+{
+	const char *name;
+
+	int l,nrlayers;
+	bool pbcz,jumps;
+	int runs;
+};
+
+static struct scaling_case_t scaling_cases[]=
+{
+	{"small_jumps",32,2,false,true,64},
+	{"percolation_512",512,2,false,false,16},
+	{"many_layers",64,8,true,false,64},
+	{NULL,0,0,false,false,0}
+};
+
+static void scaling_point_done(int index,struct point_t *point,struct statistics_t *total,void *data)
+{
+	(void)(index);
+	(void)(point);
+
+	long *runs=data;
+
+	*runs+=total->runs;
+}
+
+/*
+	Runs each workload once for every thread count: the speedup and the parallel
+	efficiency are relative to the first thread count, the load imbalance is the
+	ratio between the largest busy time of a worker and the average one.
+*/
+
+static void scaling_run(struct bench_options_t *options)
+{
+	printf("# case executor threads runs seconds samples_per_s speedup efficiency busy_fraction imbalance memory_per_thread_bytes\n");
+
+	for(int c=0;scaling_cases[c].name!=NULL;c++)
+	{
+		struct scaling_case_t *scase=&scaling_cases[c];
+		double base_rate=0.0;
+
+		if((options->scaling_case>=0)&&(options->scaling_case!=c))
+			continue;
+
+		for(int d=0;d<options->nr_threads;d++)
+		{
+			int nr_threads=options->threads[d];
+			struct config_t config;
+
+			bench_config(&config,options,scase->l,scase->nrlayers,scase->pbcz);
+
+			config.measure_jumps=scase->jumps;
+			config.total_runs=(options->scaling_runs>0)?(options->scaling_runs):(scase->runs);
+			config.minmillip=450;
+			config.maxmillip=550;
+			config.incmillip=10;
+			config.minmillipperp=config.maxmillipperp=500;
+			config.scheduler=!options->openmp;
+			config.nr_workers=nr_threads;
+			config.worker_stats=aligned_alloc(CACHE_LINE_SIZE,sizeof(struct worker_stats_t)*nr_threads);
+			assert(config.worker_stats);
+
+			for(int e=0;e<nr_threads;e++)
+				worker_stats_reset(&config.worker_stats[e]);
+
+			fprintf(stderr,"%s, %d threads\n",scase->name,nr_threads);
+
+			int nr_points;
+			struct point_t *points=grid_points(&config,&nr_points);
+			long runs=0;
+
+			double start=get_time();
+			batch_run_points(&config,points,nr_points,scaling_point_done,&runs);
+			double elapsed=get_time()-start;
+
+			double busy=0.0,max_busy=0.0,memory=0.0;
+			int nr_memory=0;
+
+			for(int e=0;e<nr_threads;e++)
+			{
+				busy+=config.worker_stats[e].busy;
+				max_busy=MAX(max_busy,config.worker_stats[e].busy);
+
+				if(config.worker_stats[e].memory>0)
+				{
+					memory+=config.worker_stats[e].memory;
+					nr_memory++;
+				}
+			}
+
+			double rate=runs/elapsed;
+
+			if(d==0)
+				base_rate=rate;
+
+			double speedup=rate/base_rate;
+
+			printf("%s %s %d %ld %f %f %f %f %f %f %.0f\n",scase->name,(options->openmp==true)?("openmp"):("scheduler"),
+				nr_threads,runs,elapsed,rate,speedup,speedup*options->threads[0]/nr_threads,busy/(nr_threads*elapsed),
+				(busy>0.0)?(max_busy*nr_threads/busy):(0.0),(nr_memory>0)?(memory/nr_memory):(0.0));
+			fflush(stdout);
+
+			free(points);
+			free(config.worker_stats);
+		}
+	}
+}
+
+/*
+	Comma-separated lists of values.
+*/
+
+static int parse_ints(const char *str,int *values)
+{
+	int nr_values=0;
+	char *end;
+
+	while((*str!='\0')&&(nr_values<BENCH_MAX_VALUES))
+	{
+		values[nr_values++]=strtol(str,&end,10);
+
+		if((end==str)||((*end!=',')&&(*end!='\0')))
+			return -1;
+
+		str=(*end==',')?(end+1):(end);
+	}
+
+	return nr_values;
+}
+
+static int parse_doubles(const char *str,double *values)
+{
+	int nr_values=0;
+	char *end;
+
+	while((*str!='\0')&&(nr_values<BENCH_MAX_VALUES))
+	{
+		values[nr_values++]=strtod(str,&end);
+
+		if((end==str)||((*end!=',')&&(*end!='\0')))
+			return -1;
+
+		str=(*end==',')?(end+1):(end);
+	}
+
+	return nr_values;
+}
+
+static void usage(const char *argv0)
+{
+	fprintf(stderr,"Usage: %s [--validate | --scaling] [options]\n",argv0);
+	fprintf(stderr,"\t--validate        check the alternative engines against the reference one\n");
+	fprintf(stderr,"\t--scaling         run fixed workloads with an increasing number of threads\n");
+	fprintf(stderr,"\t--L <list>        lattice sizes (default: 16,32,...,2048, or 16,32 with --validate)\n");
+	fprintf(stderr,"\t--layers <list>   numbers of layers (default: 2,3,...,8)\n");
+	fprintf(stderr,"\t--pbcz <list>     boundary conditions along z, 0 or 1 (default: 0,1)\n");
+	fprintf(stderr,"\t--p <list>        in-plane probabilities (default: 0.48,0.5,0.52, or 0.5 with --validate)\n");
+	fprintf(stderr,"\t--pperp <list>    vertical probabilities (default: 0.5)\n");
+	fprintf(stderr,"\t--samples <n>     minimum number of samples (default: 3, or 400 with --validate)\n");
+	fprintf(stderr,"\t--time <s>        minimum time per configuration (default: 0.25)\n");
+	fprintf(stderr,"\t--alpha <a>       significance level of the statistical tests (default: 0.001)\n");
+	fprintf(stderr,"\t--no-jumps        do not measure the jumps\n");
+	fprintf(stderr,"\t--generic         do not use the specialized kernels\n");
+	fprintf(stderr,"\t--no-hugepages    do not use huge pages\n");
+	fprintf(stderr,"\t--perf            also read the hardware performance counters\n");
+	fprintf(stderr,"With --scaling:\n");
+	fprintf(stderr,"\t--threads <list>  thread counts (default: 1,2,4,... up to the number of CPUs)\n");
+	fprintf(stderr,"\t--case <name>     only one workload: small_jumps, percolation_512 or many_layers\n");
+	fprintf(stderr,"\t--runs <n>        runs per point, instead of the default of the workload\n");
+	fprintf(stderr,"\t--openmp          use the OpenMP executor instead of the scheduler\n");
+}
+
+static bool parse_options(int argc,char *argv[],struct bench_options_t *options)
+{
+	options->mode=BENCH_MODE_TIMING;
+	options->nr_ls=options->nr_layers=options->nr_pbczs=options->nr_ps=options->nr_pperps=0;
+	options->jumps=true;
+	options->generic=false;
+	options->hugepages=true;
+	options->perf=false;
+	options->min_samples=0;
+	options->min_time=0.25;
+	options->alpha=0.001;
+	options->nr_threads=0;
+	options->scaling_case=-1;
+	options->scaling_runs=0;
+	options->openmp=false;
+
+	for(int c=1;c<argc;c++)
+	{
+		bool has_value=(c+1<argc);
+
+		if((strcmp(argv[c],"--L")==0)&&(has_value==true))
+			options->nr_ls=parse_ints(argv[++c],options->ls);
+		else if((strcmp(argv[c],"--layers")==0)&&(has_value==true))
+			options->nr_layers=parse_ints(argv[++c],options->layers);
+		else if((strcmp(argv[c],"--pbcz")==0)&&(has_value==true))
+			options->nr_pbczs=parse_ints(argv[++c],options->pbczs);
+		else if((strcmp(argv[c],"--p")==0)&&(has_value==true))
+			options->nr_ps=parse_doubles(argv[++c],options->ps);
+		else if((strcmp(argv[c],"--pperp")==0)&&(has_value==true))
+			options->nr_pperps=parse_doubles(argv[++c],options->pperps);
+		else if((strcmp(argv[c],"--samples")==0)&&(has_value==true))
+			options->min_samples=atoi(argv[++c]);
+		else if((strcmp(argv[c],"--time")==0)&&(has_value==true))
+			options->min_time=atof(argv[++c]);
+		else if((strcmp(argv[c],"--alpha")==0)&&(has_value==true))
+			options->alpha=atof(argv[++c]);
+		else if((strcmp(argv[c],"--threads")==0)&&(has_value==true))
+			options->nr_threads=parse_ints(argv[++c],options->threads);
+		else if((strcmp(argv[c],"--runs")==0)&&(has_value==true))
+			options->scaling_runs=atoi(argv[++c]);
+		else if((strcmp(argv[c],"--case")==0)&&(has_value==true))
+		{
+			c++;
+
+			for(int d=0;scaling_cases[d].name!=NULL;d++)
+				if(strcmp(argv[c],scaling_cases[d].name)==0)
+					options->scaling_case=d;
+
+			if(options->scaling_case<0)
+				return false;
+		}
+		else if(strcmp(argv[c],"--validate")==0)
+			options->mode=BENCH_MODE_VALIDATE;
+		else if(strcmp(argv[c],"--scaling")==0)
+			options->mode=BENCH_MODE_SCALING;
+		else if(strcmp(argv[c],"--openmp")==0)
+			options->openmp=true;
+		else if(strcmp(argv[c],"--no-jumps")==0)
+			options->jumps=false;
+		else if(strcmp(argv[c],"--generic")==0)
+			options->generic=true;
+		else if(strcmp(argv[c],"--no-hugepages")==0)
+			options->hugepages=false;
+		else if(strcmp(argv[c],"--perf")==0)
+			options->perf=true;
+		else
+			return false;
+	}
+
+	/*
+		The default matrix: validating takes many samples, so it is smaller.
+	*/
+
+	bool validate=(options->mode==BENCH_MODE_VALIDATE);
+
+	if(options->nr_ls==0)
+		for(int l=16;l<=((validate==true)?(32):(2048));l*=2)
+			options->ls[options->nr_ls++]=l;
+
+	if(options->nr_layers==0)
+		for(int nrlayers=2;nrlayers<=8;nrlayers++)
+			options->layers[options->nr_layers++]=nrlayers;
+
+	if(options->nr_pbczs==0)
+	{
+		options->pbczs[0]=0;
+		options->pbczs[1]=1;
+		options->nr_pbczs=2;
+	}
+
+	if((options->nr_ps==0)&&(validate==true))
+	{
+		options->ps[0]=0.5;
+		options->nr_ps=1;
+	}
+	else if(options->nr_ps==0)
+	{
+		options->ps[0]=0.48;
+		options->ps[1]=0.5;
+		options->ps[2]=0.52;
+		options->nr_ps=3;
+	}
+
+	if(options->nr_pperps==0)
+	{
+		options->pperps[0]=0.5;
+		options->nr_pperps=1;
+	}
+
+	if(options->min_samples==0)
+		options->min_samples=(validate==true)?(400):(3);
+
+	if(options->nr_threads==0)
+	{
+		int nr_cpus=affinity_nr_cpus();
+
+		for(int c=1;(c<nr_cpus)&&(options->nr_threads<BENCH_MAX_VALUES-1);c*=2)
+			options->threads[options->nr_threads++]=c;
+
+		options->threads[options->nr_threads++]=MAX(nr_cpus,1);
+	}
+
+	for(int c=0;c<options->nr_threads;c++)
+		if(options->threads[c]<1)
+			return false;
+
+	if((options->nr_ls<0)||(options->nr_layers<0)||(options->nr_pbczs<0)||(options->nr_ps<0)||(options->nr_pperps<0)||(options->nr_threads<0))
+		return false;
+
+	for(int c=0;c<options->nr_ls;c++)
+		if(options->ls[c]<2)
+			return false;
+
+	for(int c=0;c<options->nr_layers;c++)
+		if((options->layers[c]<1)||(options->layers[c]>MAX_NR_OF_LAYERS))
+			return false;
+
+	options->min_samples=MAX(options->min_samples,1);
+
+	return true;
+}
+
+static bool bench_run(struct bench_options_t *options,struct config_t *config,gsl_rng *rng)
+{
+	if(options->mode==BENCH_MODE_VALIDATE)
+	{
+		bool pass=true;
+
+		for(int d=0;d<options->nr_pperps;d++)
+		{
+			for(int e=0;e<options->nr_ps;e++)
+			{
+				pass&=validate_kernels(config,options->ps[e],options->pperps[d],rng,options);
+				pass&=validate_observables(config,options->ps[e],options->pperps[d],rng,options);
+				pass&=validate_dual(config,options->ps[e],options->pperps[d],rng,options);
+				pass&=validate_fused(config,options->ps[e],options->pperps[d],rng,options);
+			}
+		}
+
+		return pass;
+	}
+
+	/*
+		The context is touched when created, so all of its memory is resident.
+	*/
+
+	long before=resident_bytes();
+	struct simulation_ctx_t *ctx=simulation_ctx_init(config);
+	long after=resident_bytes();
+	assert(ctx!=NULL);
+
+	for(int d=0;d<options->nr_pperps;d++)
+	{
+		for(int e=0;e<options->nr_ps;e++)
+		{
+			struct bench_result_t result;
+
+			bench_point(config,ctx,options->ps[e],options->pperps[d],rng,options,&result);
+
+			result.memory=((before>=0)&&(after>=0))?(after-before):(-1);
+			result.specialized=(ctx->ncs->kernel!=NULL);
+
+			print_result(config,options->ps[e],options->pperps[d],&result,options->jumps);
+		}
+	}
+
+	simulation_ctx_fini(ctx);
+
+	return true;
+}
+
+int main(int argc,char *argv[])
+{
+	struct bench_options_t options;
+
+	if(parse_options(argc,argv,&options)==false)
+	{
+		usage(argv[0]);
+		return 1;
+	}
+
+	gsl_rng *rng=gsl_rng_alloc(gsl_rng_mt19937);
+	assert(rng!=NULL);
+	seed_rng(rng);
+
+	if(options.mode==BENCH_MODE_SCALING)
+	{
+		scaling_run(&options);
+		gsl_rng_free(rng);
+		return 0;
+	}
+
+	if(options.mode==BENCH_MODE_VALIDATE)
+		printf("# L layers pbcz p pperp candidate samples mismatches min_pvalue worst_test speedup result\n");
+	else
+		print_header((options.perf==true)&&(perf_enable()==true));
+
+	bool pass=true;
+
+	for(int a=0;a<options.nr_ls;a++)
+	{
+		for(int b=0;b<options.nr_layers;b++)
+		{
+			for(int c=0;c<options.nr_pbczs;c++)
+			{
+				struct config_t config;
+
+				bench_config(&config,&options,options.ls[a],options.layers[b],options.pbczs[c]!=0);
+
+				fprintf(stderr,"L=%d, %d layers, pbcz=%d\n",config.xdim,config.nrlayers,config.pbcz);
+
+				pass&=bench_run(&options,&config,rng);
+			}
+		}
+	}
+
+	gsl_rng_free(rng);
+
+	return (pass==true)?(0):(1);
+}
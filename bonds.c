@@ -3,6 +3,7 @@
 
 #include "common.h"
 #include "bonds.h"
+#include "arena.h"
 
 /*
 	A floating point quantity defined on each bond in a two-dimensional lattice
@@ -74,10 +75,18 @@ void bond2d_set_value(struct bond2d_t *b,int x,int y,short direction,double valu
 }
 
 /*
-	An integer quantity defined on each bond in a two-dimensional lattice
+	An integer quantity defined on each bond in a two-dimensional lattice.
+
+	The values can be optionally allocated from an arena, in which case
+	they will be released along with the arena.
 */
 
 struct ibond2d_t *ibond2d_init(int x,int y)
+{
+	return ibond2d_init_in(NULL,x,y);
+}
+
+struct ibond2d_t *ibond2d_init_in(struct arena_t *arena,int x,int y)
 {
 	struct ibond2d_t *ret;
 
@@ -87,16 +96,13 @@ struct ibond2d_t *ibond2d_init(int x,int y)
 	if(!(ret=malloc(sizeof(struct ibond2d_t))))
 		return NULL;
 	
-	ret->vals[0]=malloc(sizeof(int)*x*y);
-	ret->vals[1]=malloc(sizeof(int)*x*y);
+	ret->vals[0]=arena_or_malloc(arena,sizeof(int)*x*y);
+	ret->vals[1]=arena_or_malloc(arena,sizeof(int)*x*y);
 
 	if((!ret->vals[0])||(!ret->vals[1]))
 	{
-		if(ret->vals[0])
-			free(ret->vals[0]);
-
-		if(ret->vals[1])
-			free(ret->vals[1]);
+		arena_or_free(arena,ret->vals[0]);
+		arena_or_free(arena,ret->vals[1]);
 
 		if(ret)
 			free(ret);
@@ -106,6 +112,7 @@ struct ibond2d_t *ibond2d_init(int x,int y)
 	
 	ret->lx=x;
 	ret->ly=y;
+	ret->arena=arena;
 	
 	return ret;
 }
@@ -114,11 +121,8 @@ void ibond2d_fini(struct ibond2d_t *b)
 {
 	if(b)
 	{
-		if(b->vals[0])
-			free(b->vals[0]);
-
-		if(b->vals[1])
-			free(b->vals[1]);
+		arena_or_free(b->arena,b->vals[0]);
+		arena_or_free(b->arena,b->vals[1]);
 		
 		free(b);
 	}
@@ -202,6 +206,11 @@ void vbond2d_set_value(struct vbond2d_t *vb,int x,int y,double val)
 }
 
 struct ivbond2d_t *ivbond2d_init(int x,int y)
+{
+	return ivbond2d_init_in(NULL,x,y);
+}
+
+struct ivbond2d_t *ivbond2d_init_in(struct arena_t *arena,int x,int y)
 {
 	struct ivbond2d_t *ret;
 
@@ -211,7 +220,7 @@ struct ivbond2d_t *ivbond2d_init(int x,int y)
 	if(!(ret=malloc(sizeof(struct ivbond2d_t))))
 		return NULL;
 	
-	ret->vals=malloc(sizeof(int)*x*y);
+	ret->vals=arena_or_malloc(arena,sizeof(int)*x*y);
 
 	if(!ret->vals)
 	{
@@ -223,6 +232,7 @@ struct ivbond2d_t *ivbond2d_init(int x,int y)
 	
 	ret->lx=x;
 	ret->ly=y;
+	ret->arena=arena;
 	
 	return ret;
 }
@@ -231,8 +241,7 @@ void ivbond2d_fini(struct ivbond2d_t *vb)
 {
 	if(vb)
 	{
-		if(vb->vals)
-			free(vb->vals);
+		arena_or_free(vb->arena,vb->vals);
 		
 		free(vb);
 	}
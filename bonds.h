@@ -4,6 +4,8 @@
 #define DIR_X	(0)
 #define DIR_Y	(1)
 
+struct arena_t;
+
 struct bond2d_t
 {
 	double *vals[2];
@@ -19,9 +21,12 @@ struct ibond2d_t
 {
 	int *vals[2];
 	int lx,ly;
+
+	struct arena_t *arena;
 };
 
 struct ibond2d_t *ibond2d_init(int x,int y);
+struct ibond2d_t *ibond2d_init_in(struct arena_t *arena,int x,int y);
 void ibond2d_fini(struct ibond2d_t *b);
 int ibond2d_get_value(struct ibond2d_t *b,int x,int y,short direction);
 void ibond2d_set_value(struct ibond2d_t *b,int x,int y,short direction,int value);
@@ -41,9 +46,12 @@ struct ivbond2d_t
 {
 	int *vals;
 	int lx,ly;
+
+	struct arena_t *arena;
 };
 
 struct ivbond2d_t *ivbond2d_init(int x,int y);
+struct ivbond2d_t *ivbond2d_init_in(struct arena_t *arena,int x,int y);
 void ivbond2d_fini(struct ivbond2d_t *vb);
 int ivbond2d_get_value(struct ivbond2d_t *vb,int x,int y);
 void ivbond2d_set_value(struct ivbond2d_t *vb,int x,int y,int val);
@@ -0,0 +1,272 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <math.h>
+#include <assert.h>
+
+#include "common.h"
+#include "clusters.h"
+#include "simulation.h"
+#include "pipeline.h"
+#include "batch.h"
+#include "writer.h"
+#include "budget.h"
+
+/*
+	Allocation of a compute budget across the points of the grid.
+
+	All the points get a pilot of 'min_runs' runs first. Then, in a few rounds, the
+	runs are distributed according to Neyman allocation: minimizing the overall error,
+	i.e. the sum of sigma_i^2/n_i over the points, given a total cost sum c_i n_i,
+	where sigma_i is the standard deviation of a single sample at point i and c_i
+	is the measured cost of a run there, gives n_i proportional to sigma_i/sqrt(c_i).
+
+	Each round spends about half of the time left, so that sigma_i and c_i, which
+	are estimated from the runs done so far, get more precise along the way.
+*/
+
+#define BUDGET_MAX_ROUNDS	(20)
+#define BUDGET_ROUND_FRACTION	(0.5)
+#define BUDGET_MIN_FRACTION	(0.02)
+
+/*
+	What is needed to allocate the runs, for every point; the full statistics
+	are kept in compact form, see stats_compact().
+*/
+
+struct budget_point_t
+{
+	int runs,cntbilayer,cntsingle;
+	double jumps,jumps_sq,cpu_time;
+};
+
+struct budget_data_t
+{
+	struct config_t *config;
+
+	struct budget_point_t *summaries;
+	char *totals;
+	size_t stride;
+
+	/*
+		For every point in the current round, its index in the grid.
+	*/
+
+	int *which;
+
+	struct statistics_t *scratch;
+};
+
+static void budget_point_done(int index,struct point_t *point,struct statistics_t *total,void *data)
+{
+	struct budget_data_t *budget_data=data;
+	struct config_t *config=budget_data->config;
+	int c=budget_data->which[index];
+
+	(void)(point);
+
+	stats_expand(config,budget_data->totals+c*budget_data->stride,budget_data->scratch);
+	add_stats(budget_data->scratch,total);
+	stats_compact(config,budget_data->scratch,budget_data->totals+c*budget_data->stride);
+
+	struct budget_point_t *summary=&budget_data->summaries[c];
+
+	summary->runs=budget_data->scratch->runs;
+	summary->cntbilayer=budget_data->scratch->cntbilayer;
+	summary->cntsingle=budget_data->scratch->cntsingle;
+	summary->jumps=budget_data->scratch->jumps;
+	summary->jumps_sq=budget_data->scratch->jumps_sq;
+	summary->cpu_time=budget_data->scratch->cpu_time;
+}
+
+/*
+	The standard deviation of a single sample: the spanning probabilities are estimated
+	as (k+1)/(n+2), as in point_converged(), while the jumps, if measured, are rescaled
+	by the largest mean found on the grid, so that all the terms are of order one.
+*/
+
+static double budget_sigma(struct config_t *config,struct budget_point_t *summary,double jumps_scale)
+{
+	int n=summary->runs;
+
+	double pb=(summary->cntbilayer+1.0)/(n+2.0);
+	double ps=(summary->cntsingle+1.0)/(n+2.0);
+	double variance=pb*(1.0-pb)+ps*(1.0-ps);
+
+	if((config->measure_jumps==true)&&(jumps_scale>0.0)&&(n>1))
+	{
+		double mean=summary->jumps/n;
+		double jvariance=(summary->jumps_sq-n*mean*mean)/(n-1);
+
+		variance+=MAX(jvariance,0.0)/(jumps_scale*jumps_scale);
+	}
+
+	return sqrt(variance);
+}
+
+static double budget_cost(struct budget_point_t *summary)
+{
+	return MAX(summary->cpu_time/summary->runs,1e-9);
+}
+
+void do_batch_budgeted(struct config_t *config,struct outputs_t *outputs)
+{
+	/*
+		The number of runs is decided here, rather than by adaptive sampling.
+	*/
+
+	struct config_t local_config=*config;
+	local_config.adaptive=false;
+
+	int nr_points;
+	struct point_t *grid=grid_points(&local_config,&nr_points);
+
+	struct budget_data_t budget_data;
+
+	budget_data.config=&local_config;
+	budget_data.stride=stats_compact_size(&local_config);
+	budget_data.summaries=malloc(sizeof(struct budget_point_t)*MAX(nr_points,1));
+	budget_data.totals=malloc(budget_data.stride*MAX(nr_points,1));
+	budget_data.which=malloc(sizeof(int)*MAX(nr_points,1));
+	budget_data.scratch=malloc(sizeof(struct statistics_t));
+
+	struct point_t *round=malloc(sizeof(struct point_t)*MAX(nr_points,1));
+	double *deficits=malloc(sizeof(double)*MAX(nr_points,1));
+
+	assert(budget_data.summaries&&budget_data.totals&&budget_data.which&&budget_data.scratch&&round&&deficits);
+
+	reset_stats(budget_data.scratch);
+
+	for(int c=0;c<nr_points;c++)
+		stats_compact(&local_config,budget_data.scratch,budget_data.totals+c*budget_data.stride);
+
+	double start=get_time();
+
+	/*
+		The pilot runs.
+	*/
+
+	for(int c=0;c<nr_points;c++)
+	{
+		round[c]=grid[c];
+		round[c].runs=MAX(local_config.min_runs,2);
+		budget_data.which[c]=c;
+	}
+
+	batch_run_points(&local_config,round,nr_points,budget_point_done,&budget_data);
+
+	int nr_rounds=1;
+
+	for(;nr_rounds<=BUDGET_MAX_ROUNDS;nr_rounds++)
+	{
+		double elapsed=get_time()-start;
+		double remaining=local_config.budget-elapsed;
+
+		if(remaining<BUDGET_MIN_FRACTION*local_config.budget)
+			break;
+
+		/*
+			The CPU time spent per second of wall-clock time, as measured so far,
+			is used to convert the time left into the total cost of the runs.
+		*/
+
+		double cpu_time=0.0,jumps_scale=0.0;
+
+		for(int c=0;c<nr_points;c++)
+		{
+			cpu_time+=budget_data.summaries[c].cpu_time;
+			jumps_scale=MAX(jumps_scale,budget_data.summaries[c].jumps/budget_data.summaries[c].runs);
+		}
+
+		double speed=cpu_time/MAX(elapsed,1e-9);
+		double total_cost=cpu_time+remaining*speed;
+		double round_cost=BUDGET_ROUND_FRACTION*remaining*speed;
+
+		double norm=0.0;
+
+		for(int c=0;c<nr_points;c++)
+			norm+=budget_sigma(&local_config,&budget_data.summaries[c],jumps_scale)*sqrt(budget_cost(&budget_data.summaries[c]));
+
+		if(norm<=0.0)
+			break;
+
+		double needed=0.0;
+
+		for(int c=0;c<nr_points;c++)
+		{
+			struct budget_point_t *summary=&budget_data.summaries[c];
+
+			double sigma=budget_sigma(&local_config,summary,jumps_scale);
+			double cost=budget_cost(summary);
+			double target=total_cost*sigma/(sqrt(cost)*norm);
+
+			deficits[c]=MAX(target-summary->runs,0.0);
+			needed+=deficits[c]*cost;
+		}
+
+		double scale=(needed>round_cost)?(round_cost/needed):(1.0);
+
+		int nr_round=0;
+
+		for(int c=0;c<nr_points;c++)
+		{
+			int runs=(int)(floor(deficits[c]*scale));
+
+			if(runs>0)
+			{
+				round[nr_round]=grid[c];
+				round[nr_round].runs=runs;
+				budget_data.which[nr_round]=c;
+				nr_round++;
+			}
+		}
+
+		if(nr_round==0)
+			break;
+
+		batch_run_points(&local_config,round,nr_round,budget_point_done,&budget_data);
+	}
+
+	/*
+		Finally, the results are written out.
+	*/
+
+	long total_runs=0;
+	int min_runs=0,max_runs=0;
+
+	for(int c=0;c<nr_points;c++)
+	{
+		stats_expand(&local_config,budget_data.totals+c*budget_data.stride,budget_data.scratch);
+		writer_submit(outputs->stream,c,&grid[c],budget_data.scratch,NULL);
+
+		int runs=budget_data.summaries[c].runs;
+
+		total_runs+=runs;
+		min_runs=(c==0)?(runs):(MIN(min_runs,runs));
+		max_runs=(c==0)?(runs):(MAX(max_runs,runs));
+	}
+
+	fprintf(stderr,"Budget: %.1f s out of %.1f s, %d rounds, %ld runs, between %d and %d runs per point\n",
+		get_time()-start,local_config.budget,nr_rounds,total_runs,min_runs,max_runs);
+
+	if(grid)
+		free(grid);
+
+	if(round)
+		free(round);
+
+	if(deficits)
+		free(deficits);
+
+	if(budget_data.summaries)
+		free(budget_data.summaries);
+
+	if(budget_data.totals)
+		free(budget_data.totals);
+
+	if(budget_data.which)
+		free(budget_data.which);
+
+	if(budget_data.scratch)
+		free(budget_data.scratch);
+}
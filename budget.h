@@ -0,0 +1,9 @@
+#ifndef __BUDGET_H__
+#define __BUDGET_H__
+
+#include "simulation.h"
+#include "batch.h"
+
+void do_batch_budgeted(struct config_t *config,struct outputs_t *outputs);
+
+#endif //__BUDGET_H__
@@ -0,0 +1,584 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <assert.h>
+
+#include "common.h"
+#include "simulation.h"
+#include "presets.h"
+#include "campaign.h"
+
+/*
+	Campaign files: a campaign is described by a plain text file like
+
+		# Defaults, for all the batches below
+		runs = 1000
+		p = 0.2:0.8:0.01
+
+		[bilayer64]
+		L = 64
+		layers = 2
+
+		[trilayer64_pbcz]
+		L = 64
+		layers = 3
+		pbcz = true
+		pperp = 0.1, 0.25, 0.5
+
+	i.e. 'key = value' lines, grouped in sections, each section being a batch, whose
+	name is also the prefix of the output files. The keys before the first section
+	are defaults for all the batches. Comments start with '#' or ';'.
+*/
+
+#define CAMPAIGN_MAX_LINE	(1024)
+
+#define KEY_INT		(0)
+#define KEY_DOUBLE	(1)
+#define KEY_BOOL	(2)
+
+struct campaign_key_t
+{
+	const char *name;
+	int type;
+	size_t offset;
+};
+
+static struct campaign_key_t campaign_keys[]=
+{
+	{"lx",KEY_INT,offsetof(struct config_t,xdim)},
+	{"ly",KEY_INT,offsetof(struct config_t,ydim)},
+	{"layers",KEY_INT,offsetof(struct config_t,nrlayers)},
+	{"pbcz",KEY_BOOL,offsetof(struct config_t,pbcz)},
+	{"dual_bc",KEY_BOOL,offsetof(struct config_t,dual_bc)},
+	{"jumps",KEY_BOOL,offsetof(struct config_t,measure_jumps)},
+	{"cluster_observables",KEY_BOOL,offsetof(struct config_t,cluster_observables)},
+	{"runs",KEY_INT,offsetof(struct config_t,total_runs)},
+	{"hugepages",KEY_BOOL,offsetof(struct config_t,hugepages)},
+	{"pin_threads",KEY_BOOL,offsetof(struct config_t,pin_threads)},
+	{"specialized_kernels",KEY_BOOL,offsetof(struct config_t,specialized_kernels)},
+	{"pipelined",KEY_BOOL,offsetof(struct config_t,pipelined)},
+	{"generators",KEY_INT,offsetof(struct config_t,nr_generators)},
+	{"analyzers",KEY_INT,offsetof(struct config_t,nr_analyzers)},
+	{"buffers",KEY_INT,offsetof(struct config_t,nr_buffers)},
+	{"scheduler",KEY_BOOL,offsetof(struct config_t,scheduler)},
+	{"workers",KEY_INT,offsetof(struct config_t,nr_workers)},
+	{"adaptive",KEY_BOOL,offsetof(struct config_t,adaptive)},
+	{"min_runs",KEY_INT,offsetof(struct config_t,min_runs)},
+	{"max_runs",KEY_INT,offsetof(struct config_t,max_runs)},
+	{"target_error",KEY_DOUBLE,offsetof(struct config_t,target_error)},
+	{"confidence_z",KEY_DOUBLE,offsetof(struct config_t,confidence_z)},
+	{"refine",KEY_BOOL,offsetof(struct config_t,refine)},
+	{"refine_levels",KEY_INT,offsetof(struct config_t,refine_levels)},
+	{"refine_low",KEY_DOUBLE,offsetof(struct config_t,refine_low)},
+	{"refine_high",KEY_DOUBLE,offsetof(struct config_t,refine_high)},
+	{"budget",KEY_DOUBLE,offsetof(struct config_t,budget)},
+	{"memory_budget",KEY_DOUBLE,offsetof(struct config_t,memory_budget)},
+	{"event_log",KEY_BOOL,offsetof(struct config_t,event_log)},
+	{"verbose",KEY_BOOL,offsetof(struct config_t,verbose)},
+	{NULL,0,0}
+};
+
+void campaign_init(struct campaign_t *campaign)
+{
+	campaign->configs=NULL;
+	campaign->prefixes=NULL;
+	campaign->nr_batches=campaign->capacity=0;
+}
+
+static void config_free_lists(struct config_t *config)
+{
+	if(config->ps)
+		free(config->ps);
+
+	if(config->pperps)
+		free(config->pperps);
+
+	config->ps=config->pperps=NULL;
+	config->nr_ps=config->nr_pperps=0;
+}
+
+void campaign_fini(struct campaign_t *campaign)
+{
+	for(int c=0;c<campaign->nr_batches;c++)
+	{
+		config_free_lists(&campaign->configs[c]);
+
+		if(campaign->prefixes[c])
+			free(campaign->prefixes[c]);
+	}
+
+	if(campaign->configs)
+		free(campaign->configs);
+
+	if(campaign->prefixes)
+		free(campaign->prefixes);
+
+	campaign_init(campaign);
+}
+
+static double *copy_list(double *list,int nr_list)
+{
+	if(nr_list==0)
+		return NULL;
+
+	double *ret=malloc(sizeof(double)*nr_list);
+	assert(ret);
+
+	memcpy(ret,list,sizeof(double)*nr_list);
+
+	return ret;
+}
+
+/*
+	Adds a batch to the campaign, which takes ownership of the lists of values
+	in the configuration; the prefix is copied.
+*/
+
+static bool campaign_push(struct campaign_t *campaign,struct config_t *config,const char *prefix)
+{
+	for(int c=0;c<campaign->nr_batches;c++)
+	{
+		if(strcmp(campaign->prefixes[c],prefix)==0)
+		{
+			fprintf(stderr,"Duplicate batch: '%s'\n",prefix);
+			return false;
+		}
+	}
+
+	if(campaign->nr_batches==campaign->capacity)
+	{
+		campaign->capacity=MAX(2*campaign->capacity,8);
+		campaign->configs=realloc(campaign->configs,sizeof(struct config_t)*campaign->capacity);
+		campaign->prefixes=realloc(campaign->prefixes,sizeof(char *)*campaign->capacity);
+		assert(campaign->configs&&campaign->prefixes);
+	}
+
+	campaign->configs[campaign->nr_batches]=*config;
+	campaign->prefixes[campaign->nr_batches]=strdup(prefix);
+	assert(campaign->prefixes[campaign->nr_batches]);
+	campaign->nr_batches++;
+
+	return true;
+}
+
+bool campaign_add_preset(struct campaign_t *campaign,int id)
+{
+	struct config_t config;
+	const char *prefix;
+
+	if(preset(id,&config,&prefix)==false)
+	{
+		fprintf(stderr,"Unknown batch: %d\n",id);
+		return false;
+	}
+
+	return campaign_push(campaign,&config,prefix);
+}
+
+static char *trim(char *str)
+{
+	while(isspace((unsigned char)(*str)))
+		str++;
+
+	char *end=str+strlen(str);
+
+	while((end>str)&&(isspace((unsigned char)(end[-1]))))
+		end--;
+
+	*end='\0';
+
+	return str;
+}
+
+static bool parse_int(const char *value,int *result)
+{
+	char *end;
+	long x=strtol(value,&end,10);
+
+	if((end==value)||(*trim(end)!='\0')||(x<-1000000000L)||(x>1000000000L))
+		return false;
+
+	*result=(int)(x);
+	return true;
+}
+
+static bool parse_double(const char *value,double *result)
+{
+	char *end;
+	double x=strtod(value,&end);
+
+	if((end==value)||(*trim(end)!='\0')||(isfinite(x)==0))
+		return false;
+
+	*result=x;
+	return true;
+}
+
+static bool parse_bool(const char *value,bool *result)
+{
+	if((strcmp(value,"true")==0)||(strcmp(value,"yes")==0)||(strcmp(value,"on")==0)||(strcmp(value,"1")==0))
+	{
+		*result=true;
+		return true;
+	}
+
+	if((strcmp(value,"false")==0)||(strcmp(value,"no")==0)||(strcmp(value,"off")==0)||(strcmp(value,"0")==0))
+	{
+		*result=false;
+		return true;
+	}
+
+	return false;
+}
+
+/*
+	The values of p or pperp: either a range 'min:max:inc' on the grid of steps
+	of 0.001, or a comma-separated list of arbitrary values.
+*/
+
+static bool parse_values(char *value,int *min,int *max,int *inc,double **list,int *nr_list)
+{
+	if(strchr(value,':')!=NULL)
+	{
+		double x[3];
+		int nr_fields=0;
+
+		for(char *field=strtok(value,":");field!=NULL;field=strtok(NULL,":"))
+		{
+			if((nr_fields==3)||(parse_double(trim(field),&x[nr_fields])==false))
+				return false;
+
+			nr_fields++;
+		}
+
+		if(nr_fields!=3)
+			return false;
+
+		int milli[3];
+
+		for(int c=0;c<3;c++)
+			milli[c]=(int)(lround(1000.0*x[c]));
+
+		if((milli[0]<0)||(milli[1]>1000)||(milli[0]>milli[1])||(milli[2]<=0))
+			return false;
+
+		*min=milli[0];
+		*max=milli[1];
+		*inc=milli[2];
+
+		if(*list)
+			free(*list);
+
+		*list=NULL;
+		*nr_list=0;
+
+		return true;
+	}
+
+	int nr_values=1;
+
+	for(char *s=value;*s!='\0';s++)
+		if(*s==',')
+			nr_values++;
+
+	double *values=malloc(sizeof(double)*nr_values);
+	assert(values);
+
+	nr_values=0;
+
+	for(char *field=strtok(value,",");field!=NULL;field=strtok(NULL,","))
+	{
+		if((parse_double(trim(field),&values[nr_values])==false)||(values[nr_values]<0.0)||(values[nr_values]>1.0))
+		{
+			free(values);
+			return false;
+		}
+
+		nr_values++;
+	}
+
+	if(nr_values==0)
+	{
+		free(values);
+		return false;
+	}
+
+	if(*list)
+		free(*list);
+
+	*list=values;
+	*nr_list=nr_values;
+
+	return true;
+}
+
+/*
+	Sets a key in the configuration, returning false if either the key or the value
+	are not valid; 'prefix' is NULL outside of the sections.
+*/
+
+static bool campaign_set(struct config_t *config,char *prefix,const char *key,char *value,const char **error)
+{
+	*error="invalid value for";
+
+	for(int c=0;campaign_keys[c].name!=NULL;c++)
+	{
+		if(strcmp(key,campaign_keys[c].name)!=0)
+			continue;
+
+		void *field=((char *)(config))+campaign_keys[c].offset;
+
+		switch(campaign_keys[c].type)
+		{
+			case KEY_INT:
+			return parse_int(value,field);
+
+			case KEY_DOUBLE:
+			return parse_double(value,field);
+
+			case KEY_BOOL:
+			return parse_bool(value,field);
+		}
+	}
+
+	if(strcmp(key,"L")==0)
+	{
+		if(parse_int(value,&config->xdim)==false)
+			return false;
+
+		config->ydim=config->xdim;
+		return true;
+	}
+
+	if(strcmp(key,"engine")==0)
+	{
+		if(strcmp(value,"reference")==0)
+			config->engine=ENGINE_REFERENCE;
+		else if(strcmp(value,"fused")==0)
+			config->engine=ENGINE_FUSED;
+		else
+			return false;
+
+		return true;
+	}
+
+	if(strcmp(key,"p")==0)
+		return parse_values(value,&config->minmillip,&config->maxmillip,&config->incmillip,&config->ps,&config->nr_ps);
+
+	if(strcmp(key,"pperp")==0)
+		return parse_values(value,&config->minmillipperp,&config->maxmillipperp,&config->incmillipperp,&config->pperps,&config->nr_pperps);
+
+	/*
+		A preset replaces the whole configuration, so it should come first.
+	*/
+
+	if(strcmp(key,"preset")==0)
+	{
+		int id;
+		const char *preset_prefix;
+		struct config_t preset_config;
+
+		if((parse_int(value,&id)==false)||(preset(id,&preset_config,&preset_prefix)==false))
+			return false;
+
+		config_free_lists(config);
+		*config=preset_config;
+		return true;
+	}
+
+	if(strcmp(key,"output")==0)
+	{
+		if(prefix==NULL)
+		{
+			*error="only a batch can set";
+			return false;
+		}
+
+		if((*value=='\0')||(strlen(value)>=CAMPAIGN_MAX_LINE))
+			return false;
+
+		strcpy(prefix,value);
+		return true;
+	}
+
+	*error="unknown key";
+	return false;
+}
+
+static const char *campaign_check(struct config_t *config)
+{
+	if((config->xdim<2)||(config->ydim<2))
+		return "the lattice must be at least 2x2";
+
+	if((config->nrlayers<1)||(config->nrlayers>MAX_NR_OF_LAYERS))
+		return "invalid number of layers";
+
+	if(config->total_runs<1)
+		return "the number of runs must be positive";
+
+	if((config->adaptive==true)&&((config->min_runs<2)||(config->min_runs>config->max_runs)))
+		return "invalid min_runs and max_runs";
+
+	if((config->engine==ENGINE_FUSED)&&(config->measure_jumps==true))
+		return "the fused engine cannot measure jumps";
+
+	if((config->dual_bc==true)&&(config->engine==ENGINE_FUSED))
+		return "the fused engine cannot evaluate both boundary conditions";
+
+	if((config->dual_bc==true)&&(config->measure_jumps==true))
+		return "jumps cannot be measured with both boundary conditions";
+
+	if((config->refine==true)&&((config->nr_ps>0)||(config->nr_pperps>0)))
+		return "refinement needs a range of values, not a list";
+
+	if((config->refine==true)&&(config->budget>0.0))
+		return "refinement and budget cannot be combined";
+
+	if(config->memory_budget<0.0)
+		return "the memory budget cannot be negative";
+
+	return NULL;
+}
+
+bool campaign_load(struct campaign_t *campaign,const char *filename)
+{
+	FILE *in=fopen(filename,"r");
+
+	if(!in)
+	{
+		fprintf(stderr,"Couldn't open campaign file '%s'\n",filename);
+		return false;
+	}
+
+	struct config_t defaults,current;
+	char line[CAMPAIGN_MAX_LINE],prefix[CAMPAIGN_MAX_LINE];
+	int lineno=0,section_lineno=0,nr_sections=0;
+	bool in_section=false,ok=true;
+
+	config_defaults(&defaults);
+	config_defaults(&current);
+
+	while(ok==true)
+	{
+		bool eof=(fgets(line,CAMPAIGN_MAX_LINE,in)==NULL);
+
+		if(eof==false)
+		{
+			lineno++;
+
+			if((strchr(line,'\n')==NULL)&&(feof(in)==0))
+			{
+				fprintf(stderr,"%s:%d: line too long\n",filename,lineno);
+				ok=false;
+				break;
+			}
+
+			line[strcspn(line,"#;")]='\0';
+		}
+
+		char *str=trim(line);
+
+		if((eof==false)&&(*str=='\0'))
+			continue;
+
+		/*
+			Every section, i.e. batch, is complete when the next one starts.
+		*/
+
+		if((eof==true)||(*str=='['))
+		{
+			if(in_section==true)
+			{
+				const char *error=campaign_check(&current);
+
+				if(error!=NULL)
+				{
+					fprintf(stderr,"%s:%d: batch '%s': %s\n",filename,section_lineno,prefix,error);
+					ok=false;
+					break;
+				}
+
+				if(campaign_push(campaign,&current,prefix)==false)
+				{
+					ok=false;
+					break;
+				}
+
+				in_section=false;
+			}
+
+			if(eof==true)
+				break;
+
+			char *end=strchr(str,']');
+
+			if((end==NULL)||(*trim(end+1)!='\0'))
+			{
+				fprintf(stderr,"%s:%d: invalid section header\n",filename,lineno);
+				ok=false;
+				break;
+			}
+
+			*end='\0';
+			str=trim(str+1);
+
+			if(*str=='\0')
+			{
+				fprintf(stderr,"%s:%d: empty section name\n",filename,lineno);
+				ok=false;
+				break;
+			}
+
+			strcpy(prefix,str);
+
+			current=defaults;
+			current.ps=copy_list(defaults.ps,defaults.nr_ps);
+			current.pperps=copy_list(defaults.pperps,defaults.nr_pperps);
+
+			in_section=true;
+			section_lineno=lineno;
+			nr_sections++;
+			continue;
+		}
+
+		char *equal=strchr(str,'=');
+
+		if(equal==NULL)
+		{
+			fprintf(stderr,"%s:%d: expected 'key = value'\n",filename,lineno);
+			ok=false;
+			break;
+		}
+
+		*equal='\0';
+
+		char *key=trim(str);
+		char *value=trim(equal+1);
+		const char *error;
+
+		if(campaign_set((in_section==true)?(&current):(&defaults),(in_section==true)?(prefix):(NULL),key,value,&error)==false)
+		{
+			fprintf(stderr,"%s:%d: %s '%s'\n",filename,lineno,error,key);
+			ok=false;
+			break;
+		}
+	}
+
+	if((ok==true)&&(nr_sections==0))
+	{
+		fprintf(stderr,"%s: no batches defined\n",filename);
+		ok=false;
+	}
+
+	if(in_section==true)
+		config_free_lists(&current);
+
+	config_free_lists(&defaults);
+
+	fclose(in);
+
+	return ok;
+}
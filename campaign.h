@@ -0,0 +1,27 @@
+#ifndef __CAMPAIGN_H__
+#define __CAMPAIGN_H__
+
+#include <stdbool.h>
+
+#include "simulation.h"
+
+/*
+	A campaign is a list of batches, each with its own configuration and
+	output prefix, to be run together, see do_batches().
+*/
+
+struct campaign_t
+{
+	struct config_t *configs;
+	char **prefixes;
+
+	int nr_batches,capacity;
+};
+
+void campaign_init(struct campaign_t *campaign);
+void campaign_fini(struct campaign_t *campaign);
+
+bool campaign_add_preset(struct campaign_t *campaign,int id);
+bool campaign_load(struct campaign_t *campaign,const char *filename);
+
+#endif //__CAMPAIGN_H__
@@ -0,0 +1,340 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <assert.h>
+
+#include "common.h"
+#include "simulation.h"
+#include "pipeline.h"
+#include "batch.h"
+#include "scheduler.h"
+#include "checkpoint.h"
+#include "evlog.h"
+
+/*
+	Checkpoints: every CHECKPOINT_INTERVAL seconds, and when the process gets
+	SIGINT or SIGTERM, the scheduler saves the state of all the points, i.e. whether
+	they are done, and the partial statistics of the ones in progress, together
+	with the length of the output files, event log included, at that time.
+
+	When resuming, the output files are truncated to those lengths, so that the
+	points written after the checkpoint are not repeated, the points that are done
+	are skipped, and the partial ones only get the runs they were missing.
+
+	The file is
+
+		"MLCKPT04", hash of the jobs (uint64), number of jobs (int32)
+
+	then, for every job
+
+		number of points (int32), lengths of the output files (7 x int64)
+
+	and, for every point
+
+		status (int32), runs (int32), the compact statistics if partial
+
+	where the hash covers the configurations and the points of all the jobs, so
+	that a checkpoint is never applied to a different set of batches.
+*/
+
+#define CHECKPOINT_MAGIC	"MLCKPT04"
+#define CHECKPOINT_INTERVAL	(300.0)
+
+void checkpoint_init(struct checkpoint_t *checkpoint,const char *filename)
+{
+	checkpoint->filename=filename;
+	checkpoint->interval=CHECKPOINT_INTERVAL;
+	checkpoint->last=get_time();
+	checkpoint->jobs=NULL;
+	checkpoint->nr_jobs=0;
+}
+
+void checkpoint_fini(struct checkpoint_t *checkpoint)
+{
+	for(int c=0;c<checkpoint->nr_jobs;c++)
+	{
+		struct checkpoint_job_t *job=&checkpoint->jobs[c];
+
+		if(job->points==NULL)
+			continue;
+
+		for(int d=0;d<job->nr_points;d++)
+			if(job->points[d].total)
+				free(job->points[d].total);
+
+		free(job->points);
+	}
+
+	if(checkpoint->jobs)
+		free(checkpoint->jobs);
+
+	checkpoint->jobs=NULL;
+	checkpoint->nr_jobs=0;
+}
+
+/*
+	Only what changes the results is hashed: the executor and the number
+	of threads can be changed when resuming.
+*/
+
+static uint64_t checkpoint_hash(struct scheduler_job_t *jobs,int nr_jobs)
+{
+	uint64_t hash=FNV_OFFSET_BASIS;
+
+	FNV_ADD(hash,nr_jobs);
+
+	for(int c=0;c<nr_jobs;c++)
+	{
+		struct config_t *config=jobs[c].config;
+		size_t size=stats_compact_size(config);
+
+		FNV_ADD(hash,size);
+		FNV_ADD(hash,config->xdim);
+		FNV_ADD(hash,config->ydim);
+		FNV_ADD(hash,config->nrlayers);
+		FNV_ADD(hash,config->pbcz);
+		FNV_ADD(hash,config->dual_bc);
+		FNV_ADD(hash,config->measure_jumps);
+		FNV_ADD(hash,config->cluster_observables);
+		FNV_ADD(hash,config->engine);
+		FNV_ADD(hash,config->total_runs);
+		FNV_ADD(hash,config->adaptive);
+		FNV_ADD(hash,config->min_runs);
+		FNV_ADD(hash,config->max_runs);
+		FNV_ADD(hash,config->target_error);
+		FNV_ADD(hash,config->confidence_z);
+		FNV_ADD(hash,jobs[c].nr_points);
+
+		for(int d=0;d<jobs[c].nr_points;d++)
+		{
+			FNV_ADD(hash,jobs[c].points[d].p);
+			FNV_ADD(hash,jobs[c].points[d].pperp);
+			FNV_ADD(hash,jobs[c].points[d].runs);
+		}
+	}
+
+	return hash;
+}
+
+/*
+	Loads the checkpoint, if there is one and it matches the jobs.
+*/
+
+bool checkpoint_load(struct checkpoint_t *checkpoint,struct scheduler_job_t *jobs,int nr_jobs)
+{
+	FILE *in=fopen(checkpoint->filename,"rb");
+
+	if(!in)
+		return false;
+
+	char magic[8];
+	uint64_t hash;
+	int32_t nr_saved_jobs;
+	bool ok=true;
+
+	if((fread(magic,8,1,in)!=1)||(memcmp(magic,CHECKPOINT_MAGIC,8)!=0)||
+	   (fread(&hash,sizeof(uint64_t),1,in)!=1)||(fread(&nr_saved_jobs,sizeof(int32_t),1,in)!=1))
+	{
+		fprintf(stderr,"Warning: %s is not a valid checkpoint, starting from scratch.\n",checkpoint->filename);
+		fclose(in);
+		return false;
+	}
+
+	if((hash!=checkpoint_hash(jobs,nr_jobs))||(nr_saved_jobs!=nr_jobs))
+	{
+		fprintf(stderr,"Warning: %s was written for different batches, starting from scratch.\n",checkpoint->filename);
+		fclose(in);
+		return false;
+	}
+
+	checkpoint->nr_jobs=nr_jobs;
+	checkpoint->jobs=calloc(nr_jobs,sizeof(struct checkpoint_job_t));
+	assert(checkpoint->jobs);
+
+	for(int c=0;(c<nr_jobs)&&(ok==true);c++)
+	{
+		struct checkpoint_job_t *job=&checkpoint->jobs[c];
+		size_t size=stats_compact_size(jobs[c].config);
+		int32_t nr_points;
+		int64_t offsets[CHECKPOINT_NR_OUTPUTS];
+
+		if((fread(&nr_points,sizeof(int32_t),1,in)!=1)||(nr_points!=jobs[c].nr_points)||
+		   (fread(offsets,sizeof(int64_t),CHECKPOINT_NR_OUTPUTS,in)!=CHECKPOINT_NR_OUTPUTS))
+		{
+			ok=false;
+			break;
+		}
+
+		job->nr_points=nr_points;
+		job->points=calloc(MAX(nr_points,1),sizeof(struct checkpoint_point_t));
+		assert(job->points);
+
+		for(int d=0;d<CHECKPOINT_NR_OUTPUTS;d++)
+			job->offsets[d]=offsets[d];
+
+		for(int d=0;d<nr_points;d++)
+		{
+			struct checkpoint_point_t *point=&job->points[d];
+			int32_t fields[2];
+
+			if(fread(fields,sizeof(int32_t),2,in)!=2)
+			{
+				ok=false;
+				break;
+			}
+
+			point->status=fields[0];
+			point->runs=fields[1];
+			point->total=NULL;
+
+			if(point->status==CHECKPOINT_PARTIAL)
+			{
+				point->total=malloc(size);
+				assert(point->total);
+
+				if(fread(point->total,size,1,in)!=1)
+				{
+					ok=false;
+					break;
+				}
+			}
+		}
+	}
+
+	fclose(in);
+
+	if(ok==false)
+	{
+		fprintf(stderr,"Warning: %s is truncated, starting from scratch.\n",checkpoint->filename);
+		checkpoint_fini(checkpoint);
+		return false;
+	}
+
+	return true;
+}
+
+/*
+	Writing a checkpoint: first to a temporary file, which then replaces the
+	old checkpoint, so that there is always a valid one, even if the process
+	is killed while writing.
+*/
+
+FILE *checkpoint_begin(struct checkpoint_t *checkpoint,struct scheduler_job_t *jobs,int nr_jobs)
+{
+	char tmpfile[1024];
+
+	snprintf(tmpfile,1024,"%s.tmp",checkpoint->filename);
+
+	FILE *out=fopen(tmpfile,"wb");
+
+	if(!out)
+	{
+		fprintf(stderr,"Warning: couldn't write the checkpoint to %s.\n",tmpfile);
+		checkpoint->last=get_time();
+		return NULL;
+	}
+
+	uint64_t hash=checkpoint_hash(jobs,nr_jobs);
+	int32_t nr_saved_jobs=nr_jobs;
+
+	fwrite(CHECKPOINT_MAGIC,8,1,out);
+	fwrite(&hash,sizeof(uint64_t),1,out);
+	fwrite(&nr_saved_jobs,sizeof(int32_t),1,out);
+
+	return out;
+}
+
+void checkpoint_add_job(FILE *out,struct scheduler_job_t *job)
+{
+	int32_t nr_points=job->nr_points;
+	int64_t offsets[CHECKPOINT_NR_OUTPUTS]={0,0,0,0,0,0,0};
+
+	if(job->outputs!=NULL)
+	{
+		FILE *files[CHECKPOINT_NR_OUTPUTS-1]={job->outputs->out,job->outputs->out2,job->outputs->out3,job->outputs->out4,job->outputs->out5,job->outputs->out6};
+
+		for(int c=0;c<CHECKPOINT_NR_OUTPUTS-1;c++)
+			if(files[c]!=NULL)
+				offsets[c]=ftell(files[c]);
+
+		offsets[CHECKPOINT_NR_OUTPUTS-1]=evlog_length(job->outputs->evlog);
+	}
+
+	fwrite(&nr_points,sizeof(int32_t),1,out);
+	fwrite(offsets,sizeof(int64_t),CHECKPOINT_NR_OUTPUTS,out);
+}
+
+void checkpoint_add_point(FILE *out,struct config_t *config,int status,int runs,const char *total)
+{
+	int32_t fields[2]={status,runs};
+
+	fwrite(fields,sizeof(int32_t),2,out);
+
+	if(status==CHECKPOINT_PARTIAL)
+		fwrite(total,stats_compact_size(config),1,out);
+}
+
+bool checkpoint_end(struct checkpoint_t *checkpoint,FILE *out)
+{
+	char tmpfile[1024];
+
+	snprintf(tmpfile,1024,"%s.tmp",checkpoint->filename);
+
+	bool ok=(fflush(out)==0)&&(ferror(out)==0)&&(fsync(fileno(out))==0);
+
+	if(fclose(out)!=0)
+		ok=false;
+
+	if((ok==false)||(rename(tmpfile,checkpoint->filename)!=0))
+	{
+		fprintf(stderr,"Warning: couldn't write the checkpoint to %s.\n",checkpoint->filename);
+		checkpoint->last=get_time();
+		return false;
+	}
+
+	checkpoint->last=get_time();
+
+	return true;
+}
+
+/*
+	On SIGINT or SIGTERM the runs in progress are stopped, and a last checkpoint
+	is written. The default handlers are restored by the first signal, so that a
+	second one terminates the process at once.
+*/
+
+static volatile sig_atomic_t checkpoint_signal=0;
+static struct sigaction old_sigint,old_sigterm;
+
+static void checkpoint_handler(int signum)
+{
+	checkpoint_signal=signum;
+}
+
+void checkpoint_install_handlers(void)
+{
+	struct sigaction action;
+
+	memset(&action,0,sizeof(struct sigaction));
+	action.sa_handler=checkpoint_handler;
+	action.sa_flags=SA_RESETHAND;
+	sigemptyset(&action.sa_mask);
+
+	sigaction(SIGINT,&action,&old_sigint);
+	sigaction(SIGTERM,&action,&old_sigterm);
+}
+
+void checkpoint_restore_handlers(void)
+{
+	sigaction(SIGINT,&old_sigint,NULL);
+	sigaction(SIGTERM,&old_sigterm,NULL);
+}
+
+bool checkpoint_interrupted(void)
+{
+	return checkpoint_signal!=0;
+}
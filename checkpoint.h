@@ -0,0 +1,75 @@
+#ifndef __CHECKPOINT_H__
+#define __CHECKPOINT_H__
+
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "simulation.h"
+#include "scheduler.h"
+
+/*
+	Checkpoints of the scheduler, see checkpoint.c.
+*/
+
+#define CHECKPOINT_TODO		(0)
+#define CHECKPOINT_PARTIAL	(1)
+#define CHECKPOINT_DONE		(2)
+
+/*
+	The output files whose length is saved, see outputs_open(), the event log being the last one.
+*/
+
+#define CHECKPOINT_NR_OUTPUTS	(7)
+
+struct checkpoint_point_t
+{
+	int status,runs;
+
+	/*
+		Compact copy of the partial statistics, for the partial points only.
+	*/
+
+	char *total;
+};
+
+struct checkpoint_job_t
+{
+	int nr_points;
+	long offsets[CHECKPOINT_NR_OUTPUTS];
+
+	struct checkpoint_point_t *points;
+};
+
+struct checkpoint_t
+{
+	/*
+		With no file name, nothing is saved, and the structure only gives
+		the initial state of the points, see scheduler_run().
+	*/
+
+	const char *filename;
+	double interval,last;
+
+	/*
+		The initial state of the points, or NULL.
+	*/
+
+	struct checkpoint_job_t *jobs;
+	int nr_jobs;
+};
+
+void checkpoint_init(struct checkpoint_t *checkpoint,const char *filename);
+void checkpoint_fini(struct checkpoint_t *checkpoint);
+
+bool checkpoint_load(struct checkpoint_t *checkpoint,struct scheduler_job_t *jobs,int nr_jobs);
+
+FILE *checkpoint_begin(struct checkpoint_t *checkpoint,struct scheduler_job_t *jobs,int nr_jobs);
+void checkpoint_add_job(FILE *out,struct scheduler_job_t *job);
+void checkpoint_add_point(FILE *out,struct config_t *config,int status,int runs,const char *total);
+bool checkpoint_end(struct checkpoint_t *checkpoint,FILE *out);
+
+void checkpoint_install_handlers(void);
+void checkpoint_restore_handlers(void);
+bool checkpoint_interrupted(void);
+
+#endif //__CHECKPOINT_H__
@@ -1,17 +1,24 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <assert.h>
 
 #include "common.h"
 #include "bonds.h"
 #include "clusters.h"
 #include "jumps.h"
+#include "arena.h"
 
 /*
 	Clusters on a nlayer!
 */
 
 struct nclusters_t *nclusters_init(int x,int y,int nrlayers)
+{
+	return nclusters_init_in(NULL,x,y,nrlayers);
+}
+
+struct nclusters_t *nclusters_init_in(struct arena_t *arena,int x,int y,int nrlayers)
 {
 	struct nclusters_t *ret;
 	
@@ -25,7 +32,7 @@ struct nclusters_t *nclusters_init(int x,int y,int nrlayers)
 
 	for(int c=0;c<nrlayers;c++)
 	{
-		if(!(ret->vals[c]=malloc(sizeof(int)*x*y)))
+		if(!(ret->vals[c]=arena_or_malloc(arena,sizeof(int)*x*y)))
 		{
 			/*
 				If one allocation fails, we free all the
@@ -33,9 +40,9 @@ struct nclusters_t *nclusters_init(int x,int y,int nrlayers)
 			*/
 
 			for(c--;c>=0;c--)
-				if(ret->vals[c])
-					free(ret->vals[c]);
-			
+				arena_or_free(arena,ret->vals[c]);
+
+			free(ret);
 			return NULL;
 		}
 	}
@@ -44,16 +51,36 @@ struct nclusters_t *nclusters_init(int x,int y,int nrlayers)
 	ret->ly=y;
 	ret->nrlayers=nrlayers;
 
+	for(int c=0;c<MAX_NR_OF_LAYERS;c++)
+	{
+		ret->bonds[c]=NULL;
+		ret->ivbonds[c]=NULL;
+	}
+
+	ret->ws=NULL;
+	ret->jws=NULL;
+	ret->kernel=NULL;
+	ret->nr_bonds=ret->nr_vbonds=ret->nr_wrap_vbonds=0;
+	ret->nr_clusters=0;
+	ret->arena=arena;
+
 	return ret;
 }
 
+void nclusters_estimate(struct arena_estimate_t *estimate,int x,int y,int nrlayers)
+{
+	arena_estimate_malloc(estimate,sizeof(struct nclusters_t));
+
+	for(int c=0;c<nrlayers;c++)
+		arena_estimate_alloc(estimate,sizeof(int)*x*y);
+}
+
 void nclusters_fini(struct nclusters_t *nc)
 {
 	if(nc)
 	{
 		for(int c=0;c<nc->nrlayers;c++)
-			if(nc->vals[c])
-				free(nc->vals[c]);
+			arena_or_free(nc->arena,nc->vals[c]);
 
 		free(nc);
 	}
@@ -89,14 +116,142 @@ void nclusters_set_value(struct nclusters_t *nclusters,int x,int y,int layer,int
 	Clusters are identified by means of the Hoshen–Kopelman algorithm
 */
 
-#define MAX_NR_OF_CLUSTERS	(2*1024*1024)
+struct hk_workspace_t *hk_workspace_init(int x,int y,int nrlayers)
+{
+	return hk_workspace_init_in(NULL,x,y,nrlayers);
+}
 
-int hk_find(int labels[MAX_NR_OF_CLUSTERS+1],int x)
+struct hk_workspace_t *hk_workspace_init_in(struct arena_t *arena,int x,int y,int nrlayers)
+{
+	struct hk_workspace_t *ret;
+
+	assert(x>0);
+	assert(y>0);
+	assert(nrlayers>0);
+
+	if(!(ret=malloc(sizeof(struct hk_workspace_t))))
+		return NULL;
+
+	/*
+		Labels start from 1, so one more entry is needed.
+	*/
+
+	ret->capacity=x*y*nrlayers+1;
+	ret->arena=arena;
+	ret->labels=arena_or_malloc(arena,sizeof(int)*ret->capacity);
+	ret->new_labels=arena_or_malloc(arena,sizeof(int)*ret->capacity);
+	ret->info=arena_or_malloc(arena,sizeof(struct cluster_info_t)*ret->capacity);
+	ret->narrow_labels=ret->narrow_vals=NULL;
+	ret->moments=NULL;
+
+	if(ret->capacity<=UINT16_MAX)
+	{
+		ret->narrow_labels=arena_or_malloc(arena,sizeof(uint16_t)*ret->capacity);
+		ret->narrow_vals=arena_or_malloc(arena,sizeof(uint16_t)*x*y*nrlayers);
+
+		if((!ret->narrow_labels)||(!ret->narrow_vals))
+		{
+			hk_workspace_fini(ret);
+			return NULL;
+		}
+	}
+
+	if((!ret->labels)||(!ret->new_labels)||(!ret->info))
+	{
+		hk_workspace_fini(ret);
+		return NULL;
+	}
+
+	return ret;
+}
+
+/*
+	The memory taken by hk_workspace_init_in(), without allocating it.
+*/
+
+void hk_workspace_estimate(struct arena_estimate_t *estimate,int x,int y,int nrlayers)
+{
+	size_t capacity=((size_t)(x))*y*nrlayers+1;
+
+	arena_estimate_malloc(estimate,sizeof(struct hk_workspace_t));
+	arena_estimate_alloc(estimate,sizeof(int)*capacity);
+	arena_estimate_alloc(estimate,sizeof(int)*capacity);
+	arena_estimate_alloc(estimate,sizeof(struct cluster_info_t)*capacity);
+
+	if(capacity<=UINT16_MAX)
+	{
+		arena_estimate_alloc(estimate,sizeof(uint16_t)*capacity);
+		arena_estimate_alloc(estimate,sizeof(uint16_t)*(capacity-1));
+	}
+}
+
+/*
+	Makes room for the moments of the clusters, so that the normalization
+	collects them, along with the other cluster observables.
+*/
+
+void hk_workspace_enable_moments(struct hk_workspace_t *ws)
+{
+	if(ws->moments==NULL)
+		ws->moments=arena_or_malloc(ws->arena,sizeof(struct cluster_moments_t)*ws->capacity);
+}
+
+void hk_workspace_estimate_moments(struct arena_estimate_t *estimate,int x,int y,int nrlayers)
+{
+	arena_estimate_alloc(estimate,sizeof(struct cluster_moments_t)*(((size_t)(x))*y*nrlayers+1));
+}
+
+void hk_workspace_fini(struct hk_workspace_t *ws)
+{
+	if(ws)
+	{
+		arena_or_free(ws->arena,ws->labels);
+		arena_or_free(ws->arena,ws->new_labels);
+		arena_or_free(ws->arena,ws->info);
+		arena_or_free(ws->arena,ws->narrow_labels);
+		arena_or_free(ws->arena,ws->narrow_vals);
+		arena_or_free(ws->arena,ws->moments);
+
+		free(ws);
+	}
+}
+
+/*
+	Returns the workspace attached to the lattice, or a newly allocated
+	one, which the caller will have to release with hk_workspace_release().
+*/
+
+static struct hk_workspace_t *hk_workspace_acquire(struct nclusters_t *nclusters)
+{
+	if(nclusters->ws)
+	{
+		assert(nclusters->ws->capacity>=nclusters->lx*nclusters->ly*nclusters->nrlayers+1);
+		return nclusters->ws;
+	}
+
+	struct hk_workspace_t *ret=hk_workspace_init(nclusters->lx,nclusters->ly,nclusters->nrlayers);
+	assert(ret);
+
+	return ret;
+}
+
+static void hk_workspace_release(struct nclusters_t *nclusters,struct hk_workspace_t *ws)
+{
+	if(ws!=nclusters->ws)
+		hk_workspace_fini(ws);
+}
+
+int hk_find(int *labels,int x)
 {
 	int y=x;
 
+	INSTR_COUNT(finds,1);
+
 	while(labels[y]!=y)
+	{
 		y=labels[y];
+		INSTR_COUNT(find_steps,1);
+	}
 
 	/*
 		We also collapse the tree of aliases, that's an optional optimization.
@@ -112,8 +267,10 @@ int hk_find(int labels[MAX_NR_OF_CLUSTERS+1],int x)
 	return y;
 }
 
-int hk_union(int labels[MAX_NR_OF_CLUSTERS+1],int x,int y)
+int hk_union(int *labels,int x,int y)
 {
+	INSTR_COUNT(unions,1);
+
 	return labels[hk_find(labels,x)]=hk_find(labels,y);
 }
 
@@ -144,18 +301,57 @@ int count_non_zeroes(const int *vals,int len)
 	return cnt;
 }
 
-int nclusters_identify_percolation(struct nclusters_t *nclusters,int *jumps,struct statistics_t *stat,int seq,const gsl_rng *rngctx,bool pbcz)
+#define NR_OF_NEIGHBOURS	(3)
+
+/*
+	Assigns a provisional label to a site, given the labels of the
+	already visited neighbours it is connected to: a new label is created
+	if there are none, otherwise all the neighbouring clusters are merged.
+
+	The workspace has room for one label per site, so it cannot overflow.
+*/
+
+static int hk_label_site(int *labels,int *id,const int neighbours[NR_OF_NEIGHBOURS])
 {
-	int id=1;
+	int nr_of_neighbours=count_non_zeroes(neighbours, NR_OF_NEIGHBOURS);
 
-	assert(nclusters);
+	if(nr_of_neighbours==0)
+	{
+		int ret=*id;
+
+		labels[ret]=ret;
+		(*id)++;
+
+		return ret;
+	}
+
+	int maximum=find_maximum(neighbours,NR_OF_NEIGHBOURS);
+
+	for(int j=0;j<NR_OF_NEIGHBOURS;j++)
+		if((neighbours[j]!=0)&&(neighbours[j]!=maximum))
+			hk_union(labels,neighbours[j],maximum);
+
+	return hk_find(labels,maximum);
+}
+
+static int nclusters_normalize(struct nclusters_t *nclusters,struct hk_workspace_t *ws,int maxlabel);
+static void nclusters_draw_sites(struct nclusters_t *nclusters,const gsl_rng *rngctx);
+static int nclusters_evaluate(struct nclusters_t *nclusters,struct hk_workspace_t *ws,int maxid,int *jumps,struct statistics_t *stat,int seq,bool pbcz);
+
+/*
+	The generic labeling code, working with any number of layers.
+*/
+
+static int nclusters_label(struct nclusters_t *nclusters,struct hk_workspace_t *ws,bool pbcz)
+{
+	int id=1;
 
 	for(int x=0;x<nclusters->lx;x++)
 		for(int y=0;y<nclusters->ly;y++)
 			for(int l=0;l<nclusters->nrlayers;l++)
 				nclusters_set_value(nclusters,x,y,l,0);
 
-	int *labels=malloc(sizeof(int)*(MAX_NR_OF_CLUSTERS+1));
+	int *labels=ws->labels;
 
 	for(int x=0;x<nclusters->lx;x++)
 	{
@@ -163,9 +359,6 @@ int nclusters_identify_percolation(struct nclusters_t *nclusters,int *jumps,stru
 		{
 			for(int l=0;l<nclusters->nrlayers;l++)
 			{
-
-#define NR_OF_NEIGHBOURS	(3)
-
 				int neighbours[NR_OF_NEIGHBOURS]={0,0,0};
 
 				if(x!=0)
@@ -180,25 +373,7 @@ int nclusters_identify_percolation(struct nclusters_t *nclusters,int *jumps,stru
 					if(ivbond2d_get_value(nclusters->ivbonds[l-1], x, y)==1)
 						neighbours[2]=nclusters_get_value(nclusters, x, y, l-1);
 
-				int nr_of_neighbours=count_non_zeroes(neighbours, NR_OF_NEIGHBOURS);
-
-				if(nr_of_neighbours==0)
-				{
-					labels[id]=id;
-					nclusters_set_value(nclusters,x,y,l,id++);
-
-					assert(id<MAX_NR_OF_CLUSTERS);
-				}
-				else
-				{
-					int maximum=find_maximum(neighbours,NR_OF_NEIGHBOURS);
-
-					for(int j=0;j<NR_OF_NEIGHBOURS;j++)
-						if((neighbours[j]!=0)&&(neighbours[j]!=maximum))
-							hk_union(labels,neighbours[j],maximum);
-
-					nclusters_set_value(nclusters,x,y,l,hk_find(labels,maximum));
-				}
+				nclusters_set_value(nclusters,x,y,l,hk_label_site(labels,&id,neighbours));
 
 				assert(nclusters_get_value(nclusters,x,y,l)!=0);
 			}
@@ -211,23 +386,365 @@ int nclusters_identify_percolation(struct nclusters_t *nclusters,int *jumps,stru
 				if(ivbond2d_get_value(nclusters->ivbonds[nclusters->nrlayers-1], x, y)==1)
 					hk_union(labels,nclusters_get_value(nclusters,x,y,0),nclusters_get_value(nclusters,x,y,nclusters->nrlayers-1));
 
+	return nclusters_normalize(nclusters,ws,id-1);
+}
+
+/*
+	The specialized kernels, see hk_kernel.h: one variant for each of the most
+	common numbers of layers, with open or periodic boundary conditions along z,
+	and with 16-bit labels for small lattices or full-width labels otherwise.
+*/
+
+#define KERNEL_LABEL_T	uint16_t
+#define KERNEL_SUFFIX	16
+#define KERNEL_NARROW	1
+#include "hk_kernel.h"
+#undef KERNEL_LABEL_T
+#undef KERNEL_SUFFIX
+#undef KERNEL_NARROW
+
+#define KERNEL_LABEL_T	int
+#define KERNEL_SUFFIX	32
+#define KERNEL_NARROW	0
+#include "hk_kernel.h"
+#undef KERNEL_LABEL_T
+#undef KERNEL_SUFFIX
+#undef KERNEL_NARROW
+
+#define HK_KERNEL(n,pbcz,width)												\
+	static int hk_kernel_##n##_##pbcz##_##width(struct nclusters_t *nclusters,struct hk_workspace_t *ws)	\
+	{															\
+		return hk_kernel_generic_##width(nclusters,ws,n,pbcz);							\
+	}
+
+HK_KERNEL(2,0,16)
+HK_KERNEL(2,0,32)
+HK_KERNEL(2,1,16)
+HK_KERNEL(2,1,32)
+HK_KERNEL(3,0,16)
+HK_KERNEL(3,0,32)
+HK_KERNEL(3,1,16)
+HK_KERNEL(3,1,32)
+HK_KERNEL(4,0,16)
+HK_KERNEL(4,0,32)
+HK_KERNEL(4,1,16)
+HK_KERNEL(4,1,32)
+HK_KERNEL(6,0,16)
+HK_KERNEL(6,0,32)
+HK_KERNEL(6,1,16)
+HK_KERNEL(6,1,32)
+HK_KERNEL(8,0,16)
+HK_KERNEL(8,0,32)
+HK_KERNEL(8,1,16)
+HK_KERNEL(8,1,32)
+
+#define NR_OF_KERNELS	(5)
+
+static const int kernel_nrlayers[NR_OF_KERNELS]={2,3,4,6,8};
+
+static const hk_kernel_t kernels[NR_OF_KERNELS][2][2]=
+{
+	{{hk_kernel_2_0_16,hk_kernel_2_0_32},{hk_kernel_2_1_16,hk_kernel_2_1_32}},
+	{{hk_kernel_3_0_16,hk_kernel_3_0_32},{hk_kernel_3_1_16,hk_kernel_3_1_32}},
+	{{hk_kernel_4_0_16,hk_kernel_4_0_32},{hk_kernel_4_1_16,hk_kernel_4_1_32}},
+	{{hk_kernel_6_0_16,hk_kernel_6_0_32},{hk_kernel_6_1_16,hk_kernel_6_1_32}},
+	{{hk_kernel_8_0_16,hk_kernel_8_0_32},{hk_kernel_8_1_16,hk_kernel_8_1_32}}
+};
+
+/*
+	Returns the kernel specialized for the given geometry, or NULL if there is
+	none, in which case the generic code is used. The 16-bit variants are chosen
+	when the workspace has room for the narrow labels, see hk_workspace_init_in().
+*/
+
+hk_kernel_t nclusters_select_kernel(int x,int y,int nrlayers,bool pbcz)
+{
+	bool narrow=((x*y*nrlayers+1)<=UINT16_MAX);
+
+	for(int c=0;c<NR_OF_KERNELS;c++)
+		if(kernel_nrlayers[c]==nrlayers)
+			return kernels[c][(pbcz==true)?(1):(0)][(narrow==true)?(0):(1)];
+
+	return NULL;
+}
+
+int nclusters_identify_percolation(struct nclusters_t *nclusters,int *jumps,struct statistics_t *stat,int seq,const gsl_rng *rngctx,bool pbcz)
+{
+	int maxid;
+
+	assert(nclusters);
+
+	struct hk_workspace_t *ws=hk_workspace_acquire(nclusters);
+
+	if(nclusters->kernel!=NULL)
+		maxid=nclusters->kernel(nclusters,ws);
+	else
+		maxid=nclusters_label(nclusters,ws,pbcz);
+
+	nclusters->nr_clusters=maxid;
+
+	nclusters_draw_sites(nclusters,rngctx);
+
+	int nr_percolating=nclusters_evaluate(nclusters,ws,maxid,jumps,stat,seq,pbcz);
+
+	hk_workspace_release(nclusters,ws);
+
+	return nr_percolating;
+}
+
+/*
+	A union-find over the normalized ids, in which the root of every set
+	is always its smallest id.
+*/
+
+static int wrap_find(int *labels,int x)
+{
+	while(labels[x]!=x)
+	{
+		labels[x]=labels[labels[x]];
+		x=labels[x];
+	}
+
+	return x;
+}
+
+static void wrap_union(int *labels,int x,int y)
+{
+	x=wrap_find(labels,x);
+	y=wrap_find(labels,y);
+
+	if(x<y)
+		labels[y]=x;
+	else
+		labels[x]=y;
+}
+
+/*
+	Periodic boundary conditions along z from a lattice labeled with open ones:
+	the last call to nclusters_identify_percolation() has left the normalized
+	clusters in the workspace attached to the lattice, and those joined by the
+	vertical bonds between the last and the first layer are merged, then the
+	lattice is evaluated again, as with periodic boundary conditions.
+
+	The merged clusters take the smallest of their ids, and the ids are then
+	compacted, preserving their order: the clusters get exactly the ids that
+	labeling with periodic boundary conditions gives, see nclusters_normalize().
+	Their bounding boxes, sizes and moments are merged from the tables, and the
+	sites are relabeled in a single pass, without any find.
+
+	The random sites tested by the first evaluation are tested again, so that
+	the estimates with the two boundary conditions come from the same sites,
+	and no random numbers are drawn: the random stream is the same as with
+	a single boundary condition.
+*/
+
+int nclusters_identify_percolation_wrapped(struct nclusters_t *nclusters,struct statistics_t *stat,int seq)
+{
+	assert(nclusters);
+	assert(nclusters->ws);
+	assert(nclusters->ivbonds[nclusters->nrlayers-1]);
+
+	struct hk_workspace_t *ws=nclusters->ws;
+	int *labels=ws->labels;
+	int *new_labels=ws->new_labels;
+	struct cluster_info_t *info=ws->info;
+	struct cluster_moments_t *moments=ws->moments;
+
+	int maxid=nclusters->nr_clusters;
+	int top=nclusters->nrlayers-1;
+	int nr_sites=nclusters->lx*nclusters->ly;
+	int *wrap=nclusters->ivbonds[top]->vals;
+
+	for(int c=0;c<=maxid;c++)
+		labels[c]=c;
+
+	for(int idx=0;idx<nr_sites;idx++)
+		if(wrap[idx]==1)
+			wrap_union(labels,nclusters->vals[0][idx],nclusters->vals[top][idx]);
+
 	/*
-		Normalization and collection of statistics about the clusters.
+		A root is never after the clusters merged into it, and no cluster is moved
+		after itself, so the tables can be compacted in place.
 	*/
 
-	id=1;
+	int id=1;
+
+	for(int c=1;c<=maxid;c++)
+	{
+		int r=wrap_find(labels,c);
 
-	int *new_labels=malloc(sizeof(int)*(MAX_NR_OF_CLUSTERS+1));
+		if(r==c)
+		{
+			new_labels[c]=id++;
 
-	for(int c=0;c<(MAX_NR_OF_CLUSTERS+1);c++)
-		new_labels[c]=0;
+			info[new_labels[c]]=info[c];
+
+			if(moments!=NULL)
+				moments[new_labels[c]]=moments[c];
+
+			continue;
+		}
+
+		struct cluster_info_t *root=&info[new_labels[r]];
+
+		new_labels[c]=new_labels[r];
+
+		root->minx=MIN(root->minx,info[c].minx);
+		root->maxx=MAX(root->maxx,info[c].maxx);
+		root->miny=MIN(root->miny,info[c].miny);
+		root->maxy=MAX(root->maxy,info[c].maxy);
+		root->sites+=info[c].sites;
+
+		if(moments!=NULL)
+		{
+			moments[new_labels[r]].x+=moments[c].x;
+			moments[new_labels[r]].y+=moments[c].y;
+			moments[new_labels[r]].z+=moments[c].z;
+			moments[new_labels[r]].r2+=moments[c].r2;
+		}
+	}
+
+	if(id-1<maxid)
+		for(int l=0;l<nclusters->nrlayers;l++)
+			for(int idx=0;idx<nr_sites;idx++)
+				nclusters->vals[l][idx]=new_labels[nclusters->vals[l][idx]];
 
-	struct cluster_info_t
+	nclusters->nr_clusters=id-1;
+
+	return nclusters_evaluate(nclusters,ws,id-1,NULL,stat,seq,true);
+}
+
+/*
+	One labeling sweep of the fused engine: each bond is drawn from the RNG at
+	the moment the sweep reaches it, and used right away. The vertical bonds are
+	always drawn, so that the RNG stream does not depend on 'vertical', but they
+	are used only if 'vertical' is true. Returns the number of provisional labels.
+*/
+
+static int fused_sweep(struct nclusters_t *nclusters,struct hk_workspace_t *ws,double p,double pperp,const gsl_rng *rngctx,bool pbcz,bool vertical,struct statistics_t *stat)
+{
+	int id=1;
+	int bonds=0,vbonds=0;
+	int *labels=ws->labels;
+	int top=nclusters->nrlayers-1;
+
+	for(int x=0;x<nclusters->lx;x++)
+	{
+		for(int y=0;y<nclusters->ly;y++)
+		{
+			for(int l=0;l<nclusters->nrlayers;l++)
+			{
+				int neighbours[NR_OF_NEIGHBOURS]={0,0,0};
+
+				if((x!=0)&&(gsl_rng_uniform(rngctx)<p))
+				{
+					neighbours[0]=nclusters_get_value(nclusters,x-1,y,l);
+					bonds++;
+				}
+
+				if((y!=0)&&(gsl_rng_uniform(rngctx)<p))
+				{
+					neighbours[1]=nclusters_get_value(nclusters,x,y-1,l);
+					bonds++;
+				}
+
+				if((l!=0)&&(gsl_rng_uniform(rngctx)<pperp)&&(vertical==true))
+				{
+					neighbours[2]=nclusters_get_value(nclusters,x,y,l-1);
+					vbonds++;
+				}
+
+				nclusters_set_value(nclusters,x,y,l,hk_label_site(labels,&id,neighbours));
+
+				/*
+					The vertical bond between the last and the first layer: the
+					first layer at (x,y) has already been labeled, so we can merge
+					the two clusters right away.
+				*/
+
+				if((pbcz==true)&&(l==top)&&(gsl_rng_uniform(rngctx)<pperp)&&(vertical==true))
+				{
+					hk_union(labels,nclusters_get_value(nclusters,x,y,0),nclusters_get_value(nclusters,x,y,top));
+					vbonds++;
+				}
+			}
+		}
+	}
+
+	if(stat!=NULL)
 	{
-		int minx,miny,maxx,maxy;
-	};
+		stat->bonds=bonds;
+		stat->vbonds=vbonds;
+	}
+
+	return id;
+}
+
+/*
+	Fused version of the two passes performed in do_run(): the bonds are
+	never stored, rather each one is drawn from the RNG at the moment the
+	labeling sweep reaches it. The lattice is labeled a first time with the
+	vertical bonds (seq=1) and evaluated, then the same bonds are drawn again
+	from 'replay', a copy of the RNG taken before the first sweep, and the
+	lattice is labeled a second time without the vertical bonds (seq=2). The
+	random sites of both evaluations are drawn from 'rngctx', which is left
+	in the same state as if the bonds had been drawn only once.
+
+	Every bond is visited exactly once by the Hoshen-Kopelman sweep, so this
+	is statistically equivalent to the two-pass approach, but the RNG stream
+	is consumed in a different order. The in-plane bonds on the far edges,
+	which are never looked at in absence of periodic boundary conditions
+	along x and y, are not drawn at all.
+
+	Since no bond arrays are available afterwards, jumps cannot be measured.
+*/
+
+void nclusters_identify_percolation_fused(struct nclusters_t *nclusters,double p,double pperp,struct statistics_t *stat,const gsl_rng *rngctx,gsl_rng *replay,bool pbcz)
+{
+	assert(nclusters);
+	assert(replay);
+
+	struct hk_workspace_t *ws=hk_workspace_acquire(nclusters);
+
+	gsl_rng_memcpy(replay,rngctx);
+
+	int id=fused_sweep(nclusters,ws,p,pperp,rngctx,pbcz,true,stat);
+	int maxid=nclusters_normalize(nclusters,ws,id-1);
+	nclusters_draw_sites(nclusters,rngctx);
+	stat->nr_percolating1=nclusters_evaluate(nclusters,ws,maxid,NULL,stat,1,pbcz);
+
+	id=fused_sweep(nclusters,ws,p,pperp,replay,pbcz,false,NULL);
+	maxid=nclusters_normalize(nclusters,ws,id-1);
+	nclusters_draw_sites(nclusters,rngctx);
+	stat->nr_percolating2=nclusters_evaluate(nclusters,ws,maxid,NULL,stat,2,pbcz);
+
+	hk_workspace_release(nclusters,ws);
+}
+
+/*
+	Given the provisional labels and their aliases, the clusters are normalized,
+	i.e. relabeled from 1 to maxid, and their bounding boxes are found.
+	Returns maxid.
+*/
+
+static int nclusters_normalize(struct nclusters_t *nclusters,struct hk_workspace_t *ws,int maxlabel)
+{
+	/*
+		Normalization and collection of statistics about the clusters.
+
+		Only the provisional labels actually used, i.e. from 1 to maxlabel,
+		need to be cleared.
+	*/
+
+	int id=1;
 
-	struct cluster_info_t *info=malloc(sizeof(struct cluster_info_t)*(MAX_NR_OF_CLUSTERS+1));
+	int *labels=ws->labels;
+	int *new_labels=ws->new_labels;
+	struct cluster_info_t *info=ws->info;
+	struct cluster_moments_t *moments=ws->moments;
+
+	for(int c=0;c<=maxlabel;c++)
+		new_labels[c]=0;
 
 	for(int x=0;x<nclusters->lx;x++)
 	{
@@ -244,6 +761,10 @@ int nclusters_identify_percolation(struct nclusters_t *nclusters,int *jumps,stru
 
 					info[new_labels[r]].minx=info[new_labels[r]].maxx=x;
 					info[new_labels[r]].miny=info[new_labels[r]].maxy=y;
+					info[new_labels[r]].sites=1;
+
+					if(moments!=NULL)
+						moments[new_labels[r]]=(struct cluster_moments_t){0.0,0.0,0.0,0.0};
 				}
 				else
 				{
@@ -252,8 +773,12 @@ int nclusters_identify_percolation(struct nclusters_t *nclusters,int *jumps,stru
 
 					info[new_labels[r]].miny=MIN(info[new_labels[r]].miny, y);
 					info[new_labels[r]].maxy=MAX(info[new_labels[r]].maxy, y);
+					info[new_labels[r]].sites++;
 				}
 
+				if(moments!=NULL)
+					cluster_moments_add(&moments[new_labels[r]],x,y,l);
+
 				nclusters_set_value(nclusters,x,y,l,new_labels[r]);
 
 				assert(nclusters_get_value(nclusters,x,y,l)!=0);
@@ -261,28 +786,72 @@ int nclusters_identify_percolation(struct nclusters_t *nclusters,int *jumps,stru
 		}
 	}
 
-	if(new_labels)
-		free(new_labels);
+	return id-1;
+}
 
-	/*
-		We select a random lattice site to check whether it belongs to the percolating cluster,
-		following the criterion in lecture 2 of "An Introduction to Universality" by A. Codello.
-	*/
+/*
+	Adds a finite cluster, of 'sites' sites, to the cluster observables of a run.
+*/
 
-	int rx=gsl_rng_uniform_int(rngctx, nclusters->lx);
-	int ry=gsl_rng_uniform_int(rngctx, nclusters->ly);
-	int rl=gsl_rng_uniform_int(rngctx, nclusters->nrlayers);
+static void cluster_observables_add(struct cluster_observables_t *observables,int sites,const struct cluster_moments_t *moments,double nr_sites)
+{
+	int bin=0;
 
-	int rx_by_layer[MAX_NR_OF_LAYERS];
-	int ry_by_layer[MAX_NR_OF_LAYERS];
-	int rz_by_layer[MAX_NR_OF_LAYERS];
+	while((bin<CLUSTER_NR_BINS-1)&&((sites>>(bin+1))!=0))
+		bin++;
+
+	double s=sites;
+	double cx=moments->x/s,cy=moments->y/s,cz=moments->z/s;
+	double rg2=MAX(moments->r2/s-(cx*cx+cy*cy+cz*cz),0.0);
+
+	observables->clusters[bin]+=1.0;
+	observables->rg2[bin]+=rg2;
+	observables->chi+=s*s/nr_sites;
+	observables->xi_num+=2.0*rg2*s*s;
+	observables->xi_den+=s*s;
+}
+
+/*
+	We select a random lattice site to check whether it belongs to the percolating cluster,
+	following the criterion in lecture 2 of "An Introduction to Universality" by A. Codello,
+	and then one in each layer.
+*/
+
+static void nclusters_draw_sites(struct nclusters_t *nclusters,const gsl_rng *rngctx)
+{
+	struct random_sites_t *sites=&nclusters->sites;
+
+	sites->x=gsl_rng_uniform_int(rngctx, nclusters->lx);
+	sites->y=gsl_rng_uniform_int(rngctx, nclusters->ly);
+	sites->l=gsl_rng_uniform_int(rngctx, nclusters->nrlayers);
 
 	for(int z=0;z<nclusters->nrlayers;z++)
 	{
-		rx_by_layer[z]=gsl_rng_uniform_int(rngctx, nclusters->lx);
-		ry_by_layer[z]=gsl_rng_uniform_int(rngctx, nclusters->ly);
-		rz_by_layer[z]=z;
+		sites->x_by_layer[z]=gsl_rng_uniform_int(rngctx, nclusters->lx);
+		sites->y_by_layer[z]=gsl_rng_uniform_int(rngctx, nclusters->ly);
 	}
+}
+
+/*
+	Once the clusters have been normalized, the percolating ones are
+	identified and the statistics are collected, testing the random
+	sites drawn by nclusters_draw_sites().
+*/
+
+static int nclusters_evaluate(struct nclusters_t *nclusters,struct hk_workspace_t *ws,int maxid,int *jumps,struct statistics_t *stat,int seq,bool pbcz)
+{
+	struct cluster_info_t *info=ws->info;
+
+	int rx=nclusters->sites.x;
+	int ry=nclusters->sites.y;
+	int rl=nclusters->sites.l;
+
+	int *rx_by_layer=nclusters->sites.x_by_layer;
+	int *ry_by_layer=nclusters->sites.y_by_layer;
+	int rz_by_layer[MAX_NR_OF_LAYERS];
+
+	for(int z=0;z<nclusters->nrlayers;z++)
+		rz_by_layer[z]=z;
 
 	/*
 		Finally, we count the percolating clusters.
@@ -296,10 +865,29 @@ int nclusters_identify_percolation(struct nclusters_t *nclusters,int *jumps,stru
 #warning Jumps are calculated only for the first percolating cluster we find. This could be easily extended to all clusters.
 #warning The only difference is that then jumps should be divided by nr_percolating
 
-	int maxid=id-1;
 	int nr_percolating=0;
 	bool first_has_been_found=false;
 
+	/*
+		Besides the random sites above, the exact fraction of the sites in
+		percolating clusters is found from their sizes, see nclusters_normalize().
+		The normalized labels are not needed anymore, so that table is used to
+		mark the percolating clusters.
+	*/
+
+	double nr_sites=((double)(nclusters->lx))*nclusters->ly*nclusters->nrlayers;
+	double *strength=(seq==1)?(stat->strength1):(stat->strength2);
+	double *strength_by_layer=(seq==1)?(stat->strength1_by_layer):(stat->strength2_by_layer);
+	int *percolating=ws->new_labels;
+
+	/*
+		The cluster observables come from the same loop over the clusters,
+		when the normalization has collected their moments.
+	*/
+
+	struct cluster_moments_t *moments=ws->moments;
+	struct cluster_observables_t *observables=&stat->observables[(seq==1)?(0):(1)];
+
 	for(int thisid=1;thisid<=maxid;thisid++)
 	{
 		assert(info[thisid].maxx>=info[thisid].minx);
@@ -308,6 +896,20 @@ int nclusters_identify_percolation(struct nclusters_t *nclusters,int *jumps,stru
 		int xlength=info[thisid].maxx-info[thisid].minx+1;
 		int ylength=info[thisid].maxy-info[thisid].miny+1;
 
+		bool xcrossing=(xlength==nclusters->lx);
+		bool ycrossing=(ylength==nclusters->ly);
+		double fraction=info[thisid].sites/nr_sites;
+
+		strength[CROSSING_X]+=(xcrossing==true)?(fraction):(0.0);
+		strength[CROSSING_Y]+=(ycrossing==true)?(fraction):(0.0);
+		strength[CROSSING_EITHER]+=((xcrossing==true)||(ycrossing==true))?(fraction):(0.0);
+		strength[CROSSING_BOTH]+=((xcrossing==true)&&(ycrossing==true))?(fraction):(0.0);
+
+		percolating[thisid]=((xcrossing==true)||(ycrossing==true))?(1):(0);
+
+		if((moments!=NULL)&&(percolating[thisid]==0))
+			cluster_observables_add(observables,info[thisid].sites,&moments[thisid],nr_sites);
+
 		if(xlength==nclusters->lx)
 		{
 			if(first_has_been_found==false)
@@ -396,11 +998,25 @@ int nclusters_identify_percolation(struct nclusters_t *nclusters,int *jumps,stru
 		}
 	}
 
-	if(info)
-		free(info);
+	/*
+		Splitting the percolating clusters by layer takes a further read of
+		the labels, without any find, and only when there are some.
+	*/
 
-	if(labels)
-		free(labels);
+	if(nr_percolating>0)
+	{
+		double nr_layer_sites=((double)(nclusters->lx))*nclusters->ly;
+
+		for(int l=0;l<nclusters->nrlayers;l++)
+		{
+			int count=0;
+
+			for(int idx=0;idx<nclusters->lx*nclusters->ly;idx++)
+				count+=percolating[nclusters->vals[l][idx]];
+
+			strength_by_layer[l]=count/nr_layer_sites;
+		}
+	}
 
 	return nr_percolating;
 }
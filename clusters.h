@@ -2,11 +2,107 @@
 #define __CLUSTERS_H__
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #include <gsl/gsl_rng.h>
 
 #include "bonds.h"
 #include "common.h"
+#include "instrument.h"
+
+/*
+	Scratch memory used by the Hoshen-Kopelman algorithm: the table of label
+	aliases, the normalized labels, and the bounding box and the number of
+	sites of each cluster.
+
+	There cannot be more clusters than sites, so the tables are sized
+	according to the number of sites in the lattice.
+*/
+
+struct cluster_info_t
+{
+	int minx,miny,maxx,maxy;
+	int sites;
+};
+
+/*
+	The first and second moments of the positions of the sites of each
+	cluster, from which its radius of gyration is found.
+*/
+
+struct cluster_moments_t
+{
+	double x,y,z,r2;
+};
+
+static inline void cluster_moments_add(struct cluster_moments_t *moments,int x,int y,int l)
+{
+	moments->x+=x;
+	moments->y+=y;
+	moments->z+=l;
+	moments->r2+=((double)(x))*x+((double)(y))*y+((double)(l))*l;
+}
+
+struct hk_workspace_t
+{
+	int *labels;
+	int *new_labels;
+	struct cluster_info_t *info;
+
+	/*
+		16-bit copies of the provisional labels, used by the specialized
+		kernels; they are allocated only when all the labels fit.
+	*/
+
+	uint16_t *narrow_labels;
+	uint16_t *narrow_vals;
+
+	/*
+		The moments of each cluster, only allocated when measuring the
+		cluster observables, see hk_workspace_enable_moments().
+	*/
+
+	struct cluster_moments_t *moments;
+
+	int capacity;
+
+	struct arena_t *arena;
+};
+
+struct hk_workspace_t *hk_workspace_init(int x,int y,int nrlayers);
+struct hk_workspace_t *hk_workspace_init_in(struct arena_t *arena,int x,int y,int nrlayers);
+void hk_workspace_fini(struct hk_workspace_t *ws);
+void hk_workspace_enable_moments(struct hk_workspace_t *ws);
+
+struct arena_estimate_t;
+
+void hk_workspace_estimate(struct arena_estimate_t *estimate,int x,int y,int nrlayers);
+void hk_workspace_estimate_moments(struct arena_estimate_t *estimate,int x,int y,int nrlayers);
+
+struct jumps_workspace_t;
+struct nclusters_t;
+
+/*
+	A labeling kernel performs the Hoshen-Kopelman sweep and the normalization
+	of the labels, returning the number of clusters. The specialized kernels are
+	compiled for a fixed number of layers and boundary conditions along z.
+*/
+
+typedef int (*hk_kernel_t)(struct nclusters_t *nclusters,struct hk_workspace_t *ws);
+
+hk_kernel_t nclusters_select_kernel(int x,int y,int nrlayers,bool pbcz);
+
+/*
+	The random sites tested for membership in a percolating cluster, one in the
+	whole lattice and one in each layer, see nclusters_evaluate().
+*/
+
+struct random_sites_t
+{
+	int x,y,l;
+	int x_by_layer[MAX_NR_OF_LAYERS];
+	int y_by_layer[MAX_NR_OF_LAYERS];
+};
 
 struct nclusters_t
 {
@@ -15,18 +111,132 @@ struct nclusters_t
 
 	struct ibond2d_t *bonds[MAX_NR_OF_LAYERS];
 	struct ivbond2d_t *ivbonds[MAX_NR_OF_LAYERS];
+
+	/*
+		Optional scratch memory, not owned by the lattice: when NULL, it is
+		allocated (and freed) at every call. This is how a simulation context
+		can reuse the same memory over many runs.
+	*/
+
+	struct hk_workspace_t *ws;
+	struct jumps_workspace_t *jws;
+
+	/*
+		The labeling kernel, or NULL to use the generic code.
+	*/
+
+	hk_kernel_t kernel;
+
+	/*
+		The number of open bonds, within the layers and between them,
+		as drawn by generate_bonds().
+	*/
+
+	int nr_bonds,nr_vbonds;
+
+	/*
+		Of the vertical bonds, those between the last and the first layer.
+	*/
+
+	int nr_wrap_vbonds;
+
+	/*
+		The number of clusters found by the last labeling, whose labels and
+		cluster tables are left in the workspace, see nclusters_identify_percolation_wrapped().
+	*/
+
+	int nr_clusters;
+
+	/*
+		The random sites tested by the last evaluation, so that the same ones
+		are tested again by nclusters_identify_percolation_wrapped().
+	*/
+
+	struct random_sites_t sites;
+
+#ifdef ML_INSTRUMENT
+	struct instrument_phase_t generate;
+#endif
+
+	struct arena_t *arena;
 };
 
 struct nclusters_t *nclusters_init(int x,int y,int nrlayers);
+struct nclusters_t *nclusters_init_in(struct arena_t *arena,int x,int y,int nrlayers);
+void nclusters_estimate(struct arena_estimate_t *estimate,int x,int y,int nrlayers);
 void nclusters_fini(struct nclusters_t *bc);
 int nclusters_get_value(struct nclusters_t *nclusters,int x,int y,int layer);
 void nclusters_set_value(struct nclusters_t *nclusters,int x,int y,int layer,int value);
 
+/*
+	Observables of the finite clusters, i.e. all but the percolating ones,
+	see nclusters_evaluate(). The sizes are binned logarithmically, the k-th
+	bin holding the clusters with 2^k <= s < 2^(k+1) sites.
+*/
+
+#define CLUSTER_NR_BINS		(32)
+
+struct cluster_observables_t
+{
+	/*
+		The number of clusters in each bin, and the sum of their squared
+		radii of gyration.
+	*/
+
+	double clusters[CLUSTER_NR_BINS];
+	double rg2[CLUSTER_NR_BINS];
+
+	/*
+		The mean cluster size chi = sum s^2 / N, with its square, and the
+		numerator and the denominator of the squared correlation length,
+		xi^2 = sum 2 Rg^2 s^2 / sum s^2.
+	*/
+
+	double chi,chi_sq;
+	double xi_num,xi_den;
+};
+
+#define CROSSING_X		(0)
+#define CROSSING_Y		(1)
+#define CROSSING_EITHER		(2)
+#define CROSSING_BOTH		(3)
+#define NR_OF_CROSSINGS		(4)
+
+struct dual_statistics_t
+{
+	int cntbilayer;
+	int matches1;
+	int matches1_by_layer[MAX_NR_OF_LAYERS];
+	int nr_percolating1;
+
+	double strength1[NR_OF_CROSSINGS];
+	double strength1_sq;
+	double strength1_by_layer[MAX_NR_OF_LAYERS];
+
+	struct cluster_observables_t observables;
+};
+
 struct statistics_t
 {
 	int cntsingle;
 	int cntbilayer;
 
+	/*
+		The number of runs, and the sum of the squared jumps, so that
+		the statistical error on the mean jumps can be estimated.
+		The time spent on the runs is used to estimate their cost.
+	*/
+
+	int runs;
+	double jumps_sq;
+	double cpu_time;
+
+	/*
+		The number of open bonds, within the layers and between them.
+	*/
+
+	double bonds,vbonds;
+
 	int jumps;
 	int matches1;
 	int matches2;
@@ -36,10 +246,45 @@ struct statistics_t
 	int nr_percolating1;
 	int nr_percolating2;
 
+	/*
+		The exact fraction of the sites that belong to percolating clusters,
+		see nclusters_evaluate(): crossing along x, along y, along either
+		direction and along both, then along either direction, layer by layer.
+		The squares of the fractions along either direction are summed too, so
+		that their statistical errors can be estimated.
+	*/
+
+	double strength1[NR_OF_CROSSINGS],strength2[NR_OF_CROSSINGS];
+	double strength1_sq,strength2_sq;
+	double strength1_by_layer[MAX_NR_OF_LAYERS];
+	double strength2_by_layer[MAX_NR_OF_LAYERS];
+
+	/*
+		The cluster observables, for clusters spanning more than one layer
+		first, and for single-layer clusters then; they are only measured
+		when the label tables have room for the moments of the clusters.
+	*/
+
+	struct cluster_observables_t observables[2];
+
+	/*
+		With both boundary conditions along z, see analyze_bonds(), the
+		statistics on clusters spanning more than one layer with the other
+		boundary condition: those on single-layer clusters do not depend on it.
+	*/
+
+	struct dual_statistics_t dual;
+
 	int pbins[MAX_NR_OF_LAYERS*MAX_NR_OF_LAYERS];
 	int ns[MAX_NR_OF_LAYERS];
+
+#ifdef ML_INSTRUMENT
+	struct instrument_t instr;
+#endif
 };
 
 int nclusters_identify_percolation(struct nclusters_t *nclusters,int *jumps,struct statistics_t *stat,int seq,const gsl_rng *rngctx,bool pbcz);
+int nclusters_identify_percolation_wrapped(struct nclusters_t *nclusters,struct statistics_t *stat,int seq);
+void nclusters_identify_percolation_fused(struct nclusters_t *nclusters,double p,double pperp,struct statistics_t *stat,const gsl_rng *rngctx,gsl_rng *replay,bool pbcz);
 
 #endif
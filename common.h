@@ -1,6 +1,9 @@
 #ifndef __COMMON_H__
 #define __COMMON_H__
 
+#include <stddef.h>
+#include <stdint.h>
+
 #define MAX_NR_OF_LAYERS	(256)
 
 #define MAKE_INDEX(ctx,x,y)	((x)+ctx->lx*(y))
@@ -8,4 +11,25 @@
 #define MIN(a,b)	(((a)<(b))?(a):(b))
 #define MAX(a,b)	(((a)>(b))?(a):(b))
 
+/*
+	64-bit FNV-1a, for the checkpoints and the result store.
+*/
+
+#define FNV_OFFSET_BASIS	(UINT64_C(0xcbf29ce484222325))
+
+static inline uint64_t fnv_add(uint64_t hash,const void *data,size_t size)
+{
+	const unsigned char *bytes=data;
+
+	for(size_t c=0;c<size;c++)
+	{
+		hash^=bytes[c];
+		hash*=UINT64_C(0x100000001b3);
+	}
+
+	return hash;
+}
+
+#define FNV_ADD(hash,x)		hash=fnv_add(hash,&(x),sizeof(x))
+
 #endif //__COMMON_H__
@@ -0,0 +1,215 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+
+#include "clusters.h"
+#include "jumps.h"
+#include "arena.h"
+#include "simulation.h"
+#include "context.h"
+
+/*
+	First-touch initialization: on a NUMA system a page is placed on the node
+	of the thread that first writes to it, so all the buffers are written once
+	by the thread creating the context, which is the one that will use them.
+*/
+
+static void touch_lattice(struct nclusters_t *ncs)
+{
+	size_t size=sizeof(int)*ncs->lx*ncs->ly;
+
+	for(int l=0;l<ncs->nrlayers;l++)
+	{
+		memset(ncs->vals[l],0,size);
+
+		if(ncs->bonds[l])
+		{
+			memset(ncs->bonds[l]->vals[0],0,size);
+			memset(ncs->bonds[l]->vals[1],0,size);
+		}
+
+		if(ncs->ivbonds[l])
+			memset(ncs->ivbonds[l]->vals,0,size);
+	}
+}
+
+static void touch_workspace(struct hk_workspace_t *ws)
+{
+	memset(ws->labels,0,sizeof(int)*ws->capacity);
+	memset(ws->new_labels,0,sizeof(int)*ws->capacity);
+	memset(ws->info,0,sizeof(struct cluster_info_t)*ws->capacity);
+
+	if(ws->moments)
+		memset(ws->moments,0,sizeof(struct cluster_moments_t)*ws->capacity);
+}
+
+struct simulation_ctx_t *simulation_ctx_init(struct config_t *config)
+{
+	struct simulation_ctx_t *ret;
+
+	if(!(ret=malloc(sizeof(struct simulation_ctx_t))))
+		return NULL;
+
+	ret->lx=config->xdim;
+	ret->ly=config->ydim;
+	ret->nrlayers=config->nrlayers;
+	ret->pbcz=config->pbcz;
+	ret->dual_bc=config->dual_bc;
+	ret->engine=config->engine;
+
+	ret->replay=NULL;
+	ret->jws=NULL;
+	ret->arena=NULL;
+
+	if(config->hugepages==true)
+	{
+		ret->arena=arena_init(true);
+		assert(ret->arena);
+	}
+
+	ret->ws=hk_workspace_init_in(ret->arena,ret->lx,ret->ly,ret->nrlayers);
+	assert(ret->ws);
+
+	if(config->cluster_observables==true)
+	{
+		hk_workspace_enable_moments(ret->ws);
+		assert(ret->ws->moments);
+	}
+
+	if(config->engine==ENGINE_FUSED)
+	{
+		/*
+			No bonds are stored, only the labels.
+		*/
+
+		ret->ncs=nclusters_init_in(ret->arena,ret->lx,ret->ly,ret->nrlayers);
+		assert(ret->ncs);
+	}
+	else
+	{
+		ret->ncs=lattice_init(config,ret->arena);
+
+		if(config->measure_jumps==true)
+		{
+			ret->jws=jumps_workspace_init_in(ret->arena,ret->lx,ret->ly,ret->nrlayers);
+			assert(ret->jws);
+		}
+	}
+
+	ret->ncs->ws=ret->ws;
+	ret->ncs->jws=ret->jws;
+
+	touch_lattice(ret->ncs);
+	touch_workspace(ret->ws);
+
+	if(ret->jws)
+		jumps_workspace_touch(ret->jws);
+
+	return ret;
+}
+
+void simulation_ctx_fini(struct simulation_ctx_t *ctx)
+{
+	if(ctx)
+	{
+		if(ctx->engine==ENGINE_FUSED)
+			nclusters_fini(ctx->ncs);
+		else
+			lattice_fini(ctx->ncs);
+
+		hk_workspace_fini(ctx->ws);
+		jumps_workspace_fini(ctx->jws);
+
+		if(ctx->replay)
+			gsl_rng_free(ctx->replay);
+
+		/*
+			The arena goes last, since everything above may live in it.
+		*/
+
+		arena_fini(ctx->arena);
+
+		free(ctx);
+	}
+}
+
+/*
+	Checks whether a context can be used for runs with a given configuration.
+*/
+
+bool simulation_ctx_matches(struct simulation_ctx_t *ctx,struct config_t *config)
+{
+	if((ctx->lx!=config->xdim)||(ctx->ly!=config->ydim)||(ctx->nrlayers!=config->nrlayers))
+		return false;
+
+	if((ctx->pbcz!=config->pbcz)||(ctx->dual_bc!=config->dual_bc)||(ctx->engine!=config->engine))
+		return false;
+
+	if((config->measure_jumps==true)&&(ctx->jws==NULL))
+		return false;
+
+	if((config->cluster_observables==true)&&(ctx->ws->moments==NULL))
+		return false;
+
+	return true;
+}
+
+/*
+	The memory used by a context, as far as it is known: only what lives in the arena is counted.
+*/
+
+size_t simulation_ctx_bytes(struct simulation_ctx_t *ctx)
+{
+	if((ctx==NULL)||(ctx->arena==NULL))
+		return 0;
+
+	return arena_total_bytes(ctx->arena);
+}
+
+/*
+	The memory that simulation_ctx_init() would take for a configuration, i.e.
+	the peak memory of a worker thread, estimated before allocating anything by
+	following the same allocations, in the same order.
+*/
+
+size_t simulation_ctx_estimate(struct config_t *config)
+{
+	struct arena_estimate_t estimate;
+
+	arena_estimate_init(&estimate,config->hugepages);
+	arena_estimate_malloc(&estimate,sizeof(struct simulation_ctx_t));
+
+	hk_workspace_estimate(&estimate,config->xdim,config->ydim,config->nrlayers);
+
+	if(config->cluster_observables==true)
+		hk_workspace_estimate_moments(&estimate,config->xdim,config->ydim,config->nrlayers);
+
+	if(config->engine==ENGINE_FUSED)
+	{
+		nclusters_estimate(&estimate,config->xdim,config->ydim,config->nrlayers);
+	}
+	else
+	{
+		lattice_estimate(config,&estimate);
+
+		if(config->measure_jumps==true)
+			jumps_workspace_estimate(&estimate,config->xdim,config->ydim,config->nrlayers);
+	}
+
+	return estimate.bytes;
+}
+
+/*
+	How much of simulation_ctx_estimate() is the graph used to evaluate the
+	jumps, counted for the worst case, a cluster filling the whole lattice.
+*/
+
+size_t simulation_ctx_graph_estimate(struct config_t *config)
+{
+	if((config->engine==ENGINE_FUSED)||(config->measure_jumps==false))
+		return 0;
+
+	return jumps_graph_max_bytes(config->xdim,config->ydim,config->nrlayers);
+}
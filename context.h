@@ -0,0 +1,55 @@
+#ifndef __CONTEXT_H__
+#define __CONTEXT_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "clusters.h"
+#include "simulation.h"
+
+/*
+	A simulation context owns all the memory needed to perform runs with a given
+	geometry (lx, ly, nrlayers, pbcz, dual_bc) and engine: lattices, bonds, label tables
+	and the scratch memory used to evaluate jumps.
+
+	It is meant to be created once per thread, and reused across runs and grid points.
+*/
+
+struct simulation_ctx_t
+{
+	int lx,ly,nrlayers;
+	bool pbcz,dual_bc;
+	int engine;
+
+	/*
+		The lattice, with its bonds only when using the reference engine.
+	*/
+
+	struct nclusters_t *ncs;
+
+	struct hk_workspace_t *ws;
+	struct jumps_workspace_t *jws;
+
+	/*
+		With the fused engine, a copy of the RNG taken before drawing the bonds,
+		used to draw them again for the second labeling, see
+		nclusters_identify_percolation_fused(). It is allocated at the first run.
+	*/
+
+	gsl_rng *replay;
+
+	/*
+		All the large buffers above are allocated from the arena, if present.
+	*/
+
+	struct arena_t *arena;
+};
+
+struct simulation_ctx_t *simulation_ctx_init(struct config_t *config);
+void simulation_ctx_fini(struct simulation_ctx_t *ctx);
+bool simulation_ctx_matches(struct simulation_ctx_t *ctx,struct config_t *config);
+size_t simulation_ctx_bytes(struct simulation_ctx_t *ctx);
+size_t simulation_ctx_estimate(struct config_t *config);
+size_t simulation_ctx_graph_estimate(struct config_t *config);
+
+#endif //__CONTEXT_H__
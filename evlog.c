@@ -0,0 +1,272 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <assert.h>
+
+#include "common.h"
+#include "clusters.h"
+#include "simulation.h"
+#include "evlog.h"
+
+/*
+	The event log of a batch: besides the averages, every single run can be
+	saved, so that new observables, error bars or histograms can be obtained
+	later, without running the simulation again, see mllog.c.
+
+	The records are collected in large per-thread buffers, and appended to the
+	file with a single write() each, rather than one line at a time. The runs
+	of every execution of a batch are added to the runs that are already there,
+	as long as the geometry is the same, but when resuming from a checkpoint
+	the log is truncated to the length it had at the time of the checkpoint,
+	as the other output files, so that no run is there twice.
+*/
+
+#define EVLOG_BUFFER_SIZE	(1<<20)
+
+static void evlog_fill_header(struct config_t *config,struct evlog_header_t *header)
+{
+	memset(header,0,sizeof(struct evlog_header_t));
+	memcpy(header->magic,EVLOG_MAGIC,8);
+
+	header->xdim=config->xdim;
+	header->ydim=config->ydim;
+	header->nrlayers=config->nrlayers;
+	header->pbcz=config->pbcz;
+	header->measure_jumps=config->measure_jumps;
+	header->engine=config->engine;
+	header->record_size=EVLOG_RECORD_SIZE(config->nrlayers);
+}
+
+static bool write_all(int fd,const void *data,size_t size)
+{
+	const char *p=data;
+
+	while(size>0)
+	{
+		ssize_t written=write(fd,p,size);
+
+		if(written<0)
+		{
+			if(errno==EINTR)
+				continue;
+
+			return false;
+		}
+
+		p+=written;
+		size-=written;
+	}
+
+	return true;
+}
+
+/*
+	With a non-negative 'offset', the log is truncated to that length, see above.
+*/
+
+struct evlog_t *evlog_open(struct config_t *config,const char *filename,long offset)
+{
+	struct evlog_header_t header,saved_header;
+
+	evlog_fill_header(config,&header);
+
+	int fd=open(filename,O_RDWR|O_CREAT|O_APPEND,0644);
+
+	if(fd<0)
+	{
+		fprintf(stderr,"Warning: couldn't open the event log %s\n",filename);
+		return NULL;
+	}
+
+	struct stat st;
+	off_t size=(fstat(fd,&st)==0)?(st.st_size):(0);
+
+	if(size>0)
+	{
+		bool same=(pread(fd,&saved_header,sizeof(struct evlog_header_t),0)==sizeof(struct evlog_header_t))&&
+		          (memcmp(&header,&saved_header,sizeof(struct evlog_header_t))==0);
+
+		if(same==false)
+		{
+			fprintf(stderr,"Warning: the event log %s was written for a different geometry, starting a new one.\n",filename);
+			size=0;
+		}
+		else
+		{
+			/*
+				A record left incomplete by a process that was killed is dropped.
+			*/
+
+			off_t records=size-sizeof(struct evlog_header_t);
+
+			size-=records%header.record_size;
+
+			if((offset>=(long)(sizeof(struct evlog_header_t)))&&(offset<size))
+				size=offset;
+		}
+
+		if(ftruncate(fd,size)!=0)
+			fprintf(stderr,"Warning: couldn't truncate %s\n",filename);
+	}
+
+	if((size==0)&&(write_all(fd,&header,sizeof(struct evlog_header_t))==false))
+	{
+		fprintf(stderr,"Warning: couldn't write to the event log %s\n",filename);
+		close(fd);
+		return NULL;
+	}
+
+	struct evlog_t *ret=malloc(sizeof(struct evlog_t));
+	assert(ret);
+
+	ret->fd=fd;
+	ret->nrlayers=config->nrlayers;
+	ret->nr_bins=(config->measure_jumps==true)?(ifactorial(config->nrlayers)):(0);
+	ret->record_size=header.record_size;
+	pthread_mutex_init(&ret->mutex,NULL);
+
+	return ret;
+}
+
+void evlog_close(struct evlog_t *evlog)
+{
+	if(evlog==NULL)
+		return;
+
+	close(evlog->fd);
+	pthread_mutex_destroy(&evlog->mutex);
+	free(evlog);
+}
+
+/*
+	The length of the log, with all the records flushed so far, or 0 for a NULL log.
+*/
+
+long evlog_length(struct evlog_t *evlog)
+{
+	struct stat st;
+	long ret=0;
+
+	if(evlog==NULL)
+		return 0;
+
+	pthread_mutex_lock(&evlog->mutex);
+
+	if(fstat(evlog->fd,&st)==0)
+		ret=st.st_size;
+
+	pthread_mutex_unlock(&evlog->mutex);
+
+	return ret;
+}
+
+/*
+	A buffer for a NULL log does nothing, so that the callers need not check.
+*/
+
+void evlog_buffer_init(struct evlog_buffer_t *buffer,struct evlog_t *evlog,bool hold)
+{
+	buffer->evlog=evlog;
+	buffer->data=NULL;
+	buffer->used=buffer->capacity=0;
+	buffer->hold=hold;
+
+	if(evlog!=NULL)
+	{
+		buffer->capacity=(EVLOG_BUFFER_SIZE/evlog->record_size)*evlog->record_size;
+		buffer->data=malloc(buffer->capacity);
+		assert(buffer->data);
+	}
+}
+
+void evlog_buffer_add(struct evlog_buffer_t *buffer,double p,double pperp,int flags,struct statistics_t *st)
+{
+	struct evlog_t *evlog=buffer->evlog;
+
+	if(evlog==NULL)
+		return;
+
+	if((buffer->used+evlog->record_size>buffer->capacity)&&(buffer->hold==true))
+	{
+		buffer->capacity*=2;
+		buffer->data=realloc(buffer->data,buffer->capacity);
+		assert(buffer->data);
+	}
+
+	if(buffer->used+evlog->record_size>buffer->capacity)
+		evlog_buffer_flush(buffer);
+
+	struct evlog_record_t *record=(struct evlog_record_t *)(buffer->data+buffer->used);
+
+	memset(record,0,evlog->record_size);
+
+	record->p=p;
+	record->pperp=pperp;
+	record->flags=flags;
+	record->nr_percolating1=st->nr_percolating1;
+	record->nr_percolating2=st->nr_percolating2;
+	record->jumps=st->jumps;
+	record->matches1=st->matches1;
+	record->matches2=st->matches2;
+	record->bonds=(int32_t)(st->bonds);
+	record->vbonds=(int32_t)(st->vbonds);
+	record->bin=-1;
+
+	for(int c=0;c<evlog->nr_bins;c++)
+	{
+		if(st->pbins[c]!=0)
+		{
+			record->bin=c;
+			break;
+		}
+	}
+
+	int32_t *ip=(int32_t *)(record+1);
+
+	for(int z=0;z<evlog->nrlayers;z++)
+	{
+		ip[z]=st->matches1_by_layer[z];
+		ip[evlog->nrlayers+z]=st->matches2_by_layer[z];
+		ip[2*evlog->nrlayers+z]=st->ns[z];
+	}
+
+	buffer->used+=evlog->record_size;
+}
+
+void evlog_buffer_flush(struct evlog_buffer_t *buffer)
+{
+	struct evlog_t *evlog=buffer->evlog;
+
+	if((evlog==NULL)||(buffer->used==0))
+		return;
+
+	pthread_mutex_lock(&evlog->mutex);
+
+	if(write_all(evlog->fd,buffer->data,buffer->used)==false)
+		fprintf(stderr,"Warning: couldn't write to the event log\n");
+
+	pthread_mutex_unlock(&evlog->mutex);
+
+	buffer->used=0;
+}
+
+void evlog_buffer_drop(struct evlog_buffer_t *buffer)
+{
+	buffer->used=0;
+}
+
+void evlog_buffer_fini(struct evlog_buffer_t *buffer)
+{
+	evlog_buffer_flush(buffer);
+
+	if(buffer->data)
+		free(buffer->data);
+
+	buffer->data=NULL;
+	buffer->used=buffer->capacity=0;
+}
@@ -0,0 +1,91 @@
+#ifndef __EVLOG_H__
+#define __EVLOG_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+/*
+	The binary event log: a header, followed by a record for every single run.
+	This file is also used by the reader, mllog.c, which does not depend on
+	the rest of the code.
+*/
+
+#define EVLOG_MAGIC		"MLEVLOG1"
+
+struct evlog_header_t
+{
+	char magic[8];
+
+	int32_t xdim,ydim,nrlayers;
+	int32_t pbcz,measure_jumps,engine;
+	int32_t record_size;
+	int32_t reserved;
+};
+
+/*
+	The fixed part of a record: 'flags' holds the spanning flags, as returned
+	by do_run(), 'bonds' and 'vbonds' are the numbers of open bonds within the
+	layers and between them, and 'bin' is the permutation bin of the jumps, or -1.
+
+	It is followed by matches1_by_layer, matches2_by_layer and ns, with 'nrlayers'
+	entries each, and padded to a multiple of 8 bytes.
+*/
+
+struct evlog_record_t
+{
+	double p,pperp;
+
+	int32_t flags;
+	int32_t nr_percolating1,nr_percolating2;
+	int32_t jumps;
+	int32_t matches1,matches2;
+	int32_t bonds,vbonds;
+	int32_t bin;
+	int32_t reserved;
+};
+
+#define EVLOG_RECORD_SIZE(nrlayers)	((sizeof(struct evlog_record_t)+3*sizeof(int32_t)*(nrlayers)+7)/8*8)
+
+struct config_t;
+struct statistics_t;
+
+struct evlog_t
+{
+	int fd;
+	int nrlayers,nr_bins;
+	size_t record_size;
+
+	pthread_mutex_t mutex;
+};
+
+/*
+	Every thread writes through its own buffer, which is
+	appended to the file with a single write when full.
+
+	A buffer with 'hold' set grows instead, and the records are only written
+	by evlog_buffer_flush(), or thrown away by evlog_buffer_drop(): this way
+	the scheduler writes the runs of a task only if it keeps its result.
+*/
+
+struct evlog_buffer_t
+{
+	struct evlog_t *evlog;
+
+	char *data;
+	size_t used,capacity;
+	bool hold;
+};
+
+struct evlog_t *evlog_open(struct config_t *config,const char *filename,long offset);
+void evlog_close(struct evlog_t *evlog);
+long evlog_length(struct evlog_t *evlog);
+
+void evlog_buffer_init(struct evlog_buffer_t *buffer,struct evlog_t *evlog,bool hold);
+void evlog_buffer_add(struct evlog_buffer_t *buffer,double p,double pperp,int flags,struct statistics_t *st);
+void evlog_buffer_flush(struct evlog_buffer_t *buffer);
+void evlog_buffer_drop(struct evlog_buffer_t *buffer);
+void evlog_buffer_fini(struct evlog_buffer_t *buffer);
+
+#endif //__EVLOG_H__
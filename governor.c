@@ -0,0 +1,214 @@
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "common.h"
+#include "simulation.h"
+#include "context.h"
+#include "jumps.h"
+#include "arena.h"
+#include "affinity.h"
+#include "governor.h"
+
+/*
+	The memory budget governor: with a 'memory_budget' (in MB) in the configuration,
+	the memory that each worker thread will need is estimated before anything is
+	allocated, see simulation_ctx_estimate(), and the number of threads is capped
+	so that all of them fit in the budget. When the engine requested is not the
+	leanest one for a batch, the batch is moved to the leaner engine first.
+
+	The budget covers the lattices, the label tables and the scratch memory of
+	the jumps, which grow with the size of the lattice; the statistics, the
+	output buffers and the thread stacks are small, and not counted. The graph
+	used to evaluate the jumps grows with the percolating clusters, and it is
+	counted for the worst case, a cluster filling the whole lattice, which is
+	also as large as it is allowed to grow, see adjacency_set().
+
+	The decisions are reported on stderr.
+*/
+
+#define MB	(1024.0*1024.0)
+
+static const char *engine_names[]={"reference","fused"};
+
+static double budget_bytes(struct config_t *config)
+{
+	return config->memory_budget*MB;
+}
+
+/*
+	Only the last decision is kept, so that the batches run in rounds, with a
+	compute budget or grid refinement, do not report the same one every time.
+*/
+
+static int last_workers=-1,last_fit=-1;
+static size_t last_worker_bytes=0;
+
+/*
+	The part of the memory of each worker taken by the graph of the jumps, in the decisions.
+*/
+
+static void graph_note(char *note,size_t size,size_t graph_bytes,const char *per)
+{
+	note[0]='\0';
+
+	if(graph_bytes>0)
+		snprintf(note,size," (including up to %.1f MB%s for the graph of the jumps, with a cluster filling the lattice)",graph_bytes/MB,per);
+}
+
+static bool governor_report_once(int nr_workers,int fit,size_t worker_bytes)
+{
+	if((nr_workers==last_workers)&&(fit==last_fit)&&(worker_bytes==last_worker_bytes))
+		return false;
+
+	last_workers=nr_workers;
+	last_fit=fit;
+	last_worker_bytes=worker_bytes;
+
+	return true;
+}
+
+/*
+	The reference engine needs the bonds, and the scratch memory of the jumps
+	if they are measured, while the fused engine needs only the labels: it
+	cannot measure the jumps, nor evaluate both boundary conditions along z,
+	otherwise the two engines give the same observables, and the leaner one
+	can be used instead.
+*/
+
+void governor_select_engine(struct config_t *config,const char *prefix)
+{
+	if((config->memory_budget<=0.0)||(config->measure_jumps==true)||(config->dual_bc==true))
+		return;
+
+	struct config_t other=*config;
+
+	other.engine=(config->engine==ENGINE_FUSED)?(ENGINE_REFERENCE):(ENGINE_FUSED);
+
+	size_t worker_bytes=simulation_ctx_estimate(config);
+	size_t other_bytes=simulation_ctx_estimate(&other);
+	int nr_workers=(config->nr_workers>0)?(config->nr_workers):(MAX(affinity_nr_cpus(),1));
+
+	if((((double)(worker_bytes))*nr_workers<=budget_bytes(config))||(other_bytes>=worker_bytes))
+		return;
+
+	fprintf(stderr,"Memory budget: batch %s does not fit with the %s engine (%.1f MB per worker), using the %s engine (%.1f MB per worker).\n",
+		prefix,engine_names[config->engine],worker_bytes/MB,engine_names[other.engine],other_bytes/MB);
+
+	config->engine=other.engine;
+}
+
+/*
+	Returns how many of 'nr_workers' threads, each one needing 'worker_bytes',
+	of which 'graph_bytes' for the graph of the jumps, fit in the budget: at
+	least one, even if a single thread does not fit.
+*/
+
+int governor_workers(struct config_t *config,size_t worker_bytes,size_t graph_bytes,int nr_workers)
+{
+	if((config->memory_budget<=0.0)||(worker_bytes==0))
+		return nr_workers;
+
+	double budget=budget_bytes(config);
+	double room=budget/worker_bytes;
+	int fit=(room>=nr_workers)?(nr_workers):((int)(room));
+
+	if(governor_report_once(nr_workers,fit,worker_bytes)==true)
+	{
+		char note[128];
+
+		graph_note(note,128,graph_bytes,"");
+
+		if(fit<1)
+		{
+			fprintf(stderr,"Warning: a single worker needs %.1f MB%s, over the memory budget of %.1f MB, running one worker anyway.\n",
+				worker_bytes/MB,note,budget/MB);
+		}
+		else if(fit<nr_workers)
+		{
+			fprintf(stderr,"Memory budget: %d workers would need %.1f MB each%s, %.1f MB in total, over the budget of %.1f MB: running %d workers.\n",
+				nr_workers,worker_bytes/MB,note,nr_workers*worker_bytes/MB,budget/MB,fit);
+		}
+		else
+		{
+			fprintf(stderr,"Memory budget: %d workers, %.1f MB each%s, %.1f MB out of %.1f MB.\n",
+				nr_workers,worker_bytes/MB,note,nr_workers*worker_bytes/MB,budget/MB);
+		}
+	}
+
+	return MAX(fit,1);
+}
+
+/*
+	The pipelined executor keeps the lattices in the buffers, all allocated
+	from the same arena, while each analyzer has the label tables and the
+	scratch memory of the jumps, in its own arena, see pipeline.c.
+*/
+
+static size_t pipeline_bytes(struct config_t *config,int nr_analyzers,int nr_buffers)
+{
+	struct arena_estimate_t buffers,analyzer;
+
+	arena_estimate_init(&buffers,config->hugepages);
+
+	for(int c=0;c<nr_buffers;c++)
+		lattice_estimate(config,&buffers);
+
+	arena_estimate_init(&analyzer,config->hugepages);
+	hk_workspace_estimate(&analyzer,config->xdim,config->ydim,config->nrlayers);
+
+	if(config->cluster_observables==true)
+		hk_workspace_estimate_moments(&analyzer,config->xdim,config->ydim,config->nrlayers);
+
+	if(config->measure_jumps==true)
+		jumps_workspace_estimate(&analyzer,config->xdim,config->ydim,config->nrlayers);
+
+	return buffers.bytes+nr_analyzers*analyzer.bytes;
+}
+
+/*
+	The buffers go first, down to one per thread, then the analyzers, each
+	one with its buffer; the generators need almost no memory, and stay.
+*/
+
+void governor_pipeline(struct config_t *config,int *nr_generators,int *nr_analyzers,int *nr_buffers)
+{
+	if(config->memory_budget<=0.0)
+		return;
+
+	double budget=budget_bytes(config);
+	int analyzers=*nr_analyzers,buffers=*nr_buffers;
+	size_t bytes=pipeline_bytes(config,analyzers,buffers);
+
+	while((bytes>budget)&&(buffers>(*nr_generators)+analyzers))
+		bytes=pipeline_bytes(config,analyzers,--buffers);
+
+	while((bytes>budget)&&(analyzers>1))
+	{
+		analyzers--;
+		buffers=MIN(buffers,(*nr_generators)+analyzers);
+		bytes=pipeline_bytes(config,analyzers,buffers);
+	}
+
+	char note[128];
+
+	graph_note(note,128,(config->measure_jumps==true)?(jumps_graph_max_bytes(config->xdim,config->ydim,config->nrlayers)):(0)," per analyzer");
+
+	if(bytes>budget)
+	{
+		fprintf(stderr,"Warning: the pipeline needs at least %.1f MB%s, over the memory budget of %.1f MB, running it anyway.\n",
+			bytes/MB,note,budget/MB);
+	}
+	else if((analyzers<*nr_analyzers)||(buffers<*nr_buffers))
+	{
+		fprintf(stderr,"Memory budget: %d analyzers with %d buffers would need %.1f MB, over the budget of %.1f MB: running %d analyzers with %d buffers (%.1f MB)%s.\n",
+			*nr_analyzers,*nr_buffers,pipeline_bytes(config,*nr_analyzers,*nr_buffers)/MB,budget/MB,analyzers,buffers,bytes/MB,note);
+	}
+	else
+	{
+		fprintf(stderr,"Memory budget: %d analyzers with %d buffers, %.1f MB out of %.1f MB%s.\n",
+			analyzers,buffers,bytes/MB,budget/MB,note);
+	}
+
+	*nr_analyzers=analyzers;
+	*nr_buffers=buffers;
+}
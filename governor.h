@@ -0,0 +1,16 @@
+#ifndef __GOVERNOR_H__
+#define __GOVERNOR_H__
+
+#include <stddef.h>
+
+#include "simulation.h"
+
+/*
+	Fitting the worker threads in a memory budget, see governor.c.
+*/
+
+void governor_select_engine(struct config_t *config,const char *prefix);
+int governor_workers(struct config_t *config,size_t worker_bytes,size_t graph_bytes,int nr_workers);
+void governor_pipeline(struct config_t *config,int *nr_generators,int *nr_analyzers,int *nr_buffers);
+
+#endif //__GOVERNOR_H__
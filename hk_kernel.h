@@ -0,0 +1,205 @@
+/*
+	Template for the specialized Hoshen-Kopelman kernels, included by clusters.c
+	once for each label width, with the following macros defined:
+
+	KERNEL_LABEL_T	the type of the provisional labels
+	KERNEL_SUFFIX	appended to the names of the generated functions
+	KERNEL_NARROW	1 if the provisional labels are kept in the narrow arrays
+			of the workspace, 0 if they are kept in the lattice itself
+
+	The generated hk_kernel_generic_<suffix>() takes the number of layers and
+	the boundary conditions as arguments, but it is always inlined with constant
+	values, see HK_KERNEL() in clusters.c: every variant is then compiled with
+	its own unrolled loop over the layers, and without dead branches.
+
+	There is intentionally no include guard.
+*/
+
+#define KERNEL_CONCAT2(a,b)	a##b
+#define KERNEL_CONCAT(a,b)	KERNEL_CONCAT2(a,b)
+
+#define KERNEL_FIND		KERNEL_CONCAT(hk_find_,KERNEL_SUFFIX)
+#define KERNEL_UNION		KERNEL_CONCAT(hk_union_,KERNEL_SUFFIX)
+#define KERNEL_GENERIC		KERNEL_CONCAT(hk_kernel_generic_,KERNEL_SUFFIX)
+
+static inline KERNEL_LABEL_T KERNEL_FIND(KERNEL_LABEL_T *labels,KERNEL_LABEL_T x)
+{
+	KERNEL_LABEL_T y=x;
+
+	INSTR_COUNT(finds,1);
+
+	while(labels[y]!=y)
+	{
+		y=labels[y];
+		INSTR_COUNT(find_steps,1);
+	}
+
+	while(labels[x]!=x)
+	{
+		KERNEL_LABEL_T z=labels[x];
+		labels[x]=y;
+		x=z;
+	}
+
+	return y;
+}
+
+static inline void KERNEL_UNION(KERNEL_LABEL_T *labels,KERNEL_LABEL_T x,KERNEL_LABEL_T y)
+{
+	INSTR_COUNT(unions,1);
+
+	labels[KERNEL_FIND(labels,x)]=KERNEL_FIND(labels,y);
+}
+
+static inline __attribute__((always_inline)) int KERNEL_GENERIC(struct nclusters_t *nclusters,struct hk_workspace_t *ws,const int nrlayers,const bool pbcz)
+{
+	const int lx=nclusters->lx;
+	const int ly=nclusters->ly;
+
+	KERNEL_LABEL_T *labels;
+	KERNEL_LABEL_T *pvals[MAX_NR_OF_LAYERS];
+
+	const int *xbonds[MAX_NR_OF_LAYERS];
+	const int *ybonds[MAX_NR_OF_LAYERS];
+	const int *vbonds[MAX_NR_OF_LAYERS];
+
+	assert(nclusters->nrlayers==nrlayers);
+
+#if KERNEL_NARROW
+	assert(ws->narrow_labels!=NULL);
+
+	labels=ws->narrow_labels;
+
+	for(int l=0;l<nrlayers;l++)
+		pvals[l]=ws->narrow_vals+l*lx*ly;
+#else
+	labels=ws->labels;
+
+	for(int l=0;l<nrlayers;l++)
+		pvals[l]=nclusters->vals[l];
+#endif
+
+	for(int l=0;l<nrlayers;l++)
+	{
+		xbonds[l]=nclusters->bonds[l]->vals[DIR_X];
+		ybonds[l]=nclusters->bonds[l]->vals[DIR_Y];
+		vbonds[l]=((l<nrlayers-1)||(pbcz==true))?(nclusters->ivbonds[l]->vals):(NULL);
+	}
+
+	/*
+		The sweep follows the memory layout, i.e. x is the inner loop: the
+		neighbours at x-1 and y-1 are visited before the site itself anyway.
+	*/
+
+	int id=1;
+
+	for(int y=0;y<ly;y++)
+	{
+		for(int x=0;x<lx;x++)
+		{
+			int idx=x+lx*y;
+
+			for(int l=0;l<nrlayers;l++)
+			{
+				KERNEL_LABEL_T n0=0,n1=0,n2=0;
+
+				if((x!=0)&&(xbonds[l][idx-1]==1))
+					n0=pvals[l][idx-1];
+
+				if((y!=0)&&(ybonds[l][idx-lx]==1))
+					n1=pvals[l][idx-lx];
+
+				if((l!=0)&&(vbonds[l-1][idx]==1))
+					n2=pvals[l-1][idx];
+
+				if((n0|n1|n2)==0)
+				{
+					labels[id]=id;
+					pvals[l][idx]=id;
+					id++;
+				}
+				else
+				{
+					KERNEL_LABEL_T maximum=MAX(n0,MAX(n1,n2));
+
+					if((n0!=0)&&(n0!=maximum))
+						KERNEL_UNION(labels,n0,maximum);
+
+					if((n1!=0)&&(n1!=maximum))
+						KERNEL_UNION(labels,n1,maximum);
+
+					if((n2!=0)&&(n2!=maximum))
+						KERNEL_UNION(labels,n2,maximum);
+
+					pvals[l][idx]=KERNEL_FIND(labels,maximum);
+				}
+			}
+		}
+	}
+
+	if(pbcz==true)
+		for(int idx=0;idx<lx*ly;idx++)
+			if(vbonds[nrlayers-1][idx]==1)
+				KERNEL_UNION(labels,pvals[0][idx],pvals[nrlayers-1][idx]);
+
+	/*
+		Normalization, visiting the sites in the same order as nclusters_normalize(),
+		so that the clusters get exactly the same ids as with the generic code.
+	*/
+
+	int *new_labels=ws->new_labels;
+	struct cluster_info_t *info=ws->info;
+	struct cluster_moments_t *moments=ws->moments;
+
+	for(int c=0;c<id;c++)
+		new_labels[c]=0;
+
+	int newid=1;
+
+	for(int x=0;x<lx;x++)
+	{
+		for(int y=0;y<ly;y++)
+		{
+			int idx=x+lx*y;
+
+			for(int l=0;l<nrlayers;l++)
+			{
+				int r=KERNEL_FIND(labels,pvals[l][idx]);
+
+				if(new_labels[r]==0)
+				{
+					new_labels[r]=newid++;
+
+					info[new_labels[r]].minx=info[new_labels[r]].maxx=x;
+					info[new_labels[r]].miny=info[new_labels[r]].maxy=y;
+					info[new_labels[r]].sites=1;
+
+					if(moments!=NULL)
+						moments[new_labels[r]]=(struct cluster_moments_t){0.0,0.0,0.0,0.0};
+				}
+				else
+				{
+					info[new_labels[r]].minx=MIN(info[new_labels[r]].minx, x);
+					info[new_labels[r]].maxx=MAX(info[new_labels[r]].maxx, x);
+
+					info[new_labels[r]].miny=MIN(info[new_labels[r]].miny, y);
+					info[new_labels[r]].maxy=MAX(info[new_labels[r]].maxy, y);
+					info[new_labels[r]].sites++;
+				}
+
+				if(moments!=NULL)
+					cluster_moments_add(&moments[new_labels[r]],x,y,l);
+
+				nclusters->vals[l][idx]=new_labels[r];
+			}
+		}
+	}
+
+	return newid-1;
+}
+
+#undef KERNEL_FIND
+#undef KERNEL_UNION
+#undef KERNEL_GENERIC
+#undef KERNEL_CONCAT
+#undef KERNEL_CONCAT2
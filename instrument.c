@@ -0,0 +1,168 @@
+#include "instrument.h"
+
+#ifdef ML_INSTRUMENT
+
+#include <string.h>
+#include <pthread.h>
+
+#include "simulation.h"
+
+_Thread_local struct instrument_t instrument_counters;
+
+void instrument_phase_add(struct instrument_phase_t *total,const struct instrument_phase_t *phase)
+{
+	total->ticks+=phase->ticks;
+
+	for(int c=0;c<PERF_NR_EVENTS;c++)
+		total->events[c]+=phase->events[c];
+}
+
+/*
+	What has been spent since 'mark' was taken, by the same thread.
+*/
+
+void instrument_phase_since(struct instrument_phase_t *phase,const struct instrument_phase_t *mark)
+{
+	struct instrument_phase_t now;
+
+	instrument_mark(&now);
+
+	phase->ticks=now.ticks-mark->ticks;
+
+	for(int c=0;c<PERF_NR_EVENTS;c++)
+		phase->events[c]=now.events[c]-mark->events[c];
+}
+
+void instrument_phase_stop(struct instrument_phase_t *total,const struct instrument_phase_t *mark)
+{
+	struct instrument_phase_t phase;
+
+	instrument_phase_since(&phase,mark);
+	instrument_phase_add(total,&phase);
+}
+
+void instrument_reset(struct instrument_t *instr)
+{
+	memset(instr->phases,0,sizeof(struct instrument_phase_t)*INSTR_NR_PHASES);
+
+	instr->unions=instr->finds=instr->find_steps=0;
+	instr->vertices=instr->dijkstra_iterations=0;
+}
+
+void instrument_add(struct instrument_t *total,const struct instrument_t *instr)
+{
+	for(int c=0;c<INSTR_NR_PHASES;c++)
+		instrument_phase_add(&total->phases[c],&instr->phases[c]);
+
+	total->unions+=instr->unions;
+	total->finds+=instr->finds;
+	total->find_steps+=instr->find_steps;
+	total->vertices+=instr->vertices;
+	total->dijkstra_iterations+=instr->dijkstra_iterations;
+}
+
+/*
+	The rate of the time-stamp counter, measured once against the wall clock.
+*/
+
+static double ticks_per_second;
+static pthread_once_t ticks_per_second_once=PTHREAD_ONCE_INIT;
+
+static void instrument_calibrate(void)
+{
+	struct timespec delay={0,20000000};
+
+	double t0=get_time();
+	uint64_t ticks0=instrument_ticks();
+
+	nanosleep(&delay,NULL);
+
+	double t1=get_time();
+	uint64_t ticks1=instrument_ticks();
+
+	ticks_per_second=((double)(ticks1-ticks0))/(t1-t0);
+}
+
+double instrument_ticks_per_second(void)
+{
+	pthread_once(&ticks_per_second_once,instrument_calibrate);
+
+	return ticks_per_second;
+}
+
+static const char *phase_names[INSTR_NR_PHASES]={"generate","label1","clear","label2","jumps"};
+
+/*
+	The hardware counters are only written if they are in use, see perf.c.
+*/
+
+void instrument_write_header(FILE *out)
+{
+	fprintf(out,"# p pperp runs generate_ns label1_ns clear_ns label2_ns jumps_ns ");
+	fprintf(out,"unions finds mean_find_path vertices dijkstra_iterations");
+
+	if(perf_active==true)
+		for(int c=0;c<INSTR_NR_PHASES;c++)
+			for(int d=0;d<PERF_NR_EVENTS;d++)
+				fprintf(out," %s_%s",phase_names[c],perf_event_names[d]);
+
+	fprintf(out,"\n");
+}
+
+/*
+	The first labeling pass without the jumps.
+*/
+
+static uint64_t label1_only(const struct instrument_t *instr,int event)
+{
+	const struct instrument_phase_t *label1=&instr->phases[INSTR_LABEL1];
+	const struct instrument_phase_t *jumps=&instr->phases[INSTR_JUMPS];
+
+	if(event<0)
+		return (label1->ticks>jumps->ticks)?(label1->ticks-jumps->ticks):(0);
+
+	return (label1->events[event]>jumps->events[event])?(label1->events[event]-jumps->events[event]):(0);
+}
+
+/*
+	One row per point: the times are in nanoseconds per run, with the first
+	labeling pass not including the jumps, the counters and the hardware
+	events are per run too.
+*/
+
+void instrument_write(FILE *out,double p,double pperp,int runs,const struct instrument_t *instr)
+{
+	double ns_per_tick=1e9/instrument_ticks_per_second();
+
+	fprintf(out,"%f %f %d ",p,pperp,runs);
+	fprintf(out,"%f ",ns_per_tick*instr->phases[INSTR_GENERATE].ticks/runs);
+	fprintf(out,"%f ",ns_per_tick*label1_only(instr,-1)/runs);
+	fprintf(out,"%f ",ns_per_tick*instr->phases[INSTR_CLEAR].ticks/runs);
+	fprintf(out,"%f ",ns_per_tick*instr->phases[INSTR_LABEL2].ticks/runs);
+	fprintf(out,"%f ",ns_per_tick*instr->phases[INSTR_JUMPS].ticks/runs);
+	fprintf(out,"%f ",((double)(instr->unions))/runs);
+	fprintf(out,"%f ",((double)(instr->finds))/runs);
+	fprintf(out,"%f ",(instr->finds>0)?(((double)(instr->find_steps))/instr->finds):(0.0));
+	fprintf(out,"%f ",((double)(instr->vertices))/runs);
+	fprintf(out,"%f ",((double)(instr->dijkstra_iterations))/runs);
+
+	if(perf_active==true)
+	{
+		for(int c=0;c<INSTR_NR_PHASES;c++)
+		{
+			for(int d=0;d<PERF_NR_EVENTS;d++)
+			{
+				uint64_t value=(c==INSTR_LABEL1)?(label1_only(instr,d)):(instr->phases[c].events[d]);
+
+				if(perf_event_available(d)==true)
+					fprintf(out,"%f ",((double)(value))/runs);
+				else
+					fprintf(out,"nan ");
+			}
+		}
+	}
+
+	fprintf(out,"\n");
+}
+
+#endif
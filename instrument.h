@@ -0,0 +1,132 @@
+#ifndef __INSTRUMENT_H__
+#define __INSTRUMENT_H__
+
+/*
+	Optional instrumentation of the single runs, compiled in only when ML_INSTRUMENT
+	is defined, e.g. with cmake -DML_INSTRUMENT=ON: the time spent in each phase
+	of a run, read from the time-stamp counter, and a few counters of the work
+	done by the algorithms. Without ML_INSTRUMENT, the macros at the end of this
+	file expand to nothing, and the code is exactly the same as before.
+
+	Instrumented builds can also read the hardware performance counters at the
+	boundaries of the phases, see perf.h, if perf_enable() has succeeded.
+
+	The counters are kept per thread, in 'instrument_counters', so that the
+	labeling and jumps code does not need to know where they go: analyze_bonds()
+	and do_run() reset them at the beginning of a run, and move them to the
+	statistics of the run at the end. From there, they are summed over the
+	points like everything else, and written to <prefix>.instr.dat.
+*/
+
+#define INSTR_GENERATE		(0)
+#define INSTR_LABEL1		(1)
+#define INSTR_CLEAR		(2)
+#define INSTR_LABEL2		(3)
+#define INSTR_JUMPS		(4)
+#define INSTR_NR_PHASES		(5)
+
+#ifdef ML_INSTRUMENT
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "perf.h"
+
+#if defined(__x86_64__)||defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/*
+	The ticks, and the hardware events, either at a given moment or spent
+	in a phase.
+*/
+
+struct instrument_phase_t
+{
+	uint64_t ticks;
+	uint64_t events[PERF_NR_EVENTS];
+};
+
+struct instrument_t
+{
+	/*
+		The phases: the bond generation, the two labeling passes and the
+		clearing of the vertical bonds between them, and the evaluation of
+		the jumps, which happens during the first pass, and is included in
+		its ticks too. The fused engine does everything in its single
+		labeling sweep, counted as the first pass.
+	*/
+
+	struct instrument_phase_t phases[INSTR_NR_PHASES];
+
+	/*
+		The union-find operations, with the total length of the paths followed
+		by the finds, and the graphs built to evaluate the jumps.
+	*/
+
+	uint64_t unions,finds,find_steps;
+	uint64_t vertices,dijkstra_iterations;
+};
+
+extern _Thread_local struct instrument_t instrument_counters;
+
+static inline uint64_t instrument_ticks(void)
+{
+#if defined(__x86_64__)||defined(__i386__)
+	return __rdtsc();
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+
+	return ((uint64_t)(ts.tv_sec))*1000000000ULL+ts.tv_nsec;
+#endif
+}
+
+static inline void instrument_mark(struct instrument_phase_t *mark)
+{
+	mark->ticks=instrument_ticks();
+
+	if(perf_active==true)
+	{
+		perf_read(mark->events);
+		return;
+	}
+
+	for(int c=0;c<PERF_NR_EVENTS;c++)
+		mark->events[c]=0;
+}
+
+void instrument_phase_add(struct instrument_phase_t *total,const struct instrument_phase_t *phase);
+void instrument_phase_since(struct instrument_phase_t *phase,const struct instrument_phase_t *mark);
+void instrument_phase_stop(struct instrument_phase_t *total,const struct instrument_phase_t *mark);
+
+void instrument_reset(struct instrument_t *instr);
+void instrument_add(struct instrument_t *total,const struct instrument_t *instr);
+
+double instrument_ticks_per_second(void);
+void instrument_write_header(FILE *out);
+void instrument_write(FILE *out,double p,double pperp,int runs,const struct instrument_t *instr);
+
+#define INSTR_START(t)		struct instrument_phase_t t; instrument_mark(&t)
+#define INSTR_STOP(phase,t)	instrument_phase_stop(&instrument_counters.phases[phase],&(t))
+#define INSTR_ELAPSED(dst,t)	instrument_phase_since(&(dst),&(t))
+#define INSTR_ADD(phase,src)	instrument_phase_add(&instrument_counters.phases[phase],&(src))
+#define INSTR_COUNT(field,n)	instrument_counters.field+=(n)
+#define INSTR_RESET()		instrument_reset(&instrument_counters)
+#define INSTR_COLLECT(stat)	instrument_add(&(stat)->instr,&instrument_counters)
+
+#else
+
+#define INSTR_START(t)
+#define INSTR_STOP(phase,t)
+#define INSTR_ELAPSED(dst,t)
+#define INSTR_ADD(phase,src)
+#define INSTR_COUNT(field,n)
+#define INSTR_RESET()
+#define INSTR_COLLECT(stat)
+
+#endif
+
+#endif //__INSTRUMENT_H__
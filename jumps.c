@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <stdbool.h>
 #include <assert.h>
 #include <limits.h>
@@ -9,6 +10,7 @@
 
 #include "jumps.h"
 #include "clusters.h"
+#include "arena.h"
 
 /*
 	Simply prints a matrix, with a newline after each row.
@@ -37,28 +39,130 @@ struct adjacency_t
 {
 	gsl_spmatrix_int *m;
 	int nr_vertices;
+
+	/*
+		The matrix, along with the scratch arrays used by dijkstra_distance(),
+		can hold up to 'capacity' vertices, so that it can be reused, and it
+		never grows beyond 'max_entries', see adjacency_set().
+	*/
+
+	int capacity;
+	size_t max_entries;
+	int *distances;
+	bool *in_spt;
+
+	struct arena_t *arena;
 };
 
-struct adjacency_t *init_adjacency(int nr_vertices)
+/*
+	Every site adds at most eight entries to the matrix: two for each of its
+	three bonds, to the next sites along x, y and z, and two towards the start
+	and end nodes. There are fewer vertices than sites, so eight entries per
+	vertex are enough for any graph, a cluster filling the whole lattice included.
+
+	The matrix is not sized for that worst case, which takes about 350 bytes
+	per site: room is reserved for the edges of a few thousand vertices, and
+	it is doubled when needed, up to the worst case, see adjacency_set().
+	Clearing the matrix keeps its storage, so it grows to fit the largest
+	graph seen by the thread, and no further.
+*/
+
+#define EDGES_PER_VERTEX		(8)
+#define ADJACENCY_RESERVED_VERTICES	(4096)
+
+static size_t adjacency_reserved_entries(int nr_vertices)
+{
+	return EDGES_PER_VERTEX*((size_t)(MIN(nr_vertices,ADJACENCY_RESERVED_VERTICES)));
+}
+
+static size_t adjacency_max_entries(int nr_vertices)
+{
+	return EDGES_PER_VERTEX*((size_t)(nr_vertices));
+}
+
+struct adjacency_t *init_adjacency(struct arena_t *arena,int nr_vertices)
 {
 	struct adjacency_t *ret=malloc(sizeof(struct adjacency_t));
+	assert(ret);
 
-	ret->m=gsl_spmatrix_int_alloc(nr_vertices,nr_vertices);
+	ret->m=gsl_spmatrix_int_alloc_nzmax(nr_vertices,nr_vertices,adjacency_reserved_entries(nr_vertices),GSL_SPMATRIX_TRIPLET);
 	ret->nr_vertices=nr_vertices;
+	ret->capacity=nr_vertices;
+	ret->max_entries=adjacency_max_entries(nr_vertices);
+	ret->arena=arena;
+	ret->distances=arena_or_malloc(arena,sizeof(int)*nr_vertices);
+	ret->in_spt=arena_or_malloc(arena,sizeof(bool)*nr_vertices);
+
+	assert(ret->m&&ret->distances&&ret->in_spt);
 
 	return ret;
 }
 
+/*
+	A triplet matrix stores the row, the column and the value of each entry,
+	and since GSL 2.6 also a node of the binary tree used to look them up,
+	of four words; a work array of one word per row is allocated as well.
+
+	The matrix starts from the reserved entries, see init_adjacency(), but the
+	largest percolating cluster can make it grow up to the worst case, which is
+	what is counted, so that the estimate is an upper bound.
+*/
+
+#define TRIPLET_BYTES_PER_ENTRY	(3*sizeof(int)+4*sizeof(void *))
+
+static size_t adjacency_max_bytes(int nr_vertices)
+{
+	return sizeof(gsl_spmatrix_int)+adjacency_max_entries(nr_vertices)*TRIPLET_BYTES_PER_ENTRY;
+}
+
+static void adjacency_estimate(struct arena_estimate_t *estimate,int nr_vertices)
+{
+	arena_estimate_malloc(estimate,sizeof(struct adjacency_t));
+	arena_estimate_malloc(estimate,adjacency_max_bytes(nr_vertices));
+	arena_estimate_malloc(estimate,sizeof(size_t)*nr_vertices);
+	arena_estimate_alloc(estimate,sizeof(int)*nr_vertices);
+	arena_estimate_alloc(estimate,sizeof(bool)*nr_vertices);
+}
+
 void fini_adjacency(struct adjacency_t *adj)
 {
-	gsl_spmatrix_int_free(adj->m);
+	if(adj)
+	{
+		gsl_spmatrix_int_free(adj->m);
+
+		arena_or_free(adj->arena,adj->distances);
+		arena_or_free(adj->arena,adj->in_spt);
+
+		free(adj);
+	}
 }
 
+/*
+	Removes all the edges, and sets the number of vertices.
+*/
+
+void reset_adjacency(struct adjacency_t *adj,int nr_vertices)
+{
+	assert(nr_vertices<=adj->capacity);
+
+	gsl_spmatrix_int_set_zero(adj->m);
+	adj->nr_vertices=nr_vertices;
+}
+
+/*
+	GSL doubles the storage of a full matrix: here it is grown beforehand, in
+	the same way, but never beyond the worst case, which would waste up to half
+	of the largest allocation.
+*/
+
 void adjacency_set(struct adjacency_t *adj, int i, int j, int weight)
 {
 	if(weight==INT_MAX)
 		return;
 
+	if((adj->m->nz>=adj->m->nzmax)&&(adj->m->nzmax<adj->max_entries))
+		gsl_spmatrix_int_realloc(MIN(2*adj->m->nzmax,adj->max_entries),adj->m);
+
 	gsl_spmatrix_int_set(adj->m,i,j,1+weight);
 }
 
@@ -106,14 +210,14 @@ int dijkstra_distance(struct adjacency_t *adj, int from, int to)
 		The output array. distances[i] will hold the shortest distance from 'from' to i.
 	*/
 
-	int *distances=malloc(sizeof(int)*V);
+	int *distances=adj->distances;
 
 	/*
 		in_spt[i] will be true if either vertex i is included in the shortest
 		path tree or the shortest distance from 'from' to i is finalized.
 	*/
 
-	bool *in_spt=malloc(sizeof(bool)*V);
+	bool *in_spt=adj->in_spt;
 
 	/*
 		Initialize all distances to infinite and all values in in_spt to false.
@@ -150,6 +254,8 @@ int dijkstra_distance(struct adjacency_t *adj, int from, int to)
 
 		in_spt[u]=true;
 
+		INSTR_COUNT(dijkstra_iterations,1);
+
 		/*
 			Update distances value of the adjacent vertices of the picked vertex.
 		*/
@@ -169,15 +275,7 @@ int dijkstra_distance(struct adjacency_t *adj, int from, int to)
 		}
 	}
 
-	int result=distances[to];
-
-	if(distances)
-		free(distances);
-
-	if(in_spt)
-		free(in_spt);
-
-	return result;
+	return distances[to];
 }
 
 void add_edge(struct adjacency_t *adj, int id1, int id2, int weight)
@@ -437,12 +535,105 @@ void fill_ns_bins(int nrlayers,const int bins[MAX_NR_OF_LAYERS],int *ns)
 	}
 }
 
+/*
+	Scratch memory for ncluster_evaluate_jumps(): the lattice of vertex ids and the
+	graph. The lattice and the arrays used by Dijkstra are sized for the worst case,
+	i.e. a cluster filling the whole lattice, the edges of the graph grow on demand.
+*/
+
+struct jumps_workspace_t
+{
+	struct nclusters_t *vertices;
+	struct adjacency_t *adj;
+};
+
+struct jumps_workspace_t *jumps_workspace_init(int x,int y,int nrlayers)
+{
+	return jumps_workspace_init_in(NULL,x,y,nrlayers);
+}
+
+/*
+	The GSL sparse matrix has its own allocator, so only the lattice
+	of vertices and the arrays used by Dijkstra go into the arena.
+*/
+
+struct jumps_workspace_t *jumps_workspace_init_in(struct arena_t *arena,int x,int y,int nrlayers)
+{
+	struct jumps_workspace_t *ret;
+
+	if(!(ret=malloc(sizeof(struct jumps_workspace_t))))
+		return NULL;
+
+	ret->vertices=nclusters_init_in(arena,x,y,nrlayers);
+	ret->adj=init_adjacency(arena,x*y*nrlayers+2);
+
+	if((!ret->vertices)||(!ret->adj))
+	{
+		jumps_workspace_fini(ret);
+		return NULL;
+	}
+
+	return ret;
+}
+
+/*
+	The memory taken by jumps_workspace_init_in(), without allocating it.
+*/
+
+void jumps_workspace_estimate(struct arena_estimate_t *estimate,int x,int y,int nrlayers)
+{
+	arena_estimate_malloc(estimate,sizeof(struct jumps_workspace_t));
+	nclusters_estimate(estimate,x,y,nrlayers);
+	adjacency_estimate(estimate,x*y*nrlayers+2);
+}
+
+/*
+	The largest that the graph used to evaluate the jumps can get, which is
+	counted in full by jumps_workspace_estimate().
+*/
+
+size_t jumps_graph_max_bytes(int x,int y,int nrlayers)
+{
+	return adjacency_max_bytes(x*y*nrlayers+2);
+}
+
+void jumps_workspace_fini(struct jumps_workspace_t *jws)
+{
+	if(jws)
+	{
+		if(jws->vertices)
+			nclusters_fini(jws->vertices);
+
+		if(jws->adj)
+			fini_adjacency(jws->adj);
+
+		free(jws);
+	}
+}
+
+/*
+	Writes once to all the memory in the workspace, see simulation_ctx_init().
+*/
+
+void jumps_workspace_touch(struct jumps_workspace_t *jws)
+{
+	struct nclusters_t *vertices=jws->vertices;
+
+	for(int l=0;l<vertices->nrlayers;l++)
+		memset(vertices->vals[l],0,sizeof(int)*vertices->lx*vertices->ly);
+
+	memset(jws->adj->distances,0,sizeof(int)*jws->adj->capacity);
+	memset(jws->adj->in_spt,0,sizeof(bool)*jws->adj->capacity);
+}
+
 int ncluster_evaluate_jumps(struct nclusters_t *nclusters,int id,int spanning,bool pbcz,int *pbins,int *ns)
 {
 	assert(nclusters!=NULL);
 	assert(id!=0);
 	assert((spanning==DIR_X)||(spanning==DIR_Y));
 
+	INSTR_START(t0);
+
 	/*
 		We create a graph that corresponds to the cluster, augmented by two nodes:
 		assuming the cluster is percolating from left to right, a start node (id=0)
@@ -459,12 +650,23 @@ int ncluster_evaluate_jumps(struct nclusters_t *nclusters,int id,int spanning,bo
 
 	int nr_vertices=2;
 
+	/*
+		The workspace attached to the lattice is used, if available.
+	*/
+
+	struct jumps_workspace_t *jws=nclusters->jws;
+
+	if(jws==NULL)
+		jws=jumps_workspace_init(nclusters->lx,nclusters->ly,nclusters->nrlayers);
+
+	assert(jws!=NULL);
+	assert((jws->vertices->lx==nclusters->lx)&&(jws->vertices->ly==nclusters->ly)&&(jws->vertices->nrlayers==nclusters->nrlayers));
+
 	/*
 		We start by assigning a progressive ID to each vertex...
 	*/
 
-	struct nclusters_t *vertices=nclusters_init(nclusters->lx,nclusters->ly,nclusters->nrlayers);
-	assert(vertices!=NULL);
+	struct nclusters_t *vertices=jws->vertices;
 
 	int bins[MAX_NR_OF_LAYERS]={0};
 
@@ -523,7 +725,10 @@ int ncluster_evaluate_jumps(struct nclusters_t *nclusters,int id,int spanning,bo
 		...and then we create and populate the adjacency matrix.
 	*/
 
-	struct adjacency_t *adj=init_adjacency(nr_vertices);
+	struct adjacency_t *adj=jws->adj;
+	reset_adjacency(adj,nr_vertices);
+
+	INSTR_COUNT(vertices,nr_vertices);
 
 	for(int x=0;x<nclusters->lx;x++)
 		for(int y=0;y<nclusters->ly;y++)
@@ -544,15 +749,14 @@ int ncluster_evaluate_jumps(struct nclusters_t *nclusters,int id,int spanning,bo
 	fill_ns_bins(nclusters->nrlayers,bins,ns);
 
 	/*
-		Finally, we free the vertices structure along with graph adjacency matrix
+		Finally, we free the workspace, unless it belongs to the lattice,
 		and we return the number of jumps.
 	*/
 
-	if(vertices)
-		nclusters_fini(vertices);
+	if(jws!=nclusters->jws)
+		jumps_workspace_fini(jws);
 
-	if(adj)
-		fini_adjacency(adj);
+	INSTR_STOP(INSTR_JUMPS,t0);
 
 	return jumps;
 }
@@ -2,9 +2,17 @@
 #define __JUMPS_H__
 
 #include <stdbool.h>
+#include <stddef.h>
 
 #include "clusters.h"
 
+struct jumps_workspace_t *jumps_workspace_init(int x,int y,int nrlayers);
+struct jumps_workspace_t *jumps_workspace_init_in(struct arena_t *arena,int x,int y,int nrlayers);
+void jumps_workspace_fini(struct jumps_workspace_t *jws);
+void jumps_workspace_touch(struct jumps_workspace_t *jws);
+void jumps_workspace_estimate(struct arena_estimate_t *estimate,int x,int y,int nrlayers);
+size_t jumps_graph_max_bytes(int x,int y,int nrlayers);
+
 int ncluster_evaluate_jumps(struct nclusters_t *nclusters,int id,int spanning,bool pbcz,int *pbins,int *ns);
 
 #endif //__JUMPS_H__
@@ -0,0 +1,363 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "evlog.h"
+
+/*
+	A reader for the event logs written by evlog.c: the file is memory-mapped,
+	the runs are grouped by point, and either the averages (the same columns
+	as the main output file, plus the number of runs), their bootstrap errors,
+	or the histogram of one of the fields are printed.
+
+	Usage: mllog [--bootstrap <n> | --histogram <field> | --info] <file.events>
+*/
+
+/*
+	The spanning flags, as in simulation.h.
+*/
+
+#define TWO_LAYER_PERCOLATION		(1)
+#define SINGLE_LAYER_PERCOLATION	(2)
+
+#define MODE_SUMMARY		(0)
+#define MODE_BOOTSTRAP		(1)
+#define MODE_HISTOGRAM		(2)
+#define MODE_INFO		(3)
+
+struct evlog_file_t
+{
+	const char *base;
+	size_t size;
+
+	const struct evlog_header_t *header;
+	size_t nr_records;
+};
+
+static const struct evlog_record_t *get_record(struct evlog_file_t *file,size_t index)
+{
+	return (const struct evlog_record_t *)(file->base+sizeof(struct evlog_header_t)+index*file->header->record_size);
+}
+
+static const int32_t *get_by_layer(const struct evlog_record_t *record)
+{
+	return (const int32_t *)(record+1);
+}
+
+/*
+	Sorting the runs by point, with pperp varying more slowly, as in the output files.
+*/
+
+static struct evlog_file_t *sorting_file;
+
+static int compare_records(const void *a,const void *b)
+{
+	const struct evlog_record_t *r1=get_record(sorting_file,*((const size_t *)(a)));
+	const struct evlog_record_t *r2=get_record(sorting_file,*((const size_t *)(b)));
+
+	if(r1->pperp!=r2->pperp)
+		return (r1->pperp<r2->pperp)?(-1):(1);
+
+	if(r1->p!=r2->p)
+		return (r1->p<r2->p)?(-1):(1);
+
+	return 0;
+}
+
+static int compare_ints(const void *a,const void *b)
+{
+	int32_t x=*((const int32_t *)(a));
+	int32_t y=*((const int32_t *)(b));
+
+	return (x>y)-(x<y);
+}
+
+/*
+	xorshift64*, for the bootstrap.
+*/
+
+static uint64_t rng_state=UINT64_C(0x9e3779b97f4a7c15);
+
+static uint64_t rng_next(void)
+{
+	rng_state^=rng_state>>12;
+	rng_state^=rng_state<<25;
+	rng_state^=rng_state>>27;
+
+	return rng_state*UINT64_C(2685821657736338717);
+}
+
+static void print_summary(struct evlog_file_t *file,size_t *indices,size_t n)
+{
+	int nrlayers=file->header->nrlayers;
+	const struct evlog_record_t *first=get_record(file,indices[0]);
+
+	double bilayer=0.0,single=0.0,jumps=0.0,matches1=0.0,matches2=0.0,perc1=0.0,perc2=0.0;
+	double *by_layer=calloc(2*nrlayers,sizeof(double));
+
+	for(size_t c=0;c<n;c++)
+	{
+		const struct evlog_record_t *record=get_record(file,indices[c]);
+		const int32_t *ip=get_by_layer(record);
+
+		bilayer+=(record->flags&TWO_LAYER_PERCOLATION)?(1.0):(0.0);
+		single+=(record->flags&SINGLE_LAYER_PERCOLATION)?(1.0):(0.0);
+		jumps+=record->jumps;
+		matches1+=record->matches1;
+		matches2+=record->matches2;
+		perc1+=record->nr_percolating1;
+		perc2+=record->nr_percolating2;
+
+		for(int z=0;z<2*nrlayers;z++)
+			by_layer[z]+=ip[z];
+	}
+
+	printf("%f %f ",first->p,first->pperp);
+	printf("%f %f %f %f %f %f %f ",bilayer/n,single/n,jumps/n,matches1/n,matches2/n,perc1/n,perc2/n);
+
+	for(int z=0;z<2*nrlayers;z++)
+		printf("%f ",by_layer[z]/n);
+
+	printf("%zu\n",n);
+
+	free(by_layer);
+}
+
+static void print_bootstrap(struct evlog_file_t *file,size_t *indices,size_t n,int nr_resamplings)
+{
+	const struct evlog_record_t *first=get_record(file,indices[0]);
+
+	double mean[3]={0.0,0.0,0.0},sum[3]={0.0,0.0,0.0},sum_sq[3]={0.0,0.0,0.0};
+
+	for(size_t c=0;c<n;c++)
+	{
+		const struct evlog_record_t *record=get_record(file,indices[c]);
+
+		mean[0]+=(record->flags&TWO_LAYER_PERCOLATION)?(1.0):(0.0);
+		mean[1]+=(record->flags&SINGLE_LAYER_PERCOLATION)?(1.0):(0.0);
+		mean[2]+=record->jumps;
+	}
+
+	for(int b=0;b<nr_resamplings;b++)
+	{
+		double x[3]={0.0,0.0,0.0};
+
+		for(size_t c=0;c<n;c++)
+		{
+			const struct evlog_record_t *record=get_record(file,indices[rng_next()%n]);
+
+			x[0]+=(record->flags&TWO_LAYER_PERCOLATION)?(1.0):(0.0);
+			x[1]+=(record->flags&SINGLE_LAYER_PERCOLATION)?(1.0):(0.0);
+			x[2]+=record->jumps;
+		}
+
+		for(int d=0;d<3;d++)
+		{
+			sum[d]+=x[d]/n;
+			sum_sq[d]+=(x[d]/n)*(x[d]/n);
+		}
+	}
+
+	printf("%f %f %zu ",first->p,first->pperp,n);
+
+	for(int d=0;d<3;d++)
+	{
+		double avg=sum[d]/nr_resamplings;
+		double variance=sum_sq[d]/nr_resamplings-avg*avg;
+
+		printf("%f %f ",mean[d]/n,sqrt(fmax(variance,0.0)));
+	}
+
+	printf("\n");
+}
+
+static int32_t get_field(const struct evlog_record_t *record,const char *field)
+{
+	if(strcmp(field,"jumps")==0)
+		return record->jumps;
+	else if(strcmp(field,"bonds")==0)
+		return record->bonds;
+	else if(strcmp(field,"vbonds")==0)
+		return record->vbonds;
+	else if(strcmp(field,"nr_percolating1")==0)
+		return record->nr_percolating1;
+	else if(strcmp(field,"nr_percolating2")==0)
+		return record->nr_percolating2;
+	else if(strcmp(field,"bin")==0)
+		return record->bin;
+
+	return record->flags;
+}
+
+static void print_histogram(struct evlog_file_t *file,size_t *indices,size_t n,const char *field)
+{
+	const struct evlog_record_t *first=get_record(file,indices[0]);
+	int32_t *values=malloc(sizeof(int32_t)*n);
+
+	if(!values)
+		return;
+
+	for(size_t c=0;c<n;c++)
+		values[c]=get_field(get_record(file,indices[c]),field);
+
+	qsort(values,n,sizeof(int32_t),compare_ints);
+
+	for(size_t c=0;c<n;)
+	{
+		size_t d=c;
+
+		while((d<n)&&(values[d]==values[c]))
+			d++;
+
+		printf("%f %f %d %zu\n",first->p,first->pperp,values[c],d-c);
+		c=d;
+	}
+
+	printf("\n");
+
+	free(values);
+}
+
+static bool valid_field(const char *field)
+{
+	const char *fields[]={"flags","jumps","bonds","vbonds","nr_percolating1","nr_percolating2","bin",NULL};
+
+	for(int c=0;fields[c]!=NULL;c++)
+		if(strcmp(field,fields[c])==0)
+			return true;
+
+	return false;
+}
+
+static void usage(const char *argv0)
+{
+	fprintf(stderr,"Usage: %s [--bootstrap <n> | --histogram <field> | --info] <file.events>\n",argv0);
+	fprintf(stderr,"The fields are: flags, jumps, bonds, vbonds, nr_percolating1, nr_percolating2, bin\n");
+}
+
+int main(int argc,char *argv[])
+{
+	int mode=MODE_SUMMARY,nr_resamplings=0;
+	const char *field=NULL,*filename=NULL;
+
+	for(int c=1;c<argc;c++)
+	{
+		if((strcmp(argv[c],"--bootstrap")==0)&&(c+1<argc))
+		{
+			mode=MODE_BOOTSTRAP;
+			nr_resamplings=atoi(argv[++c]);
+		}
+		else if((strcmp(argv[c],"--histogram")==0)&&(c+1<argc))
+		{
+			mode=MODE_HISTOGRAM;
+			field=argv[++c];
+		}
+		else if(strcmp(argv[c],"--info")==0)
+		{
+			mode=MODE_INFO;
+		}
+		else
+		{
+			filename=argv[c];
+		}
+	}
+
+	if((filename==NULL)||((mode==MODE_BOOTSTRAP)&&(nr_resamplings<1))||((mode==MODE_HISTOGRAM)&&(valid_field(field)==false)))
+	{
+		usage(argv[0]);
+		return 1;
+	}
+
+	int fd=open(filename,O_RDONLY);
+	struct stat st;
+
+	if((fd<0)||(fstat(fd,&st)!=0)||(((size_t)(st.st_size))<sizeof(struct evlog_header_t)))
+	{
+		fprintf(stderr,"Couldn't read %s\n",filename);
+		return 1;
+	}
+
+	struct evlog_file_t file;
+
+	file.size=st.st_size;
+	file.base=mmap(NULL,file.size,PROT_READ,MAP_PRIVATE,fd,0);
+	close(fd);
+
+	if(file.base==MAP_FAILED)
+	{
+		fprintf(stderr,"Couldn't map %s\n",filename);
+		return 1;
+	}
+
+	file.header=(const struct evlog_header_t *)(file.base);
+
+	if((memcmp(file.header->magic,EVLOG_MAGIC,8)!=0)||(file.header->nrlayers<1)||
+	   (((size_t)(file.header->record_size))!=EVLOG_RECORD_SIZE(file.header->nrlayers)))
+	{
+		fprintf(stderr,"%s is not an event log\n",filename);
+		return 1;
+	}
+
+	file.nr_records=(file.size-sizeof(struct evlog_header_t))/file.header->record_size;
+
+	if(mode==MODE_INFO)
+	{
+		printf("Lattice: %dx%d, %d layers, pbcz=%d, jumps=%d, engine=%d\n",file.header->xdim,file.header->ydim,
+			file.header->nrlayers,file.header->pbcz,file.header->measure_jumps,file.header->engine);
+		printf("Records: %zu, of %d bytes\n",file.nr_records,file.header->record_size);
+	}
+
+	size_t *indices=malloc(sizeof(size_t)*(file.nr_records+1));
+
+	if(!indices)
+		return 1;
+
+	for(size_t c=0;c<file.nr_records;c++)
+		indices[c]=c;
+
+	sorting_file=&file;
+	qsort(indices,file.nr_records,sizeof(size_t),compare_records);
+
+	size_t nr_points=0;
+
+	for(size_t c=0;c<file.nr_records;)
+	{
+		size_t d=c+1;
+
+		while((d<file.nr_records)&&(compare_records(&indices[c],&indices[d])==0))
+			d++;
+
+		switch(mode)
+		{
+			case MODE_SUMMARY:
+			print_summary(&file,&indices[c],d-c);
+			break;
+
+			case MODE_BOOTSTRAP:
+			print_bootstrap(&file,&indices[c],d-c,nr_resamplings);
+			break;
+
+			case MODE_HISTOGRAM:
+			print_histogram(&file,&indices[c],d-c,field);
+			break;
+		}
+
+		nr_points++;
+		c=d;
+	}
+
+	if(mode==MODE_INFO)
+		printf("Points: %zu\n",nr_points);
+
+	free(indices);
+	munmap((void *)(file.base),file.size);
+
+	return 0;
+}
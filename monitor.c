@@ -0,0 +1,553 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <curses.h>
+
+#include "common.h"
+#include "simulation.h"
+#include "monitor.h"
+
+/*
+	Progress reporting, for long campaigns.
+
+	Every worker acquires a slot when it starts, and publishes there each run
+	it completes: where it is, how many runs it has done, how long they took
+	and, in instrumented builds, how the time was split among the phases. The
+	slots are only written by their owners and read by the monitor thread,
+	so there is no locking at all on the side of the workers.
+
+	Once per second the monitor thread takes a snapshot of all the slots, and
+	computes the throughput, overall and per worker, and the estimated time
+	to completion, from the runs planned by the executors, see monitor_plan().
+	The snapshot is shown on an ncurses dashboard, on the terminal of stderr,
+	and every 'interval' seconds it is written as a JSON object to the status
+	file, which is replaced atomically, so that it can be polled by other tools.
+
+	The counters of a slot are never reset: a worker released by an executor
+	leaves them there, and they keep adding up when the slot is reused.
+*/
+
+#define MONITOR_TICK		(1.0)
+#define MONITOR_SMOOTHING	(0.3)
+
+static const char *phase_names[INSTR_NR_PHASES]={"generate","label1","clear","label2","jumps"};
+
+struct monitor_snapshot_t
+{
+	double time;
+	long runs;
+	double busy;
+	uint64_t ticks[INSTR_NR_PHASES];
+
+	long slot_runs[MONITOR_MAX_SLOTS];
+	double slot_busy[MONITOR_MAX_SLOTS];
+};
+
+static struct
+{
+	bool running,quit;
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+
+	bool dashboard;
+	SCREEN *screen;
+
+	char *status_file;
+	double interval,last_status;
+
+	double start;
+	atomic_long planned;
+	atomic_int nr_slots;
+
+	/*
+		Only used by the monitor thread.
+	*/
+
+	struct monitor_snapshot_t previous,current;
+	double rate;
+
+	struct monitor_slot_t slots[MONITOR_MAX_SLOTS];
+} monitor;
+
+static long monitor_rss(void)
+{
+	FILE *in=fopen("/proc/self/statm","r");
+	long size,resident;
+
+	if(!in)
+		return -1;
+
+	if(fscanf(in,"%ld %ld",&size,&resident)!=2)
+		resident=-1;
+
+	fclose(in);
+
+	return (resident>=0)?(resident*sysconf(_SC_PAGESIZE)):(-1);
+}
+
+static void monitor_snapshot(struct monitor_snapshot_t *snapshot)
+{
+	int nr_slots=atomic_load_explicit(&monitor.nr_slots,memory_order_acquire);
+
+	snapshot->time=get_time();
+	snapshot->runs=0;
+	snapshot->busy=0.0;
+
+	for(int c=0;c<INSTR_NR_PHASES;c++)
+		snapshot->ticks[c]=0;
+
+	for(int c=0;c<nr_slots;c++)
+	{
+		struct monitor_slot_t *slot=&monitor.slots[c];
+
+		snapshot->slot_runs[c]=atomic_load_explicit(&slot->runs,memory_order_relaxed);
+		snapshot->slot_busy[c]=atomic_load_explicit(&slot->busy,memory_order_relaxed);
+		snapshot->runs+=snapshot->slot_runs[c];
+		snapshot->busy+=snapshot->slot_busy[c];
+
+#ifdef ML_INSTRUMENT
+		for(int d=0;d<INSTR_NR_PHASES;d++)
+			snapshot->ticks[d]+=atomic_load_explicit(&slot->ticks[d],memory_order_relaxed);
+#endif
+	}
+
+	for(int c=nr_slots;c<MONITOR_MAX_SLOTS;c++)
+	{
+		snapshot->slot_runs[c]=0;
+		snapshot->slot_busy[c]=0.0;
+	}
+}
+
+/*
+	The share of each phase over the last tick, false if unknown.
+*/
+
+static bool monitor_phase_shares(double shares[INSTR_NR_PHASES])
+{
+	double total=0.0;
+
+	for(int c=0;c<INSTR_NR_PHASES;c++)
+	{
+		shares[c]=monitor.current.ticks[c]-monitor.previous.ticks[c];
+
+		/*
+			The jumps are counted within the first labeling pass.
+		*/
+
+		if(c==INSTR_LABEL1)
+			shares[c]-=monitor.current.ticks[INSTR_JUMPS]-monitor.previous.ticks[INSTR_JUMPS];
+
+		shares[c]=MAX(shares[c],0.0);
+		total+=shares[c];
+	}
+
+	if(total<=0.0)
+		return false;
+
+	for(int c=0;c<INSTR_NR_PHASES;c++)
+		shares[c]/=total;
+
+	return true;
+}
+
+static double monitor_eta(void)
+{
+	long left=atomic_load_explicit(&monitor.planned,memory_order_relaxed)-monitor.current.runs;
+
+	if(monitor.rate<=0.0)
+		return -1.0;
+
+	return MAX(left,0)/monitor.rate;
+}
+
+static void format_duration(char *buffer,size_t size,double seconds)
+{
+	if(seconds<0.0)
+	{
+		snprintf(buffer,size,"--:--:--");
+		return;
+	}
+
+	long s=(long)(seconds);
+
+	snprintf(buffer,size,"%02ld:%02ld:%02ld",s/3600,(s/60)%60,s%60);
+}
+
+static void monitor_draw(void)
+{
+	double dt=monitor.current.time-monitor.previous.time;
+	long planned=atomic_load_explicit(&monitor.planned,memory_order_relaxed);
+	char elapsed[32],eta[32];
+
+	format_duration(elapsed,32,monitor.current.time-monitor.start);
+	format_duration(eta,32,monitor_eta());
+
+	erase();
+
+	mvprintw(0,0,"multilayer   elapsed %s   ETA %s",elapsed,eta);
+	mvprintw(1,0,"runs %ld / %ld (%.1f%%)   %.1f samples/s   %.1f samples/s overall",monitor.current.runs,planned,
+	         (planned>0)?(100.0*monitor.current.runs/planned):(0.0),monitor.rate,
+	         monitor.current.runs/MAX(monitor.current.time-monitor.start,1e-9));
+	mvprintw(2,0,"resident memory %.1f MB",monitor_rss()/(1024.0*1024.0));
+
+	double shares[INSTR_NR_PHASES];
+
+	if(monitor_phase_shares(shares)==true)
+	{
+		move(3,0);
+		printw("phases");
+
+		for(int c=0;c<INSTR_NR_PHASES;c++)
+			printw("   %s %.1f%%",phase_names[c],100.0*shares[c]);
+	}
+	else
+	{
+		mvprintw(3,0,"phases: not measured, build with ML_INSTRUMENT");
+	}
+
+	mvprintw(5,0,"%6s %10s %10s %10s %12s %7s %12s","worker","p","pperp","runs","samples/s","busy","memory");
+
+	int nr_slots=atomic_load_explicit(&monitor.nr_slots,memory_order_acquire);
+	int row=6;
+
+	for(int c=0;(c<nr_slots)&&(row<LINES-1);c++)
+	{
+		struct monitor_slot_t *slot=&monitor.slots[c];
+
+		if(atomic_load_explicit(&slot->active,memory_order_relaxed)==false)
+			continue;
+
+		double runs=monitor.current.slot_runs[c]-monitor.previous.slot_runs[c];
+		double busy=monitor.current.slot_busy[c]-monitor.previous.slot_busy[c];
+
+		mvprintw(row++,0,"%6d %10.4f %10.4f %10ld %12.1f %6.1f%% %9.1f MB",c,
+		         atomic_load_explicit(&slot->p,memory_order_relaxed),
+		         atomic_load_explicit(&slot->pperp,memory_order_relaxed),
+		         monitor.current.slot_runs[c],runs/dt,100.0*MIN(busy/dt,1.0),
+		         atomic_load_explicit(&slot->memory,memory_order_relaxed)/(1024.0*1024.0));
+	}
+
+	/*
+		Anything else printed on the terminal is wiped at the next redraw.
+	*/
+
+	clearok(stdscr,TRUE);
+	refresh();
+}
+
+static void monitor_write_status(void)
+{
+	char tmpfile[1024];
+
+	snprintf(tmpfile,1024,"%s.tmp",monitor.status_file);
+
+	FILE *out=fopen(tmpfile,"w");
+
+	if(!out)
+	{
+		fprintf(stderr,"Warning: couldn't write the status file %s\n",tmpfile);
+		return;
+	}
+
+	double now=monitor.current.time;
+	double dt=now-monitor.previous.time;
+	double shares[INSTR_NR_PHASES];
+
+	fprintf(out,"{\n");
+	fprintf(out,"\t\"time\": %ld,\n",(long)(time(NULL)));
+	fprintf(out,"\t\"elapsed\": %.3f,\n",now-monitor.start);
+	fprintf(out,"\t\"runs_done\": %ld,\n",monitor.current.runs);
+	fprintf(out,"\t\"runs_planned\": %ld,\n",atomic_load_explicit(&monitor.planned,memory_order_relaxed));
+	fprintf(out,"\t\"samples_per_s\": %.3f,\n",monitor.rate);
+	fprintf(out,"\t\"samples_per_s_overall\": %.3f,\n",monitor.current.runs/MAX(now-monitor.start,1e-9));
+	fprintf(out,"\t\"eta\": %.1f,\n",monitor_eta());
+	fprintf(out,"\t\"resident_bytes\": %ld,\n",monitor_rss());
+
+	if(monitor_phase_shares(shares)==true)
+	{
+		fprintf(out,"\t\"phase_share\": {");
+
+		for(int c=0;c<INSTR_NR_PHASES;c++)
+			fprintf(out,"%s\"%s\": %.4f",(c>0)?(", "):(""),phase_names[c],shares[c]);
+
+		fprintf(out,"},\n");
+	}
+	else
+	{
+		fprintf(out,"\t\"phase_share\": null,\n");
+	}
+
+	fprintf(out,"\t\"workers\": [");
+
+	int nr_slots=atomic_load_explicit(&monitor.nr_slots,memory_order_acquire);
+	bool first=true;
+
+	for(int c=0;c<nr_slots;c++)
+	{
+		struct monitor_slot_t *slot=&monitor.slots[c];
+
+		if(atomic_load_explicit(&slot->active,memory_order_relaxed)==false)
+			continue;
+
+		double runs=monitor.current.slot_runs[c]-monitor.previous.slot_runs[c];
+		double busy=monitor.current.slot_busy[c]-monitor.previous.slot_busy[c];
+
+		fprintf(out,"%s\n\t\t{\"index\": %d, \"p\": %f, \"pperp\": %f, \"runs\": %ld, \"samples_per_s\": %.3f, \"busy\": %.4f, \"memory_bytes\": %zu}",
+		        (first==true)?(""):(","),c,
+		        atomic_load_explicit(&slot->p,memory_order_relaxed),
+		        atomic_load_explicit(&slot->pperp,memory_order_relaxed),
+		        monitor.current.slot_runs[c],runs/dt,MIN(busy/dt,1.0),
+		        atomic_load_explicit(&slot->memory,memory_order_relaxed));
+
+		first=false;
+	}
+
+	fprintf(out,"\n\t]\n}\n");
+
+	if((fclose(out)!=0)||(rename(tmpfile,monitor.status_file)!=0))
+		fprintf(stderr,"Warning: couldn't write the status file %s\n",monitor.status_file);
+}
+
+static void monitor_update(bool last)
+{
+	monitor_snapshot(&monitor.current);
+
+	double dt=monitor.current.time-monitor.previous.time;
+
+	if(dt<=0.0)
+		return;
+
+	double rate=(monitor.current.runs-monitor.previous.runs)/dt;
+
+	if(monitor.rate<=0.0)
+		monitor.rate=rate;
+	else
+		monitor.rate=MONITOR_SMOOTHING*rate+(1.0-MONITOR_SMOOTHING)*monitor.rate;
+
+	if(monitor.dashboard==true)
+		monitor_draw();
+
+	if((monitor.status_file!=NULL)&&((last==true)||(monitor.current.time-monitor.last_status>=monitor.interval)))
+	{
+		monitor_write_status();
+		monitor.last_status=monitor.current.time;
+	}
+
+	monitor.previous=monitor.current;
+}
+
+static void *monitor_thread(void *arg)
+{
+	(void)(arg);
+
+	pthread_mutex_lock(&monitor.mutex);
+
+	while(monitor.quit==false)
+	{
+		struct timespec deadline;
+
+		clock_gettime(CLOCK_REALTIME,&deadline);
+		deadline.tv_sec+=(time_t)(MONITOR_TICK);
+
+		pthread_cond_timedwait(&monitor.cond,&monitor.mutex,&deadline);
+
+		if(monitor.quit==true)
+			break;
+
+		pthread_mutex_unlock(&monitor.mutex);
+		monitor_update(false);
+		pthread_mutex_lock(&monitor.mutex);
+	}
+
+	pthread_mutex_unlock(&monitor.mutex);
+
+	monitor_update(true);
+
+	return NULL;
+}
+
+/*
+	Starts the monitor, with the dashboard on the terminal, if stderr is one,
+	and/or the status file, rewritten every 'interval' seconds. Returns false
+	if there is nothing to do.
+*/
+
+bool monitor_start(bool dashboard,const char *status_file,double interval)
+{
+	assert(monitor.running==false);
+
+	if((dashboard==true)&&(isatty(fileno(stderr))==0))
+	{
+		fprintf(stderr,"Warning: the dashboard needs a terminal, not showing it.\n");
+		dashboard=false;
+	}
+
+	if((dashboard==false)&&(status_file==NULL))
+		return false;
+
+	monitor.quit=false;
+	monitor.dashboard=dashboard;
+	monitor.screen=NULL;
+	monitor.status_file=(status_file!=NULL)?(strdup(status_file)):(NULL);
+	monitor.interval=MAX(interval,MONITOR_TICK);
+	monitor.start=monitor.last_status=get_time();
+	monitor.rate=0.0;
+
+	atomic_store(&monitor.planned,0);
+	atomic_store(&monitor.nr_slots,0);
+
+	for(int c=0;c<MONITOR_MAX_SLOTS;c++)
+		atomic_store(&monitor.slots[c].active,false);
+
+	monitor_snapshot(&monitor.previous);
+
+	if(monitor.dashboard==true)
+	{
+		if((monitor.screen=newterm(NULL,stderr,stdin))==NULL)
+		{
+			fprintf(stderr,"Warning: couldn't initialize the terminal, not showing the dashboard.\n");
+			monitor.dashboard=false;
+		}
+		else
+		{
+			curs_set(0);
+		}
+	}
+
+	pthread_mutex_init(&monitor.mutex,NULL);
+	pthread_cond_init(&monitor.cond,NULL);
+	pthread_create(&monitor.thread,NULL,monitor_thread,NULL);
+
+	monitor.running=true;
+
+	return true;
+}
+
+void monitor_stop(void)
+{
+	if(monitor.running==false)
+		return;
+
+	pthread_mutex_lock(&monitor.mutex);
+	monitor.quit=true;
+	pthread_cond_signal(&monitor.cond);
+	pthread_mutex_unlock(&monitor.mutex);
+
+	pthread_join(monitor.thread,NULL);
+
+	if(monitor.screen!=NULL)
+	{
+		endwin();
+		delscreen(monitor.screen);
+		monitor.screen=NULL;
+	}
+
+	pthread_mutex_destroy(&monitor.mutex);
+	pthread_cond_destroy(&monitor.cond);
+
+	if(monitor.status_file)
+		free(monitor.status_file);
+
+	monitor.status_file=NULL;
+	monitor.running=false;
+}
+
+/*
+	A free slot for a worker, or NULL if the monitor is not running.
+*/
+
+struct monitor_slot_t *monitor_acquire(void)
+{
+	if(monitor.running==false)
+		return NULL;
+
+	for(int c=0;c<MONITOR_MAX_SLOTS;c++)
+	{
+		struct monitor_slot_t *slot=&monitor.slots[c];
+		bool expected=false;
+
+		if(atomic_compare_exchange_strong(&slot->active,&expected,true)==false)
+			continue;
+
+		if(c>=atomic_load(&monitor.nr_slots))
+		{
+			atomic_store_explicit(&slot->p,0.0,memory_order_relaxed);
+			atomic_store_explicit(&slot->pperp,0.0,memory_order_relaxed);
+			atomic_store_explicit(&slot->runs,0,memory_order_relaxed);
+			atomic_store_explicit(&slot->busy,0.0,memory_order_relaxed);
+
+#ifdef ML_INSTRUMENT
+			for(int d=0;d<INSTR_NR_PHASES;d++)
+				atomic_store_explicit(&slot->ticks[d],0,memory_order_relaxed);
+#endif
+
+			/*
+				The slots in use are always the first ones.
+			*/
+
+			int nr_slots=atomic_load(&monitor.nr_slots);
+
+			while((nr_slots<c+1)&&(atomic_compare_exchange_weak(&monitor.nr_slots,&nr_slots,c+1)==false));
+		}
+
+		atomic_store_explicit(&slot->memory,0,memory_order_relaxed);
+
+		return slot;
+	}
+
+	return NULL;
+}
+
+/*
+	The memory used by the simulation context of the worker.
+*/
+
+void monitor_set_memory(struct monitor_slot_t *slot,size_t memory)
+{
+	if(slot!=NULL)
+		atomic_store_explicit(&slot->memory,memory,memory_order_relaxed);
+}
+
+void monitor_release(struct monitor_slot_t *slot)
+{
+	if(slot!=NULL)
+		atomic_store_explicit(&slot->active,false,memory_order_release);
+}
+
+/*
+	Called by the executors, with the number of runs they are about to do.
+*/
+
+void monitor_plan(long runs)
+{
+	if(monitor.running==true)
+		atomic_fetch_add_explicit(&monitor.planned,runs,memory_order_relaxed);
+}
+
+void monitor_run_done(struct monitor_slot_t *slot,double p,double pperp,struct statistics_t *stats,double seconds)
+{
+	(void)(stats);
+
+	atomic_store_explicit(&slot->p,p,memory_order_relaxed);
+	atomic_store_explicit(&slot->pperp,pperp,memory_order_relaxed);
+	atomic_store_explicit(&slot->runs,atomic_load_explicit(&slot->runs,memory_order_relaxed)+1,memory_order_relaxed);
+	atomic_store_explicit(&slot->busy,atomic_load_explicit(&slot->busy,memory_order_relaxed)+seconds,memory_order_relaxed);
+
+#ifdef ML_INSTRUMENT
+	for(int c=0;c<INSTR_NR_PHASES;c++)
+	{
+		uint64_t ticks=atomic_load_explicit(&slot->ticks[c],memory_order_relaxed);
+
+		atomic_store_explicit(&slot->ticks[c],ticks+stats->instr.phases[c].ticks,memory_order_relaxed);
+	}
+#endif
+}
@@ -0,0 +1,51 @@
+#ifndef __MONITOR_H__
+#define __MONITOR_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "clusters.h"
+#include "affinity.h"
+#include "instrument.h"
+
+/*
+	Live progress reporting, see monitor.c: a thread samples the counters
+	published by the workers, and shows them on an ncurses dashboard, and/or
+	rewrites a JSON status file.
+*/
+
+#define MONITOR_MAX_SLOTS	(256)
+
+/*
+	The counters of a worker. Each slot has a single writer, the worker that
+	acquired it, and is read by the monitor thread: all the fields are atomic,
+	and only accessed with relaxed loads and stores, so publishing a run costs
+	a few plain stores to a cache line that the worker owns.
+*/
+
+struct monitor_slot_t
+{
+	_Alignas(CACHE_LINE_SIZE) atomic_bool active;
+
+	_Atomic double p,pperp;
+	_Atomic long runs;
+	_Atomic double busy;
+	_Atomic size_t memory;
+
+#ifdef ML_INSTRUMENT
+	_Atomic uint64_t ticks[INSTR_NR_PHASES];
+#endif
+};
+
+bool monitor_start(bool dashboard,const char *status_file,double interval);
+void monitor_stop(void);
+
+struct monitor_slot_t *monitor_acquire(void);
+void monitor_set_memory(struct monitor_slot_t *slot,size_t memory);
+void monitor_release(struct monitor_slot_t *slot);
+void monitor_plan(long runs);
+void monitor_run_done(struct monitor_slot_t *slot,double p,double pperp,struct statistics_t *stats,double seconds);
+
+#endif //__MONITOR_H__
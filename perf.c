@@ -0,0 +1,252 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include "perf.h"
+
+/*
+	The counters of each thread form a single group, led by the cycles, so
+	that they are scheduled on the PMU together and read with a single read(2).
+	An event that cannot be opened, e.g. because the hardware or the hypervisor
+	does not expose it, is left out, with perf_event_available() false: its
+	value reads as zero, and the outputs report it as nan, see instrument.c
+	and bench.c. If not even the leader can be opened,
+	perf_enable() fails, and the counters are not used at all.
+
+	A read costs a system call, which is fine to split a run in its phases, but
+	not much finer than that.
+*/
+
+const char *perf_event_names[PERF_NR_EVENTS]=
+{
+	"cycles",
+	"instructions",
+	"cache_misses",
+	"dtlb_misses",
+	"branch_misses"
+};
+
+bool perf_active=false;
+
+/*
+	Which events could be opened by the first thread, perf_enable()'s.
+*/
+
+static bool available[PERF_NR_EVENTS];
+
+struct perf_thread_t
+{
+	bool opened;
+	int fds[PERF_NR_EVENTS];
+
+	/*
+		The position of each event in the group, -1 if missing.
+	*/
+
+	int slots[PERF_NR_EVENTS];
+	int nr_slots;
+};
+
+static _Thread_local struct perf_thread_t perf_thread;
+static pthread_key_t perf_key;
+
+#ifdef __linux__
+
+static int perf_event_open(int event,int group_fd)
+{
+	struct perf_event_attr attr;
+
+	memset(&attr,0,sizeof(struct perf_event_attr));
+	attr.size=sizeof(struct perf_event_attr);
+	attr.disabled=(group_fd==-1)?(1):(0);
+	attr.exclude_kernel=1;
+	attr.exclude_hv=1;
+	attr.read_format=PERF_FORMAT_GROUP;
+
+	switch(event)
+	{
+		case PERF_CYCLES:
+		attr.type=PERF_TYPE_HARDWARE;
+		attr.config=PERF_COUNT_HW_CPU_CYCLES;
+		break;
+
+		case PERF_INSTRUCTIONS:
+		attr.type=PERF_TYPE_HARDWARE;
+		attr.config=PERF_COUNT_HW_INSTRUCTIONS;
+		break;
+
+		case PERF_CACHE_MISSES:
+		attr.type=PERF_TYPE_HARDWARE;
+		attr.config=PERF_COUNT_HW_CACHE_MISSES;
+		break;
+
+		case PERF_DTLB_MISSES:
+		attr.type=PERF_TYPE_HW_CACHE;
+		attr.config=(PERF_COUNT_HW_CACHE_DTLB)|(PERF_COUNT_HW_CACHE_OP_READ<<8)|(PERF_COUNT_HW_CACHE_RESULT_MISS<<16);
+		break;
+
+		case PERF_BRANCH_MISSES:
+		attr.type=PERF_TYPE_HARDWARE;
+		attr.config=PERF_COUNT_HW_BRANCH_MISSES;
+		break;
+
+		default:
+		return -1;
+	}
+
+	return syscall(SYS_perf_event_open,&attr,0,-1,group_fd,0);
+}
+
+#else
+
+static int perf_event_open(int event,int group_fd)
+{
+	(void)(event);
+	(void)(group_fd);
+
+	errno=ENOSYS;
+	return -1;
+}
+
+#endif
+
+static void perf_thread_close(void *arg)
+{
+	struct perf_thread_t *pt=arg;
+
+	for(int c=PERF_NR_EVENTS-1;c>=0;c--)
+	{
+		if(pt->fds[c]>=0)
+			close(pt->fds[c]);
+
+		pt->fds[c]=-1;
+	}
+}
+
+/*
+	Returns false if the leader cannot be opened.
+*/
+
+static bool perf_thread_open(struct perf_thread_t *pt)
+{
+	pt->opened=true;
+	pt->nr_slots=0;
+
+	for(int c=0;c<PERF_NR_EVENTS;c++)
+	{
+		pt->fds[c]=-1;
+		pt->slots[c]=-1;
+	}
+
+	/*
+		The leader comes first, and the other threads only try the events
+		that perf_enable() found.
+	*/
+
+	for(int c=0;c<PERF_NR_EVENTS;c++)
+	{
+		if((c!=PERF_CYCLES)&&(pt->fds[PERF_CYCLES]<0))
+			break;
+
+		if((perf_active==true)&&(available[c]==false))
+			continue;
+
+		if((pt->fds[c]=perf_event_open(c,pt->fds[PERF_CYCLES]))>=0)
+			pt->slots[c]=pt->nr_slots++;
+	}
+
+	if(pt->fds[PERF_CYCLES]<0)
+		return false;
+
+#ifdef __linux__
+	ioctl(pt->fds[PERF_CYCLES],PERF_EVENT_IOC_RESET,PERF_IOC_FLAG_GROUP);
+	ioctl(pt->fds[PERF_CYCLES],PERF_EVENT_IOC_ENABLE,PERF_IOC_FLAG_GROUP);
+#endif
+
+	/*
+		The counters are closed when the thread exits.
+	*/
+
+	pthread_setspecific(perf_key,pt);
+
+	return true;
+}
+
+/*
+	Probes the counters on the calling thread, printing a warning and returning
+	false if they are not available, e.g. when perf_event_paranoid forbids them.
+*/
+
+bool perf_enable(void)
+{
+	if(perf_active==true)
+		return true;
+
+	pthread_key_create(&perf_key,perf_thread_close);
+
+	if(perf_thread_open(&perf_thread)==false)
+	{
+		fprintf(stderr,"Warning: hardware performance counters are not available (%s), not using them.\n",strerror(errno));
+		return false;
+	}
+
+	for(int c=0;c<PERF_NR_EVENTS;c++)
+	{
+		available[c]=(perf_thread.slots[c]>=0);
+
+		if(available[c]==false)
+			fprintf(stderr,"Warning: the '%s' hardware counter is not available, it will be reported as nan.\n",perf_event_names[c]);
+	}
+
+	perf_active=true;
+
+	return true;
+}
+
+bool perf_event_available(int event)
+{
+	return (perf_active==true)&&(event>=0)&&(event<PERF_NR_EVENTS)&&(available[event]==true);
+}
+
+/*
+	The current values of the counters of the calling thread, zero if unavailable.
+*/
+
+void perf_read(uint64_t values[PERF_NR_EVENTS])
+{
+	struct perf_thread_t *pt=&perf_thread;
+	uint64_t buffer[1+PERF_NR_EVENTS];
+
+	for(int c=0;c<PERF_NR_EVENTS;c++)
+		values[c]=0;
+
+	if(perf_active==false)
+		return;
+
+	if((pt->opened==false)&&(perf_thread_open(pt)==false))
+		return;
+
+	if(pt->fds[PERF_CYCLES]<0)
+		return;
+
+	ssize_t size=sizeof(uint64_t)*(1+pt->nr_slots);
+
+	if((read(pt->fds[PERF_CYCLES],buffer,size)!=size)||(buffer[0]!=(uint64_t)(pt->nr_slots)))
+		return;
+
+	for(int c=0;c<PERF_NR_EVENTS;c++)
+		if(pt->slots[c]>=0)
+			values[c]=buffer[1+pt->slots[c]];
+}
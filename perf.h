@@ -0,0 +1,33 @@
+#ifndef __PERF_H__
+#define __PERF_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+	Hardware performance counters, read through perf_event_open(2): every
+	thread gets its own group of counters, opened at its first perf_read(),
+	counting only in user space. See perf.c.
+*/
+
+#define PERF_CYCLES		(0)
+#define PERF_INSTRUCTIONS	(1)
+#define PERF_CACHE_MISSES	(2)
+#define PERF_DTLB_MISSES	(3)
+#define PERF_BRANCH_MISSES	(4)
+#define PERF_NR_EVENTS		(5)
+
+extern const char *perf_event_names[PERF_NR_EVENTS];
+
+/*
+	Set by perf_enable(), to be called before starting the threads: the
+	counters are only read while it is true.
+*/
+
+extern bool perf_active;
+
+bool perf_enable(void);
+bool perf_event_available(int event);
+void perf_read(uint64_t values[PERF_NR_EVENTS]);
+
+#endif //__PERF_H__
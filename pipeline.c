@@ -0,0 +1,505 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <gsl/gsl_rng.h>
+
+#include "common.h"
+#include "clusters.h"
+#include "jumps.h"
+#include "arena.h"
+#include "affinity.h"
+#include "simulation.h"
+#include "pipeline.h"
+#include "evlog.h"
+#include "monitor.h"
+#include "governor.h"
+
+/*
+	Pipelined execution of a batch.
+
+	Generator threads draw the random bonds into lattice buffers, analysis
+	threads identify the clusters. The buffers are allocated once, and they
+	circulate between two bounded rings: the 'free' one, from which the
+	generators take empty buffers, and the 'full' one, from which the
+	analyzers take buffers ready to be labeled.
+*/
+
+struct lattice_buffer_t
+{
+	struct nclusters_t *ncs;
+	int point;
+
+	/*
+		The time spent generating the bonds, so that the analyzer
+		can account for the whole cost of the run.
+	*/
+
+	double generation_time;
+};
+
+/*
+	A bounded ring of buffers, protected by a mutex.
+*/
+
+struct ring_t
+{
+	struct lattice_buffer_t **items;
+	int capacity,head,count;
+
+	/*
+		When closed, no more items will be pushed and pop()
+		returns NULL as soon as the ring is empty.
+	*/
+
+	bool closed;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t not_empty,not_full;
+};
+
+static void ring_init(struct ring_t *ring,int capacity)
+{
+	ring->items=malloc(sizeof(struct lattice_buffer_t *)*capacity);
+	assert(ring->items);
+
+	ring->capacity=capacity;
+	ring->head=ring->count=0;
+	ring->closed=false;
+
+	pthread_mutex_init(&ring->mutex,NULL);
+	pthread_cond_init(&ring->not_empty,NULL);
+	pthread_cond_init(&ring->not_full,NULL);
+}
+
+static void ring_fini(struct ring_t *ring)
+{
+	pthread_mutex_destroy(&ring->mutex);
+	pthread_cond_destroy(&ring->not_empty);
+	pthread_cond_destroy(&ring->not_full);
+
+	if(ring->items)
+		free(ring->items);
+}
+
+static void ring_push(struct ring_t *ring,struct lattice_buffer_t *item)
+{
+	pthread_mutex_lock(&ring->mutex);
+
+	while(ring->count==ring->capacity)
+		pthread_cond_wait(&ring->not_full,&ring->mutex);
+
+	ring->items[(ring->head+ring->count)%ring->capacity]=item;
+	ring->count++;
+
+	pthread_cond_signal(&ring->not_empty);
+	pthread_mutex_unlock(&ring->mutex);
+}
+
+static struct lattice_buffer_t *ring_pop(struct ring_t *ring)
+{
+	struct lattice_buffer_t *ret=NULL;
+
+	pthread_mutex_lock(&ring->mutex);
+
+	while((ring->count==0)&&(ring->closed==false))
+		pthread_cond_wait(&ring->not_empty,&ring->mutex);
+
+	if(ring->count>0)
+	{
+		ret=ring->items[ring->head];
+		ring->head=(ring->head+1)%ring->capacity;
+		ring->count--;
+
+		pthread_cond_signal(&ring->not_full);
+	}
+
+	pthread_mutex_unlock(&ring->mutex);
+
+	return ret;
+}
+
+static void ring_close(struct ring_t *ring)
+{
+	pthread_mutex_lock(&ring->mutex);
+	ring->closed=true;
+	pthread_cond_broadcast(&ring->not_empty);
+	pthread_mutex_unlock(&ring->mutex);
+}
+
+/*
+	The state shared by all the threads in the pipeline.
+*/
+
+struct pipeline_t
+{
+	struct config_t *config;
+	struct point_t *points;
+	int nr_points;
+
+	struct ring_t free_ring,full_ring;
+
+	/*
+		The next run to be generated, i.e. the point and the number of runs
+		already generated for it, and the number of generators still active,
+		all protected by 'jobs_mutex'.
+	*/
+
+	int next_point,next_run;
+	long total_jobs;
+	int active_generators;
+	pthread_mutex_t jobs_mutex;
+
+	/*
+		Partial statistics for each point, protected by 'stats_mutex'.
+
+		Since the runs are generated in order, only a few points are in flight
+		at any time: their statistics are allocated on the first run, and freed
+		as soon as the point is done.
+	*/
+
+	struct statistics_t **totals;
+	int *runs_done;
+	pthread_mutex_t stats_mutex;
+
+	point_done_t point_done;
+	void *data;
+};
+
+struct worker_t
+{
+	struct pipeline_t *pipeline;
+	pthread_t thread;
+	int index;
+
+	/*
+		Time spent doing actual work, as opposed to waiting on a ring.
+	*/
+
+	double busy;
+};
+
+static void *generator_thread(void *arg)
+{
+	struct worker_t *worker=arg;
+	struct pipeline_t *pipeline=worker->pipeline;
+
+	if(pipeline->config->pin_threads==true)
+		affinity_pin_thread(worker->index);
+
+	gsl_rng *rng_ctx=gsl_rng_alloc(gsl_rng_mt19937);
+	assert(rng_ctx!=NULL);
+	seed_rng(rng_ctx);
+
+	while(true)
+	{
+		int job=-1;
+
+		pthread_mutex_lock(&pipeline->jobs_mutex);
+
+		while(pipeline->next_point<pipeline->nr_points)
+		{
+			if(pipeline->next_run<point_nr_runs(pipeline->config,&pipeline->points[pipeline->next_point]))
+			{
+				job=pipeline->next_point;
+				pipeline->next_run++;
+				break;
+			}
+
+			pipeline->next_point++;
+			pipeline->next_run=0;
+		}
+
+		pthread_mutex_unlock(&pipeline->jobs_mutex);
+
+		if(job==-1)
+			break;
+
+		struct lattice_buffer_t *buffer=ring_pop(&pipeline->free_ring);
+		assert(buffer!=NULL);
+
+		double start=get_time();
+
+		buffer->point=job;
+
+		struct point_t *point=&pipeline->points[buffer->point];
+		generate_bonds(pipeline->config,buffer->ncs,point->p,point->pperp,rng_ctx);
+
+		buffer->generation_time=get_time()-start;
+		worker->busy+=buffer->generation_time;
+
+		ring_push(&pipeline->full_ring,buffer);
+	}
+
+	gsl_rng_free(rng_ctx);
+
+	/*
+		The last generator to finish closes the ring, so that the
+		analyzers know when to stop.
+	*/
+
+	pthread_mutex_lock(&pipeline->jobs_mutex);
+
+	if(--pipeline->active_generators==0)
+		ring_close(&pipeline->full_ring);
+
+	pthread_mutex_unlock(&pipeline->jobs_mutex);
+
+	return NULL;
+}
+
+static void *analyzer_thread(void *arg)
+{
+	struct worker_t *worker=arg;
+	struct pipeline_t *pipeline=worker->pipeline;
+
+	if(pipeline->config->pin_threads==true)
+		affinity_pin_thread(worker->index);
+
+	struct config_t *config=pipeline->config;
+
+	gsl_rng *rng_ctx=gsl_rng_alloc(gsl_rng_mt19937);
+	assert(rng_ctx!=NULL);
+	seed_rng(rng_ctx);
+
+	/*
+		The label tables and the scratch memory for jumps belong to the
+		analyzer, and are lent to each buffer while it is being labeled.
+	*/
+
+	struct arena_t *arena=(config->hugepages==true)?(arena_init(true)):(NULL);
+	struct hk_workspace_t *ws=hk_workspace_init_in(arena,config->xdim,config->ydim,config->nrlayers);
+	struct jumps_workspace_t *jws=NULL;
+
+	if(config->measure_jumps==true)
+		jws=jumps_workspace_init_in(arena,config->xdim,config->ydim,config->nrlayers);
+
+	assert(ws&&((config->measure_jumps==false)||(jws!=NULL)));
+
+	if(config->cluster_observables==true)
+	{
+		hk_workspace_enable_moments(ws);
+		assert(ws->moments);
+	}
+
+	struct lattice_buffer_t *buffer;
+
+	struct evlog_buffer_t evlog;
+	evlog_buffer_init(&evlog,config->evlog,false);
+
+	struct monitor_slot_t *monitor=monitor_acquire();
+
+	if(arena!=NULL)
+		monitor_set_memory(monitor,arena_total_bytes(arena));
+
+	while((buffer=ring_pop(&pipeline->full_ring))!=NULL)
+	{
+		double start=get_time();
+
+		struct statistics_t stats;
+		reset_stats(&stats);
+
+		buffer->ncs->ws=ws;
+		buffer->ncs->jws=jws;
+
+		int result=analyze_bonds(config,buffer->ncs,rng_ctx,&stats);
+		count_percolation(&stats,result);
+
+		buffer->ncs->ws=NULL;
+		buffer->ncs->jws=NULL;
+
+		int point=buffer->point;
+
+		evlog_buffer_add(&evlog,pipeline->points[point].p,pipeline->points[point].pperp,result,&stats);
+
+		worker->busy+=get_time()-start;
+		stats.cpu_time=buffer->generation_time+(get_time()-start);
+
+		if(monitor!=NULL)
+			monitor_run_done(monitor,pipeline->points[point].p,pipeline->points[point].pperp,&stats,stats.cpu_time);
+
+		ring_push(&pipeline->free_ring,buffer);
+
+		pthread_mutex_lock(&pipeline->stats_mutex);
+
+		if(pipeline->totals[point]==NULL)
+		{
+			pipeline->totals[point]=malloc(sizeof(struct statistics_t));
+			assert(pipeline->totals[point]);
+			reset_stats(pipeline->totals[point]);
+		}
+
+		add_stats(pipeline->totals[point],&stats);
+
+		if(++pipeline->runs_done[point]==point_nr_runs(config,&pipeline->points[point]))
+		{
+			pipeline->point_done(point,&pipeline->points[point],pipeline->totals[point],pipeline->data);
+
+			free(pipeline->totals[point]);
+			pipeline->totals[point]=NULL;
+		}
+
+		pthread_mutex_unlock(&pipeline->stats_mutex);
+	}
+
+	monitor_release(monitor);
+	evlog_buffer_fini(&evlog);
+	gsl_rng_free(rng_ctx);
+	hk_workspace_fini(ws);
+	jumps_workspace_fini(jws);
+	arena_fini(arena);
+
+	return NULL;
+}
+
+/*
+	By default, one generator is used for every three analyzers, since labeling is
+	considerably more expensive than generation, and there are two buffers per thread.
+*/
+
+static void pipeline_default_sizes(struct config_t *config,int *nr_generators,int *nr_analyzers,int *nr_buffers)
+{
+	int nr_cpus=sysconf(_SC_NPROCESSORS_ONLN);
+
+	if(nr_cpus<2)
+		nr_cpus=2;
+
+	*nr_generators=(config->nr_generators>0)?(config->nr_generators):(MAX(1,nr_cpus/4));
+	*nr_analyzers=(config->nr_analyzers>0)?(config->nr_analyzers):(MAX(1,nr_cpus-(*nr_generators)));
+	*nr_buffers=(config->nr_buffers>0)?(config->nr_buffers):(2*((*nr_generators)+(*nr_analyzers)));
+}
+
+int point_nr_runs(struct config_t *config,struct point_t *point)
+{
+	return (point->runs>0)?(point->runs):(config->total_runs);
+}
+
+void pipeline_run(struct config_t *config,struct point_t *points,int nr_points,point_done_t point_done,void *data)
+{
+	struct pipeline_t pipeline;
+	int nr_generators,nr_analyzers,nr_buffers;
+
+	assert(config->engine==ENGINE_REFERENCE);
+
+	pipeline_default_sizes(config,&nr_generators,&nr_analyzers,&nr_buffers);
+	governor_pipeline(config,&nr_generators,&nr_analyzers,&nr_buffers);
+
+	pipeline.config=config;
+	pipeline.points=points;
+	pipeline.nr_points=nr_points;
+	pipeline.next_point=pipeline.next_run=0;
+	pipeline.total_jobs=0;
+	pipeline.active_generators=nr_generators;
+	pipeline.point_done=point_done;
+	pipeline.data=data;
+
+	pthread_mutex_init(&pipeline.jobs_mutex,NULL);
+	pthread_mutex_init(&pipeline.stats_mutex,NULL);
+
+	pipeline.totals=malloc(sizeof(struct statistics_t *)*nr_points);
+	pipeline.runs_done=malloc(sizeof(int)*nr_points);
+	assert(pipeline.totals&&pipeline.runs_done);
+
+	for(int c=0;c<nr_points;c++)
+	{
+		pipeline.totals[c]=NULL;
+		pipeline.runs_done[c]=0;
+		pipeline.total_jobs+=point_nr_runs(config,&points[c]);
+	}
+
+	monitor_plan(pipeline.total_jobs);
+
+	/*
+		All the buffers are allocated once, and start in the 'free' ring.
+	*/
+
+	ring_init(&pipeline.free_ring,nr_buffers);
+	ring_init(&pipeline.full_ring,nr_buffers);
+
+	struct arena_t *arena=(config->hugepages==true)?(arena_init(true)):(NULL);
+	struct lattice_buffer_t *buffers=malloc(sizeof(struct lattice_buffer_t)*nr_buffers);
+	assert(buffers);
+
+	for(int c=0;c<nr_buffers;c++)
+	{
+		buffers[c].ncs=lattice_init(config,arena);
+		buffers[c].point=-1;
+		buffers[c].generation_time=0.0;
+		ring_push(&pipeline.free_ring,&buffers[c]);
+	}
+
+	struct worker_t *workers=malloc(sizeof(struct worker_t)*(nr_generators+nr_analyzers));
+	assert(workers);
+
+	double start=get_time();
+
+	for(int c=0;c<nr_generators+nr_analyzers;c++)
+	{
+		workers[c].pipeline=&pipeline;
+		workers[c].index=c;
+		workers[c].busy=0.0;
+
+		pthread_create(&workers[c].thread,NULL,(c<nr_generators)?(generator_thread):(analyzer_thread),&workers[c]);
+	}
+
+	for(int c=0;c<nr_generators+nr_analyzers;c++)
+		pthread_join(workers[c].thread,NULL);
+
+	double elapsed=get_time()-start;
+
+	/*
+		Stage utilisation, i.e. the fraction of the wall time the threads in each stage
+		spent working. A stage with low utilisation has too many threads.
+	*/
+
+	double busy_generators=0.0,busy_analyzers=0.0;
+
+	for(int c=0;c<nr_generators;c++)
+		busy_generators+=workers[c].busy;
+
+	for(int c=nr_generators;c<nr_generators+nr_analyzers;c++)
+		busy_analyzers+=workers[c].busy;
+
+	if(elapsed>0.0)
+	{
+		fprintf(stderr,"Pipeline: %d generators (%.1f%% busy), %d analyzers (%.1f%% busy), %d buffers, %.2f runs/s\n",
+			nr_generators,100.0*busy_generators/(elapsed*nr_generators),
+			nr_analyzers,100.0*busy_analyzers/(elapsed*nr_analyzers),
+			nr_buffers,pipeline.total_jobs/elapsed);
+	}
+
+	/*
+		Final cleanup.
+	*/
+
+	for(int c=0;c<nr_buffers;c++)
+		lattice_fini(buffers[c].ncs);
+
+	if(arena)
+	{
+		arena_report(arena,stderr);
+		arena_fini(arena);
+	}
+
+	if(buffers)
+		free(buffers);
+
+	if(workers)
+		free(workers);
+
+	ring_fini(&pipeline.free_ring);
+	ring_fini(&pipeline.full_ring);
+
+	pthread_mutex_destroy(&pipeline.jobs_mutex);
+	pthread_mutex_destroy(&pipeline.stats_mutex);
+
+	if(pipeline.totals)
+		free(pipeline.totals);
+
+	if(pipeline.runs_done)
+		free(pipeline.runs_done);
+}
@@ -0,0 +1,29 @@
+#ifndef __PIPELINE_H__
+#define __PIPELINE_H__
+
+#include "clusters.h"
+#include "simulation.h"
+
+/*
+	A grid point, i.e. a pair of (p, pperp) values, and the number
+	of runs to be performed there, 0 meaning 'total_runs'.
+*/
+
+struct point_t
+{
+	double p,pperp;
+	int runs;
+};
+
+int point_nr_runs(struct config_t *config,struct point_t *point);
+
+/*
+	Called once for each point, when all its runs have been analyzed.
+	Calls are serialized, so there is no need for locking inside.
+*/
+
+typedef void (*point_done_t)(int index,struct point_t *point,struct statistics_t *total,void *data);
+
+void pipeline_run(struct config_t *config,struct point_t *points,int nr_points,point_done_t point_done,void *data);
+
+#endif //__PIPELINE_H__
@@ -0,0 +1,709 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "simulation.h"
+#include "presets.h"
+
+/*
+	The predefined batches: fills in the configuration and the output prefix
+	for the given id, returning false if there is no such batch.
+*/
+
+bool preset(int id,struct config_t *config,const char **prefix)
+{
+	config_defaults(config);
+
+	switch(id)
+	{
+		case 1:
+		config->pbcz=false;
+		config->xdim=config->ydim=512;
+		config->nrlayers=3;
+		*prefix="trilayer512";
+		break;
+
+		case 2:
+		config->pbcz=false;
+		config->xdim=config->ydim=512;
+		config->nrlayers=6;
+		*prefix="esalayer512";
+		break;
+
+		case 3:
+		config->pbcz=false;
+		config->xdim=config->ydim=16;
+		config->nrlayers=2;
+		*prefix="bilayer16";
+		break;
+
+		case 4:
+		config->pbcz=false;
+		config->xdim=config->ydim=32;
+		config->nrlayers=2;
+		*prefix="bilayer32";
+		break;
+
+		case 5:
+		config->pbcz=false;
+		config->xdim=config->ydim=64;
+		config->nrlayers=2;
+		*prefix="bilayer64";
+		break;
+
+		case 6:
+		config->pbcz=false;
+		config->xdim=config->ydim=128;
+		config->nrlayers=2;
+		*prefix="bilayer128";
+		break;
+
+		case 7:
+		config->pbcz=false;
+		config->xdim=config->ydim=256;
+		config->nrlayers=2;
+		*prefix="bilayer256";
+		break;
+
+		case 8:
+		config->pbcz=false;
+		config->xdim=config->ydim=512;
+		config->nrlayers=2;
+		*prefix="bilayer512";
+		break;
+
+		case 9:
+		config->pbcz=false;
+		config->measure_jumps=true;
+		config->total_runs=1000;
+		config->minmillipperp=500;
+		config->maxmillipperp=500;
+		config->xdim=config->ydim=16;
+		config->nrlayers=2;
+		*prefix="jumps16";
+		break;
+
+		case 10:
+		config->pbcz=false;
+		config->measure_jumps=true;
+		config->total_runs=1000;
+		config->minmillipperp=500;
+		config->maxmillipperp=500;
+		config->xdim=config->ydim=32;
+		config->nrlayers=2;
+		*prefix="jumps32";
+		break;
+
+		case 11:
+		config->pbcz=false;
+		config->measure_jumps=true;
+		config->total_runs=1000;
+		config->minmillipperp=500;
+		config->maxmillipperp=500;
+		config->xdim=config->ydim=64;
+		config->nrlayers=2;
+		*prefix="jumps64";
+		break;
+
+		case 12:
+		config->pbcz=false;
+		config->measure_jumps=true;
+		config->total_runs=1000;
+		config->minmillipperp=500;
+		config->maxmillipperp=500;
+		config->xdim=config->ydim=128;
+		config->nrlayers=2;
+		*prefix="jumps128";
+		break;
+
+		case 13:
+		config->pbcz=false;
+		config->measure_jumps=true;
+		config->total_runs=1000;
+		config->minmillipperp=500;
+		config->maxmillipperp=500;
+		config->xdim=config->ydim=256;
+		config->nrlayers=2;
+		*prefix="jumps256";
+		break;
+
+		/*
+			Same, with periodic boundary conditions along z.
+		*/
+
+		case 14:
+		config->pbcz=true;
+		config->xdim=config->ydim=512;
+		config->nrlayers=3;
+		*prefix="trilayer512_pbcz";
+		break;
+
+		case 15:
+		config->pbcz=true;
+		config->xdim=config->ydim=512;
+		config->nrlayers=6;
+		*prefix="esalayer512_pbcz";
+		break;
+
+		case 16:
+		config->pbcz=true;
+		config->xdim=config->ydim=16;
+		config->nrlayers=2;
+		*prefix="bilayer16_pbcz";
+		break;
+
+		case 17:
+		config->pbcz=true;
+		config->xdim=config->ydim=32;
+		config->nrlayers=2;
+		*prefix="bilayer32_pbcz";
+		break;
+
+		case 18:
+		config->pbcz=true;
+		config->xdim=config->ydim=64;
+		config->nrlayers=2;
+		*prefix="bilayer64_pbcz";
+		break;
+
+		case 19:
+		config->pbcz=true;
+		config->xdim=config->ydim=128;
+		config->nrlayers=2;
+		*prefix="bilayer128_pbcz";
+		break;
+
+		case 20:
+		config->pbcz=true;
+		config->xdim=config->ydim=256;
+		config->nrlayers=2;
+		*prefix="bilayer256_pbcz";
+		break;
+
+		case 21:
+		config->pbcz=true;
+		config->xdim=config->ydim=512;
+		config->nrlayers=2;
+		*prefix="bilayer512_pbcz";
+		break;
+
+		case 22:
+		config->pbcz=true;
+		config->measure_jumps=true;
+		config->total_runs=1000;
+		config->minmillipperp=500;
+		config->maxmillipperp=500;
+		config->xdim=config->ydim=16;
+		config->nrlayers=2;
+		*prefix="jumps16_pbcz";
+		break;
+
+		case 23:
+		config->pbcz=true;
+		config->measure_jumps=true;
+		config->total_runs=1000;
+		config->minmillipperp=500;
+		config->maxmillipperp=500;
+		config->xdim=config->ydim=32;
+		config->nrlayers=2;
+		*prefix="jumps32_pbcz";
+		break;
+
+		case 24:
+		config->pbcz=true;
+		config->measure_jumps=true;
+		config->total_runs=1000;
+		config->minmillipperp=500;
+		config->maxmillipperp=500;
+		config->xdim=config->ydim=64;
+		config->nrlayers=2;
+		*prefix="jumps64_pbcz";
+		break;
+
+		case 25:
+		config->pbcz=true;
+		config->measure_jumps=true;
+		config->total_runs=1000;
+		config->minmillipperp=500;
+		config->maxmillipperp=500;
+		config->xdim=config->ydim=128;
+		config->nrlayers=2;
+		*prefix="jumps128_pbcz";
+		break;
+
+		case 26:
+		config->pbcz=true;
+		config->measure_jumps=true;
+		config->total_runs=1000;
+		config->minmillipperp=500;
+		config->maxmillipperp=500;
+		config->xdim=config->ydim=256;
+		config->nrlayers=2;
+		*prefix="jumps256_pbcz";
+		break;
+
+		case 40:
+		config->pbcz=false;
+		config->total_runs=10000;
+		config->minmillipperp=250;
+		config->maxmillipperp=250;
+		config->incmillip=1;
+		config->xdim=config->ydim=512;
+		config->nrlayers=2;
+		*prefix="bilayer512p25";
+		break;
+
+		case 41:
+		config->pbcz=false;
+		config->total_runs=10000;
+		config->minmillipperp=500;
+		config->maxmillipperp=500;
+		config->incmillip=1;
+		config->xdim=config->ydim=512;
+		config->nrlayers=2;
+		*prefix="bilayer512p50";
+		break;
+
+		case 42:
+		config->pbcz=false;
+		config->verbose=true;
+		config->total_runs=10000;
+		config->minmillipperp=750;
+		config->maxmillipperp=750;
+		config->incmillip=1;
+		config->xdim=config->ydim=512;
+		config->nrlayers=2;
+		*prefix="bilayer512p75";
+		break;
+
+		case 43:
+		config->pbcz=true;
+		config->total_runs=20000;
+		config->minmillipperp=250;
+		config->maxmillipperp=250;
+		config->incmillip=1;
+		config->xdim=config->ydim=512;
+		config->nrlayers=2;
+		*prefix="bilayer512p25_pbcz";
+		break;
+
+		case 44:
+		config->pbcz=true;
+		config->total_runs=20000;
+		config->minmillipperp=500;
+		config->maxmillipperp=500;
+		config->incmillip=1;
+		config->xdim=config->ydim=512;
+		config->nrlayers=2;
+		*prefix="bilayer512p50_pbcz";
+		break;
+
+		case 45:
+		config->pbcz=true;
+		config->total_runs=20000;
+		config->minmillipperp=750;
+		config->maxmillipperp=750;
+		config->incmillip=1;
+		config->xdim=config->ydim=512;
+		config->nrlayers=2;
+		*prefix="bilayer512p75_pbcz";
+		break;
+
+		case 50:
+		config->pbcz=false;
+		config->total_runs=10000;
+		config->minmillipperp=500;
+		config->maxmillipperp=500;
+		config->incmillip=1;
+		config->xdim=config->ydim=256;
+		config->nrlayers=3;
+		*prefix="trilayer256p50";
+		break;
+
+		case 51:
+		config->pbcz=true;
+		config->total_runs=10000;
+		config->minmillipperp=500;
+		config->maxmillipperp=500;
+		config->incmillip=1;
+		config->xdim=config->ydim=256;
+		config->nrlayers=3;
+		*prefix="trilayer256p50_pbcz";
+		break;
+
+		/*
+			The same as cases 40-51, but starting from a grid with a spacing of 0.02,
+			and refining it down to 0.001 only around the percolation threshold.
+		*/
+
+		case 140:
+		config->pbcz=false;
+		config->total_runs=10000;
+		config->minmillipperp=250;
+		config->maxmillipperp=250;
+		config->incmillip=20;
+		config->refine=true;
+		config->xdim=config->ydim=512;
+		config->nrlayers=2;
+		*prefix="bilayer512p25_refined";
+		break;
+
+		case 141:
+		config->pbcz=false;
+		config->total_runs=10000;
+		config->minmillipperp=500;
+		config->maxmillipperp=500;
+		config->incmillip=20;
+		config->refine=true;
+		config->xdim=config->ydim=512;
+		config->nrlayers=2;
+		*prefix="bilayer512p50_refined";
+		break;
+
+		case 142:
+		config->pbcz=false;
+		config->total_runs=10000;
+		config->minmillipperp=750;
+		config->maxmillipperp=750;
+		config->incmillip=20;
+		config->refine=true;
+		config->xdim=config->ydim=512;
+		config->nrlayers=2;
+		*prefix="bilayer512p75_refined";
+		break;
+
+		case 143:
+		config->pbcz=true;
+		config->total_runs=20000;
+		config->minmillipperp=250;
+		config->maxmillipperp=250;
+		config->incmillip=20;
+		config->refine=true;
+		config->xdim=config->ydim=512;
+		config->nrlayers=2;
+		*prefix="bilayer512p25_pbcz_refined";
+		break;
+
+		case 144:
+		config->pbcz=true;
+		config->total_runs=20000;
+		config->minmillipperp=500;
+		config->maxmillipperp=500;
+		config->incmillip=20;
+		config->refine=true;
+		config->xdim=config->ydim=512;
+		config->nrlayers=2;
+		*prefix="bilayer512p50_pbcz_refined";
+		break;
+
+		case 145:
+		config->pbcz=true;
+		config->total_runs=20000;
+		config->minmillipperp=750;
+		config->maxmillipperp=750;
+		config->incmillip=20;
+		config->refine=true;
+		config->xdim=config->ydim=512;
+		config->nrlayers=2;
+		*prefix="bilayer512p75_pbcz_refined";
+		break;
+
+		case 150:
+		config->pbcz=false;
+		config->total_runs=10000;
+		config->minmillipperp=500;
+		config->maxmillipperp=500;
+		config->incmillip=20;
+		config->refine=true;
+		config->xdim=config->ydim=256;
+		config->nrlayers=3;
+		*prefix="trilayer256p50_refined";
+		break;
+
+		case 151:
+		config->pbcz=true;
+		config->total_runs=10000;
+		config->minmillipperp=500;
+		config->maxmillipperp=500;
+		config->incmillip=20;
+		config->refine=true;
+		config->xdim=config->ydim=256;
+		config->nrlayers=3;
+		*prefix="trilayer256p50_pbcz_refined";
+		break;
+
+		/*
+			Jumps around pperp=0.5, with the runs distributed
+			according to their cost within a budget of 12 hours.
+		*/
+
+		case 160:
+		config->pbcz=false;
+		config->measure_jumps=true;
+		config->budget=12*3600;
+		config->minmillipperp=500;
+		config->maxmillipperp=500;
+		config->incmillip=5;
+		config->xdim=config->ydim=256;
+		config->nrlayers=2;
+		*prefix="jumps256_budget";
+		break;
+
+		case 201:
+		config->pbcz=false;
+		config->xdim=config->ydim=256;
+		config->nrlayers=2;
+		*prefix="l2_256";
+		break;
+
+		case 202:
+		config->pbcz=false;
+		config->xdim=config->ydim=256;
+		config->nrlayers=3;
+		*prefix="l3_256";
+		break;
+
+		case 203:
+		config->pbcz=false;
+		config->xdim=config->ydim=256;
+		config->nrlayers=4;
+		*prefix="l4_256";
+		break;
+
+		case 204:
+		config->pbcz=false;
+		config->xdim=config->ydim=256;
+		config->nrlayers=5;
+		*prefix="l5_256";
+		break;
+
+		case 205:
+		config->pbcz=false;
+		config->xdim=config->ydim=256;
+		config->nrlayers=6;
+		*prefix="l6_256";
+		break;
+
+		case 206:
+		config->pbcz=false;
+		config->xdim=config->ydim=256;
+		config->nrlayers=7;
+		*prefix="l7_256";
+		break;
+
+		case 207:
+		config->pbcz=false;
+		config->xdim=config->ydim=256;
+		config->nrlayers=8;
+		*prefix="l8_256";
+		break;
+
+		case 208:
+		config->pbcz=true;
+		config->xdim=config->ydim=256;
+		config->nrlayers=2;
+		*prefix="l2_256_pbcz";
+		break;
+
+		case 209:
+		config->pbcz=true;
+		config->xdim=config->ydim=256;
+		config->nrlayers=3;
+		*prefix="l3_256_pbcz";
+		break;
+
+		case 210:
+		config->pbcz=true;
+		config->xdim=config->ydim=256;
+		config->nrlayers=4;
+		*prefix="l4_256_pbcz";
+		break;
+
+		case 211:
+		config->pbcz=true;
+		config->xdim=config->ydim=256;
+		config->nrlayers=5;
+		*prefix="l5_256_pbcz";
+		break;
+
+		case 212:
+		config->pbcz=true;
+		config->xdim=config->ydim=256;
+		config->nrlayers=6;
+		*prefix="l6_256_pbcz";
+		break;
+
+		case 213:
+		config->pbcz=true;
+		config->xdim=config->ydim=256;
+		config->nrlayers=7;
+		*prefix="l7_256_pbcz";
+		break;
+
+		case 214:
+		config->pbcz=true;
+		config->xdim=config->ydim=256;
+		config->nrlayers=8;
+		*prefix="l8_256_pbcz";
+		break;
+
+		case 218:
+		config->pbcz=false;
+		config->measure_jumps=true;
+		config->total_runs=1000;
+		config->minmillipperp=500;
+		config->maxmillipperp=500;
+		config->xdim=config->ydim=16;
+		config->nrlayers=3;
+		*prefix="trilayer_jumps16";
+		break;
+
+		case 219:
+		config->pbcz=false;
+		config->measure_jumps=true;
+		config->total_runs=1000;
+		config->minmillipperp=500;
+		config->maxmillipperp=500;
+		config->xdim=config->ydim=32;
+		config->nrlayers=3;
+		*prefix="trilayer_jumps32";
+		break;
+
+		case 220:
+		config->pbcz=false;
+		config->measure_jumps=true;
+		config->total_runs=1000;
+		config->minmillipperp=500;
+		config->maxmillipperp=500;
+		config->xdim=config->ydim=64;
+		config->nrlayers=3;
+		*prefix="trilayer_jumps64";
+		break;
+
+		case 221:
+		config->pbcz=false;
+		config->measure_jumps=true;
+		config->total_runs=1000;
+		config->minmillipperp=500;
+		config->maxmillipperp=500;
+		config->xdim=config->ydim=128;
+		config->nrlayers=3;
+		*prefix="trilayer_jumps128";
+		break;
+
+		case 222:
+		config->pbcz=false;
+		config->measure_jumps=true;
+		config->total_runs=1000;
+		config->minmillipperp=500;
+		config->maxmillipperp=500;
+		config->xdim=config->ydim=256;
+		config->nrlayers=3;
+		*prefix="trilayer_jumps256";
+		break;
+
+		case 223:
+		config->pbcz=true;
+		config->measure_jumps=true;
+		config->total_runs=1000;
+		config->minmillipperp=500;
+		config->maxmillipperp=500;
+		config->xdim=config->ydim=16;
+		config->nrlayers=3;
+		*prefix="trilayer_jumps16_pbcz";
+		break;
+
+		case 224:
+		config->pbcz=true;
+		config->measure_jumps=true;
+		config->total_runs=1000;
+		config->minmillipperp=500;
+		config->maxmillipperp=500;
+		config->xdim=config->ydim=32;
+		config->nrlayers=3;
+		*prefix="trilayer_jumps32_pbcz";
+		break;
+
+		case 225:
+		config->pbcz=true;
+		config->measure_jumps=true;
+		config->total_runs=1000;
+		config->minmillipperp=500;
+		config->maxmillipperp=500;
+		config->xdim=config->ydim=64;
+		config->nrlayers=3;
+		*prefix="trilayer_jumps64_pbcz";
+		break;
+
+		case 226:
+		config->pbcz=true;
+		config->measure_jumps=true;
+		config->total_runs=1000;
+		config->minmillipperp=500;
+		config->maxmillipperp=500;
+		config->xdim=config->ydim=128;
+		config->nrlayers=3;
+		*prefix="trilayer_jumps128_pbcz";
+		break;
+
+		case 227:
+		config->pbcz=true;
+		config->measure_jumps=true;
+		config->total_runs=1000;
+		config->minmillipperp=500;
+		config->maxmillipperp=500;
+		config->xdim=config->ydim=256;
+		config->nrlayers=3;
+		*prefix="trilayer_jumps256_pbcz";
+		break;
+
+		case 900:
+		config->pbcz=true;
+		config->measure_jumps=true;
+		config->total_runs=50000;
+		config->minmillipperp=500;
+		config->maxmillipperp=500;
+		config->xdim=config->ydim=32;
+		config->nrlayers=5;
+		*prefix="l5_256_test2";
+		break;
+
+		case 903:
+		config->pbcz=true;
+		config->measure_jumps=true;
+		config->total_runs=50000;
+		config->minmillipperp=500;
+		config->maxmillipperp=500;
+		config->xdim=config->ydim=32;
+		config->nrlayers=5;
+		*prefix="l3_256_test9";
+		break;
+
+		case 904:
+		config->pbcz=true;
+		config->measure_jumps=true;
+		config->total_runs=50000;
+		config->minmillipperp=500;
+		config->maxmillipperp=500;
+		config->xdim=config->ydim=32;
+		config->nrlayers=5;
+		*prefix="l4_256_test9";
+		break;
+
+		case 905:
+		config->pbcz=true;
+		config->measure_jumps=true;
+		config->total_runs=50000;
+		config->minmillipperp=500;
+		config->maxmillipperp=500;
+		config->xdim=config->ydim=32;
+		config->nrlayers=5;
+		*prefix="l5_256_test9";
+		break;
+
+		default:
+		return false;
+	}
+
+	return true;
+}
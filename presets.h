@@ -0,0 +1,10 @@
+#ifndef __PRESETS_H__
+#define __PRESETS_H__
+
+#include <stdbool.h>
+
+#include "simulation.h"
+
+bool preset(int id,struct config_t *config,const char **prefix);
+
+#endif //__PRESETS_H__
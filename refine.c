@@ -0,0 +1,234 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <assert.h>
+
+#include "common.h"
+#include "clusters.h"
+#include "simulation.h"
+#include "pipeline.h"
+#include "batch.h"
+#include "writer.h"
+#include "refine.h"
+
+/*
+	Adaptive refinement of the grid around the percolation threshold.
+
+	The points live on the lattice of integer millip and millipperp values spanned
+	by the configuration, whose grid is the coarsest level. After each level, every
+	pair of neighbouring points, either along p or along pperp, is looked at: if one
+	of the spanning probabilities enters the band [refine_low, refine_high] between
+	the two, the midpoint is evaluated at the next level. Points far away from the
+	threshold are never revisited, while the band gets bracketed more and more tightly,
+	down to a spacing of 0.001.
+*/
+
+#define POINT_UNVISITED		(0)
+#define POINT_QUEUED		(1)
+#define POINT_EVALUATED		(2)
+
+struct refine_grid_t
+{
+	int minmillip,np;
+	int minmillipperp,npperp;
+
+	/*
+		For every point of the finest grid, its state and,
+		once evaluated, its two spanning probabilities.
+	*/
+
+	char *state;
+	float *bilayer,*single;
+};
+
+struct refine_level_t
+{
+	struct point_t *points;
+	int *millip,*millipperp;
+	int nr_points,capacity;
+};
+
+struct refine_data_t
+{
+	struct config_t *config;
+	struct outputs_t *outputs;
+	struct refine_grid_t *grid;
+	struct refine_level_t *level;
+};
+
+static int grid_index(struct refine_grid_t *grid,int millip,int millipperp)
+{
+	return (millipperp-grid->minmillipperp)*grid->np+(millip-grid->minmillip);
+}
+
+static void level_add(struct refine_level_t *level,struct refine_grid_t *grid,int millip,int millipperp)
+{
+	int idx=grid_index(grid,millip,millipperp);
+
+	if(grid->state[idx]!=POINT_UNVISITED)
+		return;
+
+	grid->state[idx]=POINT_QUEUED;
+
+	if(level->nr_points==level->capacity)
+	{
+		level->capacity=MAX(2*level->capacity,64);
+		level->points=realloc(level->points,sizeof(struct point_t)*level->capacity);
+		level->millip=realloc(level->millip,sizeof(int)*level->capacity);
+		level->millipperp=realloc(level->millipperp,sizeof(int)*level->capacity);
+		assert(level->points&&level->millip&&level->millipperp);
+	}
+
+	level->points[level->nr_points].p=0.001*millip;
+	level->points[level->nr_points].pperp=0.001*millipperp;
+	level->points[level->nr_points].runs=0;
+	level->millip[level->nr_points]=millip;
+	level->millipperp[level->nr_points]=millipperp;
+	level->nr_points++;
+}
+
+static void refine_point_done(int index,struct point_t *point,struct statistics_t *total,void *data)
+{
+	struct refine_data_t *refine_data=data;
+	struct refine_grid_t *grid=refine_data->grid;
+	struct refine_level_t *level=refine_data->level;
+
+	int idx=grid_index(grid,level->millip[index],level->millipperp[index]);
+
+	grid->state[idx]=POINT_EVALUATED;
+	grid->bilayer[idx]=((double)(total->cntbilayer))/total->runs;
+	grid->single[idx]=((double)(total->cntsingle))/total->runs;
+
+	writer_submit(refine_data->outputs->stream,index,point,total,NULL);
+}
+
+/*
+	Whether one of the spanning probabilities enters the band between two points.
+*/
+
+static bool crosses_band(struct config_t *config,struct refine_grid_t *grid,int idx1,int idx2)
+{
+	double low=config->refine_low,high=config->refine_high;
+
+	if((MAX(grid->bilayer[idx1],grid->bilayer[idx2])>=low)&&(MIN(grid->bilayer[idx1],grid->bilayer[idx2])<=high))
+		return true;
+
+	if((MAX(grid->single[idx1],grid->single[idx2])>=low)&&(MIN(grid->single[idx1],grid->single[idx2])<=high))
+		return true;
+
+	return false;
+}
+
+/*
+	Looks for neighbouring evaluated points, first along p and then along pperp,
+	and queues the midpoints of the intervals that need to be refined.
+*/
+
+static void refine_next_level(struct config_t *config,struct refine_grid_t *grid,struct refine_level_t *level)
+{
+	level->nr_points=0;
+
+	for(int y=0;y<grid->npperp;y++)
+	{
+		int last=-1;
+
+		for(int x=0;x<grid->np;x++)
+		{
+			if(grid->state[y*grid->np+x]!=POINT_EVALUATED)
+				continue;
+
+			if((last!=-1)&&(x-last>1)&&(crosses_band(config,grid,y*grid->np+last,y*grid->np+x)==true))
+				level_add(level,grid,grid->minmillip+(last+x)/2,grid->minmillipperp+y);
+
+			last=x;
+		}
+	}
+
+	for(int x=0;x<grid->np;x++)
+	{
+		int last=-1;
+
+		for(int y=0;y<grid->npperp;y++)
+		{
+			if(grid->state[y*grid->np+x]!=POINT_EVALUATED)
+				continue;
+
+			if((last!=-1)&&(y-last>1)&&(crosses_band(config,grid,last*grid->np+x,y*grid->np+x)==true))
+				level_add(level,grid,grid->minmillip+x,grid->minmillipperp+(last+y)/2);
+
+			last=y;
+		}
+	}
+}
+
+void do_batch_refined(struct config_t *config,struct outputs_t *outputs)
+{
+	struct refine_grid_t grid;
+	struct refine_level_t level;
+
+	/*
+		The finest grid covers the same range as the coarse one.
+	*/
+
+	grid.minmillip=config->minmillip;
+	grid.minmillipperp=config->minmillipperp;
+	grid.np=config->maxmillip-config->minmillip+1;
+	grid.npperp=config->maxmillipperp-config->minmillipperp+1;
+
+	assert((grid.np>0)&&(grid.npperp>0));
+
+	size_t size=((size_t)(grid.np))*grid.npperp;
+
+	grid.state=calloc(size,sizeof(char));
+	grid.bilayer=malloc(sizeof(float)*size);
+	grid.single=malloc(sizeof(float)*size);
+	assert(grid.state&&grid.bilayer&&grid.single);
+
+	level.points=NULL;
+	level.millip=level.millipperp=NULL;
+	level.nr_points=level.capacity=0;
+
+	for(int millipperp=config->minmillipperp;millipperp<=config->maxmillipperp;millipperp+=config->incmillipperp)
+		for(int millip=config->minmillip;millip<=config->maxmillip;millip+=config->incmillip)
+			level_add(&level,&grid,millip,millipperp);
+
+	struct refine_data_t refine_data;
+
+	refine_data.config=config;
+	refine_data.outputs=outputs;
+	refine_data.grid=&grid;
+	refine_data.level=&level;
+
+	int total_points=0;
+
+	for(int c=0;(c<=config->refine_levels)&&(level.nr_points>0);c++)
+	{
+		fprintf(stderr,"Refinement level %d: %d points\n",c,level.nr_points);
+
+		batch_run_points(config,level.points,level.nr_points,refine_point_done,&refine_data);
+
+		total_points+=level.nr_points;
+
+		refine_next_level(config,&grid,&level);
+	}
+
+	fprintf(stderr,"Refinement: %d points evaluated, out of %zu on the finest grid\n",total_points,size);
+
+	if(level.points)
+		free(level.points);
+
+	if(level.millip)
+		free(level.millip);
+
+	if(level.millipperp)
+		free(level.millipperp);
+
+	if(grid.state)
+		free(grid.state);
+
+	if(grid.bilayer)
+		free(grid.bilayer);
+
+	if(grid.single)
+		free(grid.single);
+}
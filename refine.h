@@ -0,0 +1,9 @@
+#ifndef __REFINE_H__
+#define __REFINE_H__
+
+#include "simulation.h"
+#include "batch.h"
+
+void do_batch_refined(struct config_t *config,struct outputs_t *outputs);
+
+#endif //__REFINE_H__
@@ -0,0 +1,833 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "common.h"
+#include "clusters.h"
+#include "simulation.h"
+#include "context.h"
+#include "arena.h"
+#include "affinity.h"
+#include "pipeline.h"
+#include "batch.h"
+#include "scheduler.h"
+#include "checkpoint.h"
+#include "evlog.h"
+#include "writer.h"
+#include "monitor.h"
+#include "governor.h"
+
+/*
+	A cost-aware, work-stealing task scheduler.
+
+	Every point starts as a short pilot task. When a pilot is done, the
+	measured cost of a run at that point is used to split the remaining runs
+	into chunks of roughly SCHEDULER_CHUNK_SECONDS each.
+
+	Each worker keeps its own tasks in a heap, ordered by the estimated time,
+	in seconds, of all the work left at their point when they were created:
+	from a simple cost model for the pilots, and from the measured cost of a
+	run for the chunks. This way the chunks of the most expensive points, i.e.
+	the ones close to the threshold, start first rather than stretching the
+	tail. A worker with nothing left steals the largest task of another worker.
+
+	Optionally, the state of the points is saved to a checkpoint, from which
+	an interrupted run can be resumed, see checkpoint.c. The same structure
+	also gives the initial state of the points, either from such a checkpoint
+	or from the result store, see store.c, in which case it has no file name.
+
+	Several jobs, possibly with different geometries, can share the same pool
+	of workers: each worker keeps its simulation context as long as the tasks
+	it gets have the same geometry, and creates a new one otherwise.
+*/
+
+#define SCHEDULER_PILOT_RUNS		(4)
+#define SCHEDULER_CHUNK_SECONDS		(0.25)
+#define SCHEDULER_JUMPS_COST		(10.0)
+#define SCHEDULER_SECONDS_PER_SITE	(1e-7)
+
+/*
+	The cost of a task is the estimated time left at its point, see above.
+*/
+
+struct task_t
+{
+	int job,point;
+	int runs;
+	bool pilot;
+
+	double cost;
+};
+
+/*
+	A max-heap of tasks, ordered by cost.
+*/
+
+struct task_heap_t
+{
+	struct task_t *tasks;
+	int nr_tasks,capacity;
+
+	pthread_mutex_t mutex;
+};
+
+static void heap_init(struct task_heap_t *heap)
+{
+	heap->tasks=NULL;
+	heap->nr_tasks=heap->capacity=0;
+	pthread_mutex_init(&heap->mutex,NULL);
+}
+
+static void heap_fini(struct task_heap_t *heap)
+{
+	pthread_mutex_destroy(&heap->mutex);
+
+	if(heap->tasks)
+		free(heap->tasks);
+}
+
+static void heap_push(struct task_heap_t *heap,struct task_t *task)
+{
+	pthread_mutex_lock(&heap->mutex);
+
+	if(heap->nr_tasks==heap->capacity)
+	{
+		heap->capacity=MAX(2*heap->capacity,64);
+		heap->tasks=realloc(heap->tasks,sizeof(struct task_t)*heap->capacity);
+		assert(heap->tasks);
+	}
+
+	int c=heap->nr_tasks++;
+
+	while((c>0)&&(heap->tasks[(c-1)/2].cost<task->cost))
+	{
+		heap->tasks[c]=heap->tasks[(c-1)/2];
+		c=(c-1)/2;
+	}
+
+	heap->tasks[c]=*task;
+
+	pthread_mutex_unlock(&heap->mutex);
+}
+
+static bool heap_pop(struct task_heap_t *heap,struct task_t *task)
+{
+	pthread_mutex_lock(&heap->mutex);
+
+	if(heap->nr_tasks==0)
+	{
+		pthread_mutex_unlock(&heap->mutex);
+		return false;
+	}
+
+	*task=heap->tasks[0];
+
+	struct task_t last=heap->tasks[--heap->nr_tasks];
+	int c=0;
+
+	while(2*c+1<heap->nr_tasks)
+	{
+		int child=2*c+1;
+
+		if((child+1<heap->nr_tasks)&&(heap->tasks[child+1].cost>heap->tasks[child].cost))
+			child++;
+
+		if(heap->tasks[child].cost<=last.cost)
+			break;
+
+		heap->tasks[c]=heap->tasks[child];
+		c=child;
+	}
+
+	if(heap->nr_tasks>0)
+		heap->tasks[c]=last;
+
+	pthread_mutex_unlock(&heap->mutex);
+
+	return true;
+}
+
+/*
+	The partial results of a point, while its tasks are running.
+*/
+
+struct point_state_t
+{
+	int runs_scheduled,runs_done;
+	int tasks_pending;
+	bool done;
+
+	/*
+		Compact copy of the statistics, allocated with the first result.
+	*/
+
+	char *total;
+};
+
+struct scheduler_t
+{
+	struct scheduler_job_t *jobs;
+	int nr_jobs;
+
+	/*
+		The settings of the pool of workers, shared by all the jobs, see scheduler_pool().
+	*/
+
+	struct config_t pool;
+
+	struct point_state_t **states;
+
+	int nr_workers;
+	struct task_heap_t *heaps;
+
+	/*
+		The number of tasks not yet completed, protected by 'mutex': idle
+		workers wait on 'cond' for new tasks, or for the end of the work.
+	*/
+
+	long pending;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+
+	/*
+		Merging results and calling back, protected by 'results_mutex'.
+	*/
+
+	pthread_mutex_t results_mutex;
+	struct statistics_t *scratch;
+
+	long nr_tasks,nr_steals;
+
+	struct checkpoint_t *checkpoint;
+};
+
+struct scheduler_worker_t
+{
+	struct scheduler_t *scheduler;
+	pthread_t thread;
+	int index;
+
+	struct worker_stats_t *stats;
+};
+
+/*
+	A rough estimate of the time of a run, in seconds, before any measurement:
+	it only has to be comparable with the measured ones, see scheduler_complete().
+*/
+
+static double model_cost(struct config_t *config)
+{
+	double ret=SCHEDULER_SECONDS_PER_SITE*config->xdim*config->ydim*config->nrlayers;
+
+	if(config->measure_jumps==true)
+		ret*=SCHEDULER_JUMPS_COST;
+
+	return ret;
+}
+
+static void scheduler_push(struct scheduler_t *scheduler,int worker,struct task_t *task)
+{
+	pthread_mutex_lock(&scheduler->mutex);
+	scheduler->pending++;
+	pthread_mutex_unlock(&scheduler->mutex);
+
+	heap_push(&scheduler->heaps[worker],task);
+
+	pthread_mutex_lock(&scheduler->mutex);
+	pthread_cond_broadcast(&scheduler->cond);
+	pthread_mutex_unlock(&scheduler->mutex);
+}
+
+/*
+	Takes the largest task of the worker, or steals the largest one of another worker.
+	Waits if there are none, but some tasks are still running: they may generate new ones.
+*/
+
+static bool scheduler_next(struct scheduler_t *scheduler,int index,struct task_t *task)
+{
+	while(true)
+	{
+		if(checkpoint_interrupted()==true)
+			return false;
+
+		if(heap_pop(&scheduler->heaps[index],task)==true)
+			return true;
+
+		for(int c=1;c<scheduler->nr_workers;c++)
+		{
+			if(heap_pop(&scheduler->heaps[(index+c)%scheduler->nr_workers],task)==true)
+			{
+				pthread_mutex_lock(&scheduler->results_mutex);
+				scheduler->nr_steals++;
+				pthread_mutex_unlock(&scheduler->results_mutex);
+
+				return true;
+			}
+		}
+
+		pthread_mutex_lock(&scheduler->mutex);
+
+		if((scheduler->pending==0)||(checkpoint_interrupted()==true))
+		{
+			pthread_mutex_unlock(&scheduler->mutex);
+			return false;
+		}
+
+		/*
+			New tasks are pushed before 'pending' is decremented, so waiting
+			here cannot miss the last one: the heaps are looked at again.
+		*/
+
+		bool empty=true;
+
+		for(int c=0;(c<scheduler->nr_workers)&&(empty==true);c++)
+		{
+			pthread_mutex_lock(&scheduler->heaps[c].mutex);
+
+			if(scheduler->heaps[c].nr_tasks>0)
+				empty=false;
+
+			pthread_mutex_unlock(&scheduler->heaps[c].mutex);
+		}
+
+		if(empty==true)
+			pthread_cond_wait(&scheduler->cond,&scheduler->mutex);
+
+		pthread_mutex_unlock(&scheduler->mutex);
+	}
+}
+
+/*
+	Saves the state of all the points, with 'results_mutex' held, so that it is
+	consistent with what has been written to the output files so far.
+
+	The writer is drained first: then the points that are done are either in
+	the files, or held by the writer, waiting for the points before them, in
+	which case they are saved as partial, with all their runs.
+*/
+
+static void scheduler_checkpoint(struct scheduler_t *scheduler)
+{
+	for(int c=0;c<scheduler->nr_jobs;c++)
+		if(scheduler->jobs[c].outputs!=NULL)
+			writer_sync(scheduler->jobs[c].outputs->stream->writer);
+
+	FILE *out=checkpoint_begin(scheduler->checkpoint,scheduler->jobs,scheduler->nr_jobs);
+
+	if(!out)
+		return;
+
+	for(int c=0;c<scheduler->nr_jobs;c++)
+	{
+		struct scheduler_job_t *job=&scheduler->jobs[c];
+
+		checkpoint_add_job(out,job);
+
+		for(int d=0;d<job->nr_points;d++)
+		{
+			struct point_state_t *state=&scheduler->states[c][d];
+			const char *total=state->total;
+			int status=CHECKPOINT_TODO;
+
+			if(state->done==true)
+			{
+				status=CHECKPOINT_DONE;
+
+				if((job->outputs!=NULL)&&((total=writer_held(job->outputs->stream,d))!=NULL))
+					status=CHECKPOINT_PARTIAL;
+			}
+			else if(total!=NULL)
+			{
+				status=CHECKPOINT_PARTIAL;
+			}
+
+			checkpoint_add_point(out,job->config,status,state->runs_done,total);
+		}
+	}
+
+	checkpoint_end(scheduler->checkpoint,out);
+}
+
+static void scheduler_finish_point(struct scheduler_t *scheduler,int job_index,int point)
+{
+	struct scheduler_job_t *job=&scheduler->jobs[job_index];
+	struct point_state_t *state=&scheduler->states[job_index][point];
+
+	stats_expand(job->config,state->total,scheduler->scratch);
+	job->point_done(point,&job->points[point],scheduler->scratch,job->data);
+
+	free(state->total);
+	state->total=NULL;
+	state->done=true;
+}
+
+/*
+	Accumulates the result of a task, splitting the rest of the point into chunks
+	after the pilot, and calling back when the point is complete.
+
+	After a signal the runs are cut short, and no more tasks are created: with
+	adaptive sampling the point cannot be continued later, so the result is
+	dropped, otherwise it is kept as partial, for the checkpoint.
+
+	The runs of the task are written to the event log here, with the result,
+	or dropped with it, so that at every checkpoint the log holds exactly the
+	runs in the state saved.
+*/
+
+static void scheduler_complete(struct scheduler_t *scheduler,int index,struct task_t *task,struct statistics_t *result,struct evlog_buffer_t *evlog)
+{
+	struct scheduler_job_t *job=&scheduler->jobs[task->job];
+	struct config_t *config=job->config;
+	struct point_state_t *state=&scheduler->states[task->job][task->point];
+	size_t size=stats_compact_size(config);
+	double cost=result->cpu_time/MAX(result->runs,1);
+
+	bool interrupted=checkpoint_interrupted();
+	bool discard=(interrupted==true)&&(config->adaptive==true);
+
+	pthread_mutex_lock(&scheduler->results_mutex);
+
+	scheduler->nr_tasks++;
+
+	if(discard==false)
+	{
+		if(state->total==NULL)
+		{
+			state->total=malloc(size);
+			assert(state->total);
+
+			stats_compact(config,result,state->total);
+		}
+		else
+		{
+			stats_expand(config,state->total,scheduler->scratch);
+			add_stats(scheduler->scratch,result);
+			stats_compact(config,scheduler->scratch,state->total);
+		}
+
+		state->runs_done+=result->runs;
+
+		evlog_buffer_flush(evlog);
+	}
+	else
+	{
+		evlog_buffer_drop(evlog);
+	}
+
+	state->tasks_pending--;
+
+	int remaining=0,chunk=0;
+
+	if((task->pilot==true)&&(interrupted==false))
+	{
+		remaining=point_nr_runs(config,&job->points[task->point])-state->runs_scheduled;
+
+		if(remaining>0)
+		{
+			chunk=(int)(ceil(SCHEDULER_CHUNK_SECONDS/MAX(cost,1e-9)));
+			chunk=MAX(1,MIN(chunk,remaining));
+
+			state->tasks_pending+=(remaining+chunk-1)/chunk;
+			state->runs_scheduled+=remaining;
+		}
+	}
+
+	if((state->tasks_pending==0)&&(discard==false)&&
+	   ((config->adaptive==true)||(state->runs_done>=point_nr_runs(config,&job->points[task->point]))))
+		scheduler_finish_point(scheduler,task->job,task->point);
+
+	if((scheduler->checkpoint!=NULL)&&(interrupted==false)&&
+	   (get_time()-scheduler->checkpoint->last>scheduler->checkpoint->interval))
+		scheduler_checkpoint(scheduler);
+
+	pthread_mutex_unlock(&scheduler->results_mutex);
+
+	/*
+		The new chunks go to this worker's heap, others will steal them if idle.
+		They all get the measured time of the runs left at the point, so that
+		they are ranked in the same units as the pilots, and the chunks of the
+		points with the most work left go first.
+	*/
+
+	if(remaining>0)
+	{
+		for(int runs=remaining;runs>0;runs-=chunk)
+		{
+			struct task_t new_task;
+
+			new_task.job=task->job;
+			new_task.point=task->point;
+			new_task.runs=MIN(chunk,runs);
+			new_task.pilot=false;
+			new_task.cost=cost*remaining;
+
+			scheduler_push(scheduler,index,&new_task);
+		}
+	}
+
+	/*
+		After a signal, the idle workers are woken up, so that they can quit.
+	*/
+
+	pthread_mutex_lock(&scheduler->mutex);
+
+	if((--scheduler->pending==0)||(interrupted==true))
+		pthread_cond_broadcast(&scheduler->cond);
+
+	pthread_mutex_unlock(&scheduler->mutex);
+}
+
+static void *scheduler_worker_thread(void *arg)
+{
+	struct scheduler_worker_t *worker=arg;
+	struct scheduler_t *scheduler=worker->scheduler;
+
+	if(scheduler->pool.pin_threads==true)
+		affinity_pin_thread(worker->index);
+
+	struct simulation_ctx_t *ctx=NULL;
+	struct statistics_t *result=malloc(sizeof(struct statistics_t));
+	assert(result);
+
+	struct task_t task;
+
+	worker->stats->monitor=monitor_acquire();
+
+	while(scheduler_next(scheduler,worker->index,&task)==true)
+	{
+		double start=get_time();
+
+		struct scheduler_job_t *job=&scheduler->jobs[task.job];
+
+		if((ctx!=NULL)&&(simulation_ctx_matches(ctx,job->config)==false))
+		{
+			simulation_ctx_fini(ctx);
+			ctx=NULL;
+		}
+
+		if(ctx==NULL)
+		{
+			ctx=simulation_ctx_init(job->config);
+			assert(ctx!=NULL);
+
+			worker->stats->memory=MAX(worker->stats->memory,simulation_ctx_bytes(ctx));
+			monitor_set_memory(worker->stats->monitor,worker->stats->memory);
+
+			if((worker->index==0)&&(ctx->arena!=NULL)&&(job->config->verbose==true))
+				arena_report(ctx->arena,stderr);
+		}
+
+		worker_stats_update_location(worker->stats);
+
+		struct point_t point=job->points[task.point];
+		point.runs=task.runs;
+
+		struct evlog_buffer_t evlog;
+		evlog_buffer_init(&evlog,job->config->evlog,true);
+
+		do_point(ctx,job->config,&point,result,worker->stats,&evlog);
+
+		worker->stats->busy+=get_time()-start;
+
+		scheduler_complete(scheduler,worker->index,&task,result,&evlog);
+		evlog_buffer_fini(&evlog);
+	}
+
+	monitor_release(worker->stats->monitor);
+	simulation_ctx_fini(ctx);
+
+	if(result)
+		free(result);
+
+	return NULL;
+}
+
+/*
+	The jobs share a single pool of workers, so the settings of the pool are
+	merged from all of them: the smallest number of workers and the smallest
+	memory budget that any job asks for, pinning only if all the jobs ask for
+	it, and verbose output if any does. The jobs that disagree are reported.
+*/
+
+static void scheduler_pool(struct config_t *pool,struct scheduler_job_t *jobs,int nr_jobs)
+{
+	bool disagree=false;
+
+	*pool=*jobs[0].config;
+
+	for(int c=1;c<nr_jobs;c++)
+	{
+		struct config_t *config=jobs[c].config;
+
+		if((config->nr_workers!=pool->nr_workers)||(config->memory_budget!=pool->memory_budget)||(config->pin_threads!=pool->pin_threads))
+			disagree=true;
+
+		if((config->nr_workers>0)&&((pool->nr_workers<=0)||(config->nr_workers<pool->nr_workers)))
+			pool->nr_workers=config->nr_workers;
+
+		if((config->memory_budget>0.0)&&((pool->memory_budget<=0.0)||(config->memory_budget<pool->memory_budget)))
+			pool->memory_budget=config->memory_budget;
+
+		pool->pin_threads=(pool->pin_threads==true)&&(config->pin_threads==true);
+		pool->verbose=(pool->verbose==true)||(config->verbose==true);
+
+		if(pool->worker_stats==NULL)
+			pool->worker_stats=config->worker_stats;
+	}
+
+	if(disagree==true)
+	{
+		char workers[32],budget[32];
+
+		snprintf(workers,32,(pool->nr_workers>0)?("%d"):("one per CPU"),pool->nr_workers);
+		snprintf(budget,32,(pool->memory_budget>0.0)?("%.1f MB"):("none"),pool->memory_budget);
+
+		fprintf(stderr,"Warning: the batches sharing the pool of workers disagree on workers, memory_budget or pin_threads, ");
+		fprintf(stderr,"using workers: %s, memory budget: %s, pinned: %s.\n",workers,budget,(pool->pin_threads==true)?("yes"):("no"));
+	}
+}
+
+void scheduler_run(struct scheduler_job_t *jobs,int nr_jobs,struct checkpoint_t *checkpoint)
+{
+	struct scheduler_t scheduler;
+
+	assert(nr_jobs>0);
+
+	scheduler.jobs=jobs;
+	scheduler.nr_jobs=nr_jobs;
+	scheduler.pending=0;
+	scheduler.nr_tasks=scheduler.nr_steals=0;
+	scheduler.checkpoint=((checkpoint!=NULL)&&(checkpoint->filename!=NULL))?(checkpoint):(NULL);
+
+	scheduler_pool(&scheduler.pool,jobs,nr_jobs);
+
+	scheduler.nr_workers=(scheduler.pool.nr_workers>0)?(scheduler.pool.nr_workers):(affinity_nr_cpus());
+	scheduler.nr_workers=MAX(scheduler.nr_workers,1);
+
+	/*
+		A worker keeps one context at a time, so it needs at most the
+		memory of the largest one.
+	*/
+
+	size_t worker_bytes=0,graph_bytes=0;
+
+	for(int c=0;c<nr_jobs;c++)
+	{
+		worker_bytes=MAX(worker_bytes,simulation_ctx_estimate(jobs[c].config));
+		graph_bytes=MAX(graph_bytes,simulation_ctx_graph_estimate(jobs[c].config));
+	}
+
+	scheduler.nr_workers=governor_workers(&scheduler.pool,worker_bytes,graph_bytes,scheduler.nr_workers);
+
+	pthread_mutex_init(&scheduler.mutex,NULL);
+	pthread_mutex_init(&scheduler.results_mutex,NULL);
+	pthread_cond_init(&scheduler.cond,NULL);
+
+	scheduler.scratch=malloc(sizeof(struct statistics_t));
+	scheduler.heaps=malloc(sizeof(struct task_heap_t)*scheduler.nr_workers);
+	scheduler.states=malloc(sizeof(struct point_state_t *)*nr_jobs);
+	assert(scheduler.scratch&&scheduler.heaps&&scheduler.states);
+
+	for(int c=0;c<scheduler.nr_workers;c++)
+		heap_init(&scheduler.heaps[c]);
+
+	/*
+		The pilots: with adaptive sampling the number of runs is not known in
+		advance, so a point is not split at all, and its pilot does all the work.
+
+		When resuming from a checkpoint, the points that are done are skipped,
+		and the partial ones start from the statistics saved.
+	*/
+
+	int nr_pilots=0;
+	long planned=0;
+
+	for(int c=0;c<nr_jobs;c++)
+		nr_pilots+=jobs[c].nr_points;
+
+	struct task_t *pilots=malloc(sizeof(struct task_t)*MAX(nr_pilots,1));
+	assert(pilots);
+
+	nr_pilots=0;
+
+	for(int c=0;c<nr_jobs;c++)
+	{
+		struct config_t *config=jobs[c].config;
+
+		scheduler.states[c]=malloc(sizeof(struct point_state_t)*MAX(jobs[c].nr_points,1));
+		assert(scheduler.states[c]);
+
+		for(int d=0;d<jobs[c].nr_points;d++)
+		{
+			struct point_state_t *state=&scheduler.states[c][d];
+			struct checkpoint_point_t *saved=NULL;
+
+			if((checkpoint!=NULL)&&(checkpoint->jobs!=NULL))
+				saved=&checkpoint->jobs[c].points[d];
+
+			state->runs_done=0;
+			state->tasks_pending=0;
+			state->done=false;
+			state->total=NULL;
+
+			if((saved!=NULL)&&(saved->status==CHECKPOINT_DONE))
+			{
+				state->done=true;
+				continue;
+			}
+
+			if((saved!=NULL)&&(saved->status==CHECKPOINT_PARTIAL))
+			{
+				state->total=saved->total;
+				state->runs_done=saved->runs;
+				saved->total=NULL;
+			}
+
+			/*
+				A partial point with adaptive sampling is one that was done, but
+				still held by the writer, see scheduler_checkpoint(): its result is
+				complete, and its runs are already in the event log, so it is
+				written as it is, rather than run again.
+			*/
+
+			int runs=point_nr_runs(config,&jobs[c].points[d])-state->runs_done;
+			int left=runs;
+
+			if((runs<=0)||((config->adaptive==true)&&(state->total!=NULL)))
+			{
+				scheduler_finish_point(&scheduler,c,d);
+				continue;
+			}
+
+			if(config->adaptive==false)
+				runs=MIN(runs,SCHEDULER_PILOT_RUNS);
+
+			pilots[nr_pilots].job=c;
+			pilots[nr_pilots].point=d;
+			pilots[nr_pilots].runs=runs;
+			pilots[nr_pilots].pilot=(config->adaptive==false);
+			pilots[nr_pilots].cost=model_cost(config)*left;
+			nr_pilots++;
+
+			state->runs_scheduled=state->runs_done+runs;
+			state->tasks_pending=1;
+
+			planned+=left;
+		}
+	}
+
+	monitor_plan(planned);
+
+
+	/*
+		Dealt round-robin, so that every worker starts with a share of the largest ones.
+	*/
+
+	for(int c=0;c<nr_pilots;c++)
+	{
+		heap_push(&scheduler.heaps[c%scheduler.nr_workers],&pilots[c]);
+		scheduler.pending++;
+	}
+
+	struct worker_stats_t *stats=aligned_alloc(CACHE_LINE_SIZE,sizeof(struct worker_stats_t)*scheduler.nr_workers);
+	struct scheduler_worker_t *workers=malloc(sizeof(struct scheduler_worker_t)*scheduler.nr_workers);
+	assert(stats&&workers);
+
+	double start=get_time();
+
+	if(scheduler.checkpoint!=NULL)
+	{
+		checkpoint->last=start;
+		checkpoint_install_handlers();
+	}
+
+	for(int c=0;c<scheduler.nr_workers;c++)
+	{
+		worker_stats_reset(&stats[c]);
+
+		workers[c].scheduler=&scheduler;
+		workers[c].index=c;
+		workers[c].stats=&stats[c];
+
+		pthread_create(&workers[c].thread,NULL,scheduler_worker_thread,&workers[c]);
+	}
+
+	for(int c=0;c<scheduler.nr_workers;c++)
+		pthread_join(workers[c].thread,NULL);
+
+	if(scheduler.checkpoint!=NULL)
+	{
+		checkpoint_restore_handlers();
+
+		if(checkpoint_interrupted()==true)
+		{
+			scheduler_checkpoint(&scheduler);
+			fprintf(stderr,"Interrupted, checkpoint written to %s\n",checkpoint->filename);
+		}
+	}
+
+	double elapsed=get_time()-start,busy=0.0;
+
+	for(int c=0;c<scheduler.nr_workers;c++)
+		busy+=stats[c].busy;
+
+	long runs=0;
+
+	for(int c=0;c<scheduler.nr_workers;c++)
+		runs+=stats[c].runs;
+
+	if(elapsed>0.0)
+	{
+		fprintf(stderr,"Scheduler: %d workers (%.1f%% busy), %d jobs, %ld tasks, %ld steals, %.2f runs/s\n",
+			scheduler.nr_workers,100.0*busy/(elapsed*scheduler.nr_workers),nr_jobs,scheduler.nr_tasks,scheduler.nr_steals,runs/elapsed);
+	}
+
+	if((scheduler.pool.verbose==true)||(affinity_nr_nodes()>1))
+		worker_stats_report(stats,scheduler.nr_workers,stderr);
+
+	if(scheduler.pool.worker_stats!=NULL)
+		memcpy(scheduler.pool.worker_stats,stats,sizeof(struct worker_stats_t)*scheduler.nr_workers);
+
+	/*
+		Final cleanup.
+	*/
+
+	for(int c=0;c<scheduler.nr_workers;c++)
+		heap_fini(&scheduler.heaps[c]);
+
+	for(int c=0;c<nr_jobs;c++)
+	{
+		for(int d=0;d<jobs[c].nr_points;d++)
+			if(scheduler.states[c][d].total)
+				free(scheduler.states[c][d].total);
+
+		if(scheduler.states[c])
+			free(scheduler.states[c]);
+	}
+
+	pthread_mutex_destroy(&scheduler.mutex);
+	pthread_mutex_destroy(&scheduler.results_mutex);
+	pthread_cond_destroy(&scheduler.cond);
+
+	if(pilots)
+		free(pilots);
+
+	if(stats)
+		free(stats);
+
+	if(workers)
+		free(workers);
+
+	if(scheduler.heaps)
+		free(scheduler.heaps);
+
+	if(scheduler.states)
+		free(scheduler.states);
+
+	if(scheduler.scratch)
+		free(scheduler.scratch);
+}
@@ -0,0 +1,35 @@
+#ifndef __SCHEDULER_H__
+#define __SCHEDULER_H__
+
+#include "simulation.h"
+#include "pipeline.h"
+#include "batch.h"
+
+struct checkpoint_t;
+
+/*
+	A job is a list of points sharing the same configuration, with a callback
+	invoked once for each point, when all its runs are done. Calls to the
+	callbacks are serialized, across all the jobs.
+*/
+
+struct scheduler_job_t
+{
+	struct config_t *config;
+	struct point_t *points;
+	int nr_points;
+
+	point_done_t point_done;
+	void *data;
+
+	/*
+		The output files written by the callback, if any: their lengths are
+		saved in the checkpoints.
+	*/
+
+	struct outputs_t *outputs;
+};
+
+void scheduler_run(struct scheduler_job_t *jobs,int nr_jobs,struct checkpoint_t *checkpoint);
+
+#endif //__SCHEDULER_H__
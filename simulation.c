@@ -0,0 +1,890 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <assert.h>
+
+#include <gsl/gsl_rng.h>
+
+#include "arena.h"
+#include "bonds.h"
+#include "clusters.h"
+#include "simulation.h"
+#include "context.h"
+
+void seed_rng(gsl_rng *rng)
+{
+	char *devname="/dev/urandom";
+	FILE *dev;
+
+	if((dev=fopen(devname,"r"))!=NULL)
+	{
+		unsigned long seed;
+
+		fread(&seed,sizeof(unsigned long),1,dev);
+		fclose(dev);
+
+		gsl_rng_set(rng,seed);
+	}
+	else
+	{
+		printf("Warning: couldn't read from %s to seed the RNG.\n",devname);
+	}
+}
+
+double get_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+
+	return ts.tv_sec+1e-9*ts.tv_nsec;
+}
+
+/*
+        Factorial of an integer, using only integer arithmetic
+*/
+
+int ifactorial(int n)
+{
+	int result = 1;
+
+	for (int i = 1; i <= n; ++i)
+		result *= i;
+
+	return result;
+}
+
+/*
+	The default configuration, on top of which the batches are defined.
+*/
+
+void config_defaults(struct config_t *config)
+{
+	config->xdim=config->ydim=256;
+	config->nrlayers=2;
+	config->pbcz=false;
+	config->dual_bc=false;
+	config->total_runs=100;
+	config->measure_jumps=false;
+	config->minmillipperp=0;
+	config->maxmillipperp=1000;
+	config->incmillipperp=10;
+	config->minmillip=0;
+	config->maxmillip=1000;
+	config->incmillip=10;
+	config->engine=ENGINE_REFERENCE;
+	config->cluster_observables=false;
+	config->hugepages=true;
+	config->pin_threads=false;
+	config->specialized_kernels=true;
+	config->pipelined=false;
+	config->nr_generators=config->nr_analyzers=config->nr_buffers=0;
+	config->scheduler=true;
+	config->nr_workers=0;
+	config->adaptive=false;
+	config->min_runs=100;
+	config->max_runs=10000;
+	config->target_error=0.01;
+	config->confidence_z=1.0;
+	config->refine=false;
+	config->refine_levels=10;
+	config->refine_low=0.05;
+	config->refine_high=0.95;
+	config->budget=0.0;
+	config->memory_budget=0.0;
+	config->ps=config->pperps=NULL;
+	config->nr_ps=config->nr_pperps=0;
+	config->event_log=false;
+	config->evlog=NULL;
+	config->worker_stats=NULL;
+	config->verbose=false;
+}
+
+int get_random_value(double p,gsl_rng *rng_ctx)
+{
+	if(gsl_rng_uniform(rng_ctx)<p)
+		return 1;
+
+	return 0;
+}
+
+void reset_stats(struct statistics_t *st)
+{
+	st->cntsingle=0;
+	st->cntbilayer=0;
+
+	st->runs=0;
+	st->jumps_sq=0.0;
+	st->cpu_time=0.0;
+	st->bonds=st->vbonds=0.0;
+
+	st->jumps=0;
+	st->matches1=0;
+	st->matches2=0;
+
+	for(int c=0;c<MAX_NR_OF_LAYERS;c++)
+	{
+		st->matches1_by_layer[c]=0;
+		st->matches2_by_layer[c]=0;
+	}
+
+	st->nr_percolating1=0;
+	st->nr_percolating2=0;
+
+	for(int c=0;c<NR_OF_CROSSINGS;c++)
+	{
+		st->strength1[c]=0.0;
+		st->strength2[c]=0.0;
+	}
+
+	st->strength1_sq=st->strength2_sq=0.0;
+
+	memset(st->observables,0,sizeof(struct cluster_observables_t)*2);
+	memset(&st->dual,0,sizeof(struct dual_statistics_t));
+
+	for(int c=0;c<MAX_NR_OF_LAYERS;c++)
+	{
+		st->strength1_by_layer[c]=0.0;
+		st->strength2_by_layer[c]=0.0;
+	}
+
+	for(int c=0;c<MAX_NR_OF_LAYERS*MAX_NR_OF_LAYERS;c++)
+	{
+		st->pbins[c]=0;
+	}
+
+	for(int c=0;c<MAX_NR_OF_LAYERS;c++)
+	{
+		st->ns[c]=0;
+	}
+
+#ifdef ML_INSTRUMENT
+	instrument_reset(&st->instr);
+#endif
+}
+
+static void cluster_observables_merge(struct cluster_observables_t *total,const struct cluster_observables_t *observables)
+{
+	for(int c=0;c<CLUSTER_NR_BINS;c++)
+	{
+		total->clusters[c]+=observables->clusters[c];
+		total->rg2[c]+=observables->rg2[c];
+	}
+
+	total->chi+=observables->chi;
+	total->chi_sq+=observables->chi_sq;
+	total->xi_num+=observables->xi_num;
+	total->xi_den+=observables->xi_den;
+}
+
+void add_stats(struct statistics_t *total,struct statistics_t *st)
+{
+	total->cntsingle+=st->cntsingle;
+	total->cntbilayer+=st->cntbilayer;
+
+	total->runs+=st->runs;
+	total->jumps_sq+=st->jumps_sq;
+	total->cpu_time+=st->cpu_time;
+	total->bonds+=st->bonds;
+	total->vbonds+=st->vbonds;
+
+	total->jumps+=st->jumps;
+	total->matches1+=st->matches1;
+	total->matches2+=st->matches2;
+
+	for(int c=0;c<MAX_NR_OF_LAYERS;c++)
+	{
+		total->matches1_by_layer[c]+=st->matches1_by_layer[c];
+		total->matches2_by_layer[c]+=st->matches2_by_layer[c];
+	}
+
+	total->nr_percolating1+=st->nr_percolating1;
+	total->nr_percolating2+=st->nr_percolating2;
+
+	for(int c=0;c<NR_OF_CROSSINGS;c++)
+	{
+		total->strength1[c]+=st->strength1[c];
+		total->strength2[c]+=st->strength2[c];
+	}
+
+	total->strength1_sq+=st->strength1_sq;
+	total->strength2_sq+=st->strength2_sq;
+
+	for(int c=0;c<2;c++)
+		cluster_observables_merge(&total->observables[c],&st->observables[c]);
+
+	total->dual.cntbilayer+=st->dual.cntbilayer;
+	total->dual.matches1+=st->dual.matches1;
+	total->dual.nr_percolating1+=st->dual.nr_percolating1;
+	total->dual.strength1_sq+=st->dual.strength1_sq;
+
+	for(int c=0;c<MAX_NR_OF_LAYERS;c++)
+	{
+		total->dual.matches1_by_layer[c]+=st->dual.matches1_by_layer[c];
+		total->dual.strength1_by_layer[c]+=st->dual.strength1_by_layer[c];
+	}
+
+	for(int c=0;c<NR_OF_CROSSINGS;c++)
+		total->dual.strength1[c]+=st->dual.strength1[c];
+
+	cluster_observables_merge(&total->dual.observables,&st->dual.observables);
+
+	for(int c=0;c<MAX_NR_OF_LAYERS;c++)
+	{
+		total->strength1_by_layer[c]+=st->strength1_by_layer[c];
+		total->strength2_by_layer[c]+=st->strength2_by_layer[c];
+	}
+
+	for(int c=0;c<MAX_NR_OF_LAYERS*MAX_NR_OF_LAYERS;c++)
+	{
+		total->pbins[c]+=st->pbins[c];
+	}
+
+	for(int c=0;c<MAX_NR_OF_LAYERS;c++)
+	{
+		total->ns[c]+=st->ns[c];
+	}
+
+#ifdef ML_INSTRUMENT
+	instrument_add(&total->instr,&st->instr);
+#endif
+}
+
+/*
+	A compact copy of the statistics, holding only the entries that can be non-zero
+	with the given configuration: a full statistics_t is sized for the largest
+	number of layers, and for bins which are only used when measuring jumps.
+*/
+
+static int stats_nr_bins(struct config_t *config)
+{
+	return (config->measure_jumps==true)?(ifactorial(config->nrlayers)):(0);
+}
+
+size_t stats_compact_size(struct config_t *config)
+{
+	size_t size=sizeof(double)*(6+2*NR_OF_CROSSINGS+2*config->nrlayers);
+
+	size+=sizeof(int)*(8+3*config->nrlayers+stats_nr_bins(config));
+
+	if(config->cluster_observables==true)
+		size+=sizeof(struct cluster_observables_t)*2;
+
+	if(config->dual_bc==true)
+	{
+		size+=sizeof(double)*(1+NR_OF_CROSSINGS+config->nrlayers);
+		size+=sizeof(int)*(3+config->nrlayers);
+
+		if(config->cluster_observables==true)
+			size+=sizeof(struct cluster_observables_t);
+	}
+
+#ifdef ML_INSTRUMENT
+	size+=sizeof(struct instrument_t);
+#endif
+
+	/*
+		Rounded up, so that compact copies can be stored one after the other.
+	*/
+
+	return ((size+sizeof(double)-1)/sizeof(double))*sizeof(double);
+}
+
+void stats_compact(struct config_t *config,struct statistics_t *st,void *buffer)
+{
+	double *dp=buffer;
+
+	*dp++=st->jumps_sq;
+	*dp++=st->cpu_time;
+	*dp++=st->bonds;
+	*dp++=st->vbonds;
+	*dp++=st->strength1_sq;
+	*dp++=st->strength2_sq;
+
+	memcpy(dp,st->strength1,sizeof(double)*NR_OF_CROSSINGS);
+	dp+=NR_OF_CROSSINGS;
+
+	memcpy(dp,st->strength2,sizeof(double)*NR_OF_CROSSINGS);
+	dp+=NR_OF_CROSSINGS;
+
+	memcpy(dp,st->strength1_by_layer,sizeof(double)*config->nrlayers);
+	dp+=config->nrlayers;
+
+	memcpy(dp,st->strength2_by_layer,sizeof(double)*config->nrlayers);
+	dp+=config->nrlayers;
+
+	if(config->cluster_observables==true)
+	{
+		memcpy(dp,st->observables,sizeof(struct cluster_observables_t)*2);
+		dp+=2*sizeof(struct cluster_observables_t)/sizeof(double);
+	}
+
+	if(config->dual_bc==true)
+	{
+		*dp++=st->dual.strength1_sq;
+
+		memcpy(dp,st->dual.strength1,sizeof(double)*NR_OF_CROSSINGS);
+		dp+=NR_OF_CROSSINGS;
+
+		memcpy(dp,st->dual.strength1_by_layer,sizeof(double)*config->nrlayers);
+		dp+=config->nrlayers;
+
+		if(config->cluster_observables==true)
+		{
+			memcpy(dp,&st->dual.observables,sizeof(struct cluster_observables_t));
+			dp+=sizeof(struct cluster_observables_t)/sizeof(double);
+		}
+	}
+
+#ifdef ML_INSTRUMENT
+	memcpy(dp,&st->instr,sizeof(struct instrument_t));
+	dp+=sizeof(struct instrument_t)/sizeof(double);
+#endif
+
+	int *ip=(int *)(dp);
+
+	*ip++=st->runs;
+	*ip++=st->cntsingle;
+	*ip++=st->cntbilayer;
+	*ip++=st->jumps;
+	*ip++=st->matches1;
+	*ip++=st->matches2;
+	*ip++=st->nr_percolating1;
+	*ip++=st->nr_percolating2;
+
+	memcpy(ip,st->matches1_by_layer,sizeof(int)*config->nrlayers);
+	ip+=config->nrlayers;
+
+	memcpy(ip,st->matches2_by_layer,sizeof(int)*config->nrlayers);
+	ip+=config->nrlayers;
+
+	memcpy(ip,st->ns,sizeof(int)*config->nrlayers);
+	ip+=config->nrlayers;
+
+	memcpy(ip,st->pbins,sizeof(int)*stats_nr_bins(config));
+	ip+=stats_nr_bins(config);
+
+	if(config->dual_bc==true)
+	{
+		*ip++=st->dual.cntbilayer;
+		*ip++=st->dual.matches1;
+		*ip++=st->dual.nr_percolating1;
+
+		memcpy(ip,st->dual.matches1_by_layer,sizeof(int)*config->nrlayers);
+	}
+}
+
+/*
+	The inverse of stats_compact(), entries not in the compact copy are set to zero.
+*/
+
+void stats_expand(struct config_t *config,const void *buffer,struct statistics_t *st)
+{
+	const double *dp=buffer;
+
+	reset_stats(st);
+
+	st->jumps_sq=*dp++;
+	st->cpu_time=*dp++;
+	st->bonds=*dp++;
+	st->vbonds=*dp++;
+	st->strength1_sq=*dp++;
+	st->strength2_sq=*dp++;
+
+	memcpy(st->strength1,dp,sizeof(double)*NR_OF_CROSSINGS);
+	dp+=NR_OF_CROSSINGS;
+
+	memcpy(st->strength2,dp,sizeof(double)*NR_OF_CROSSINGS);
+	dp+=NR_OF_CROSSINGS;
+
+	memcpy(st->strength1_by_layer,dp,sizeof(double)*config->nrlayers);
+	dp+=config->nrlayers;
+
+	memcpy(st->strength2_by_layer,dp,sizeof(double)*config->nrlayers);
+	dp+=config->nrlayers;
+
+	if(config->cluster_observables==true)
+	{
+		memcpy(st->observables,dp,sizeof(struct cluster_observables_t)*2);
+		dp+=2*sizeof(struct cluster_observables_t)/sizeof(double);
+	}
+
+	if(config->dual_bc==true)
+	{
+		st->dual.strength1_sq=*dp++;
+
+		memcpy(st->dual.strength1,dp,sizeof(double)*NR_OF_CROSSINGS);
+		dp+=NR_OF_CROSSINGS;
+
+		memcpy(st->dual.strength1_by_layer,dp,sizeof(double)*config->nrlayers);
+		dp+=config->nrlayers;
+
+		if(config->cluster_observables==true)
+		{
+			memcpy(&st->dual.observables,dp,sizeof(struct cluster_observables_t));
+			dp+=sizeof(struct cluster_observables_t)/sizeof(double);
+		}
+	}
+
+#ifdef ML_INSTRUMENT
+	memcpy(&st->instr,dp,sizeof(struct instrument_t));
+	dp+=sizeof(struct instrument_t)/sizeof(double);
+#endif
+
+	const int *ip=(const int *)(dp);
+
+	st->runs=*ip++;
+	st->cntsingle=*ip++;
+	st->cntbilayer=*ip++;
+	st->jumps=*ip++;
+	st->matches1=*ip++;
+	st->matches2=*ip++;
+	st->nr_percolating1=*ip++;
+	st->nr_percolating2=*ip++;
+
+	memcpy(st->matches1_by_layer,ip,sizeof(int)*config->nrlayers);
+	ip+=config->nrlayers;
+
+	memcpy(st->matches2_by_layer,ip,sizeof(int)*config->nrlayers);
+	ip+=config->nrlayers;
+
+	memcpy(st->ns,ip,sizeof(int)*config->nrlayers);
+	ip+=config->nrlayers;
+
+	memcpy(st->pbins,ip,sizeof(int)*stats_nr_bins(config));
+	ip+=stats_nr_bins(config);
+
+	if(config->dual_bc==true)
+	{
+		st->dual.cntbilayer=*ip++;
+		st->dual.matches1=*ip++;
+		st->dual.nr_percolating1=*ip++;
+
+		memcpy(st->dual.matches1_by_layer,ip,sizeof(int)*config->nrlayers);
+	}
+}
+
+/*
+	Updates the percolation counters according to the result of do_run(),
+	'st' being the statistics of that single run.
+*/
+
+void count_percolation(struct statistics_t *st,int result)
+{
+	st->runs++;
+	st->jumps_sq+=((double)(st->jumps))*((double)(st->jumps));
+	st->strength1_sq+=st->strength1[CROSSING_EITHER]*st->strength1[CROSSING_EITHER];
+	st->strength2_sq+=st->strength2[CROSSING_EITHER]*st->strength2[CROSSING_EITHER];
+
+	for(int c=0;c<2;c++)
+		st->observables[c].chi_sq+=st->observables[c].chi*st->observables[c].chi;
+
+	st->dual.strength1_sq+=st->dual.strength1[CROSSING_EITHER]*st->dual.strength1[CROSSING_EITHER];
+	st->dual.observables.chi_sq+=st->dual.observables.chi*st->dual.observables.chi;
+
+	switch(result)
+	{
+		case 0:
+		break;
+
+		case TWO_LAYER_PERCOLATION:
+		st->cntbilayer++;
+		break;
+
+		case SINGLE_LAYER_PERCOLATION:
+		st->cntsingle++;
+		break;
+
+		case SINGLE_LAYER_PERCOLATION|TWO_LAYER_PERCOLATION:
+		st->cntbilayer++;
+		st->cntsingle++;
+		break;
+	}
+}
+
+/*
+	Exchanges the statistics on clusters spanning more than one layer with
+	those kept for the other boundary condition along z, see analyze_bonds().
+*/
+
+void stats_swap_dual(struct statistics_t *st)
+{
+	struct dual_statistics_t other=st->dual;
+
+	st->dual.cntbilayer=st->cntbilayer;
+	st->dual.matches1=st->matches1;
+	st->dual.nr_percolating1=st->nr_percolating1;
+	st->dual.strength1_sq=st->strength1_sq;
+	st->dual.observables=st->observables[0];
+	memcpy(st->dual.matches1_by_layer,st->matches1_by_layer,sizeof(int)*MAX_NR_OF_LAYERS);
+	memcpy(st->dual.strength1,st->strength1,sizeof(double)*NR_OF_CROSSINGS);
+	memcpy(st->dual.strength1_by_layer,st->strength1_by_layer,sizeof(double)*MAX_NR_OF_LAYERS);
+
+	st->cntbilayer=other.cntbilayer;
+	st->matches1=other.matches1;
+	st->nr_percolating1=other.nr_percolating1;
+	st->strength1_sq=other.strength1_sq;
+	st->observables[0]=other.observables;
+	memcpy(st->matches1_by_layer,other.matches1_by_layer,sizeof(int)*MAX_NR_OF_LAYERS);
+	memcpy(st->strength1,other.strength1,sizeof(double)*NR_OF_CROSSINGS);
+	memcpy(st->strength1_by_layer,other.strength1_by_layer,sizeof(double)*MAX_NR_OF_LAYERS);
+}
+
+/*
+	Stopping rule for adaptive sampling: a point is done when the standard errors
+	on both spanning probabilities, multiplied by 'confidence_z', are smaller than
+	'target_error'. The same holds for the relative error on the mean jumps, if
+	they are being measured.
+
+	The spanning probabilities are estimated as (k+1)/(n+2) for the purpose of
+	computing their error, so that a point deep into one of the two phases,
+	where all the runs give the same result, is not considered exact.
+*/
+
+static double binomial_error(int k,int n)
+{
+	double p=(k+1.0)/(n+2.0);
+
+	return sqrt(p*(1.0-p)/n);
+}
+
+bool point_converged(struct config_t *config,struct statistics_t *total)
+{
+	int n=total->runs;
+
+	if(n<MAX(config->min_runs,2))
+		return false;
+
+	if(n>=config->max_runs)
+		return true;
+
+	double target=config->target_error/config->confidence_z;
+
+	if(binomial_error(total->cntbilayer,n)>target)
+		return false;
+
+	if(binomial_error(total->cntsingle,n)>target)
+		return false;
+
+	if(config->measure_jumps==true)
+	{
+		double mean=((double)(total->jumps))/n;
+		double variance=(total->jumps_sq-n*mean*mean)/(n-1);
+
+		if((mean>0.0)&&(sqrt(MAX(variance,0.0)/n)>target*mean))
+			return false;
+	}
+
+	return true;
+}
+
+/*
+	The vertical bonds joining the last and the first layer are drawn with
+	periodic boundary conditions along z, and when evaluating both boundary
+	conditions, but in the latter case the lattice is labeled with open
+	boundary conditions, and those bonds are only added afterwards, see
+	analyze_bonds().
+*/
+
+static bool lattice_wrapped(struct config_t *config)
+{
+	return (config->pbcz==true)||(config->dual_bc==true);
+}
+
+static bool labeling_pbcz(struct config_t *config)
+{
+	return (config->dual_bc==true)?(false):(config->pbcz);
+}
+
+/*
+	Allocation of a lattice along with its bonds, optionally in an arena.
+*/
+
+struct nclusters_t *lattice_init(struct config_t *config,struct arena_t *arena)
+{
+	int xdim=config->xdim;
+	int ydim=config->ydim;
+	int zdim=config->nrlayers;
+
+	struct nclusters_t *ncs=nclusters_init_in(arena,xdim,ydim,zdim);
+	assert(ncs);
+
+	for(int z=0;z<zdim;z++)
+	{
+		ncs->bonds[z]=ibond2d_init_in(arena,xdim,ydim);
+		assert(ncs->bonds[z]);
+	}
+
+	for(int z=0;z<zdim;z++)
+	{
+		/*
+			If we do not have periodic boundary conditions in the z direction,
+			then there are no vertical bonds joining the last and the first layer.
+		*/
+
+		if((z==(zdim-1))&&(lattice_wrapped(config)==false))
+		{
+			ncs->ivbonds[z]=NULL;
+			continue;
+		}
+
+		ncs->ivbonds[z]=ivbond2d_init_in(arena,xdim,ydim);
+		assert(ncs->ivbonds[z]);
+	}
+
+	if(config->specialized_kernels==true)
+		ncs->kernel=nclusters_select_kernel(xdim,ydim,zdim,labeling_pbcz(config));
+
+	return ncs;
+}
+
+/*
+	The memory taken by lattice_init(), without allocating it.
+*/
+
+void lattice_estimate(struct config_t *config,struct arena_estimate_t *estimate)
+{
+	int xdim=config->xdim;
+	int ydim=config->ydim;
+	int zdim=config->nrlayers;
+
+	nclusters_estimate(estimate,xdim,ydim,zdim);
+
+	for(int z=0;z<zdim;z++)
+	{
+		arena_estimate_malloc(estimate,sizeof(struct ibond2d_t));
+		arena_estimate_alloc(estimate,sizeof(int)*xdim*ydim);
+		arena_estimate_alloc(estimate,sizeof(int)*xdim*ydim);
+	}
+
+	for(int z=0;z<zdim;z++)
+	{
+		if((z==(zdim-1))&&(lattice_wrapped(config)==false))
+			continue;
+
+		arena_estimate_malloc(estimate,sizeof(struct ivbond2d_t));
+		arena_estimate_alloc(estimate,sizeof(int)*xdim*ydim);
+	}
+}
+
+void lattice_fini(struct nclusters_t *ncs)
+{
+	for(int z=0;z<ncs->nrlayers;z++)
+	{
+		ibond2d_fini(ncs->bonds[z]);
+		ivbond2d_fini(ncs->ivbonds[z]);
+	}
+
+	nclusters_fini(ncs);
+}
+
+/*
+	Both boundary conditions along z from a single sample: the lattice is labeled
+	with open boundary conditions, then the clusters joined by the bonds between
+	the last and the first layer are merged, see nclusters_identify_percolation_wrapped(),
+	which gives the same clusters as labeling with periodic boundary conditions,
+	for the price of a pass over the labels. The same random sites are tested with
+	both boundary conditions, and no other random numbers are drawn. The statistics
+	for 'pbcz' are left in the usual fields, those for the other one in stat->dual.
+
+	Returns the number of percolating clusters with 'pbcz'.
+*/
+
+static int analyze_dual(struct config_t *config,struct nclusters_t *ncs,gsl_rng *rng,struct statistics_t *stat)
+{
+	assert(config->measure_jumps==false);
+	assert(ncs->ws);
+
+	int nr_open=nclusters_identify_percolation(ncs,NULL,stat,1,rng,false);
+
+	stats_swap_dual(stat);
+
+	int nr_periodic=nclusters_identify_percolation_wrapped(ncs,stat,1);
+
+	if(config->pbcz==false)
+		stats_swap_dual(stat);
+
+	stat->nr_percolating1=(config->pbcz==true)?(nr_periodic):(nr_open);
+	stat->dual.nr_percolating1=(config->pbcz==true)?(nr_open):(nr_periodic);
+	stat->dual.cntbilayer=(stat->dual.nr_percolating1>0)?(1):(0);
+
+	return stat->nr_percolating1;
+}
+
+/*
+	The random bonds are created...
+*/
+
+void generate_bonds(struct config_t *config,struct nclusters_t *ncs,double p,double pperp,gsl_rng *rng)
+{
+	int xdim=config->xdim;
+	int ydim=config->ydim;
+	int zdim=config->nrlayers;
+
+	INSTR_START(t0);
+
+	/*
+		The bonds going out of the lattice, along x and y, are drawn but never
+		used, so they are not counted.
+	*/
+
+	int bonds=0,vbonds=0,wrap_vbonds=0;
+
+	for(int z=0;z<zdim;z++)
+	{
+		for(int x=0;x<xdim;x++)
+		{
+			for(int y=0;y<ydim;y++)
+			{
+				int bx=get_random_value(p,rng);
+				int by=get_random_value(p,rng);
+
+				ibond2d_set_value(ncs->bonds[z],x,y,DIR_X,bx);
+				ibond2d_set_value(ncs->bonds[z],x,y,DIR_Y,by);
+
+				bonds+=((x<xdim-1)?(bx):(0))+((y<ydim-1)?(by):(0));
+			}
+		}
+	}
+
+	for(int z=0;z<zdim;z++)
+	{
+		if((z==(zdim-1))&&(lattice_wrapped(config)==false))
+			continue;
+
+		for(int x=0;x<xdim;x++)
+		{
+			for(int y=0;y<ydim;y++)
+			{
+				int bz=get_random_value(pperp,rng);
+
+				ivbond2d_set_value(ncs->ivbonds[z],x,y,bz);
+				vbonds+=bz;
+
+				if(z==(zdim-1))
+					wrap_vbonds+=bz;
+			}
+		}
+	}
+
+	ncs->nr_bonds=bonds;
+	ncs->nr_vbonds=vbonds;
+	ncs->nr_wrap_vbonds=wrap_vbonds;
+
+	/*
+		The bonds may be labeled by another thread, see pipeline.c, so the
+		time is kept with them, like their number.
+	*/
+
+	INSTR_ELAPSED(ncs->generate,t0);
+}
+
+/*
+	...and then the clusters are identified and measured.
+*/
+
+int analyze_bonds(struct config_t *config,struct nclusters_t *ncs,gsl_rng *rng,struct statistics_t *stat)
+{
+	int xdim=config->xdim;
+	int ydim=config->ydim;
+	int zdim=config->nrlayers;
+
+	int result=0;
+
+	/*
+		First: clusters that can span more than one layer.
+	*/
+
+	int *pjumps=(config->measure_jumps==true)?(&stat->jumps):(NULL);
+
+	stat->bonds=ncs->nr_bonds;
+	stat->vbonds=ncs->nr_vbonds-((config->pbcz==false)?(ncs->nr_wrap_vbonds):(0));
+
+	INSTR_RESET();
+	INSTR_ADD(INSTR_GENERATE,ncs->generate);
+	INSTR_START(t1);
+
+	if(config->dual_bc==true)
+	{
+		if(analyze_dual(config,ncs,rng,stat)>0)
+			result|=TWO_LAYER_PERCOLATION;
+	}
+	else if((stat->nr_percolating1=nclusters_identify_percolation(ncs,pjumps,stat,1,rng,config->pbcz))>0)
+	{
+		result|=TWO_LAYER_PERCOLATION;
+	}
+
+	INSTR_STOP(INSTR_LABEL1,t1);
+
+	/*
+		Second: the vertical links are removed, so that now we look for
+		percolation of clusters living only a single layer.
+	*/
+
+	INSTR_START(t2);
+
+	for(int z=0;z<zdim;z++)
+	{
+		if((z==(zdim-1))&&(labeling_pbcz(config)==false))
+			continue;
+
+		for(int x=0;x<xdim;x++)
+			for(int y=0;y<ydim;y++)
+				ivbond2d_set_value(ncs->ivbonds[z], x, y, 0);
+	}
+
+	INSTR_STOP(INSTR_CLEAR,t2);
+	INSTR_START(t3);
+
+	if((stat->nr_percolating2=nclusters_identify_percolation(ncs,NULL,stat,2,rng,labeling_pbcz(config)))>0)
+		result|=SINGLE_LAYER_PERCOLATION;
+
+	INSTR_STOP(INSTR_LABEL2,t3);
+	INSTR_COLLECT(stat);
+
+	return result;
+}
+
+/*
+	A single run, using the memory owned by the simulation context.
+*/
+
+int do_run(struct simulation_ctx_t *ctx,struct config_t *config,double p,double pperp,gsl_rng *rng,struct statistics_t *stat)
+{
+	int result=0;
+
+	assert(simulation_ctx_matches(ctx,config));
+
+	if(config->engine==ENGINE_FUSED)
+	{
+		assert(config->measure_jumps==false);
+
+		INSTR_RESET();
+		INSTR_START(t0);
+
+		if(ctx->replay==NULL)
+		{
+			ctx->replay=gsl_rng_clone(rng);
+			assert(ctx->replay);
+		}
+
+		nclusters_identify_percolation_fused(ctx->ncs,p,pperp,stat,rng,ctx->replay,config->pbcz);
+
+		INSTR_STOP(INSTR_LABEL1,t0);
+		INSTR_COLLECT(stat);
+
+		if(stat->nr_percolating1>0)
+			result|=TWO_LAYER_PERCOLATION;
+
+		if(stat->nr_percolating2>0)
+			result|=SINGLE_LAYER_PERCOLATION;
+
+		return result;
+	}
+
+	generate_bonds(config,ctx->ncs,p,pperp,rng);
+
+	return analyze_bonds(config,ctx->ncs,rng,stat);
+}
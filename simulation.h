@@ -0,0 +1,190 @@
+#ifndef __SIMULATION_H__
+#define __SIMULATION_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <gsl/gsl_rng.h>
+
+#include "clusters.h"
+
+struct evlog_t;
+struct worker_stats_t;
+
+/*
+	Engines, i.e. different ways of performing a single run.
+
+	ENGINE_REFERENCE: the bonds are stored in memory, then labeled twice
+	(with and without vertical bonds).
+
+	ENGINE_FUSED: the bonds are drawn on the fly during the labeling sweeps,
+	and never stored: the RNG is saved before the first sweep, and the same
+	bonds are drawn again for the second one. It can be used only when jumps
+	are not measured.
+*/
+
+#define ENGINE_REFERENCE	(0)
+#define ENGINE_FUSED		(1)
+
+struct config_t
+{
+	int total_runs;
+	int xdim,ydim,nrlayers;
+
+	bool measure_jumps;
+	bool pbcz;
+
+	/*
+		Evaluate each sample with both open and periodic boundary conditions
+		along z, see analyze_bonds(): 'pbcz' chooses which one goes to the main
+		outputs, the other one goes to the twin outputs, see batch.c.
+	*/
+
+	bool dual_bc;
+
+	int engine;
+
+	/*
+		Measure the size distribution, the mean size and the radii of gyration
+		of the finite clusters, while normalizing the labels, see clusters.h.
+	*/
+
+	bool cluster_observables;
+
+	/*
+		Place the lattices and label tables on huge pages, whenever possible.
+	*/
+
+	bool hugepages;
+
+	/*
+		Pin each worker thread to a CPU, so that it stays close to its memory.
+		Off by default: the workers are always pinned starting from the first
+		allowed CPU, so two processes sharing a node would share the same CPUs.
+	*/
+
+	bool pin_threads;
+
+	/*
+		Label with the kernels compiled for a fixed number of layers, see
+		hk_kernel.h, when one is available for the geometry being simulated.
+	*/
+
+	bool specialized_kernels;
+
+	/*
+		Pipelined execution: generator threads fill lattices with random
+		bonds, analysis threads label them. A value of 0 means 'automatic'.
+	*/
+
+	bool pipelined;
+	int nr_generators,nr_analyzers,nr_buffers;
+
+	/*
+		Otherwise, the points are split into tasks by the work-stealing scheduler,
+		see scheduler.c, running 'nr_workers' threads (0 meaning one per CPU), or,
+		if 'scheduler' is false, distributed by an OpenMP parallel loop, over
+		'nr_workers' threads (0 meaning the OpenMP default).
+	*/
+
+	bool scheduler;
+	int nr_workers;
+
+	/*
+		Adaptive sampling: instead of 'total_runs' runs, each point gets between
+		'min_runs' and 'max_runs' runs, stopping as soon as the statistical errors
+		are below 'target_error', see point_converged(). A 'confidence_z' of 1
+		makes the target a standard error, 1.96 the half-width of a 95% interval.
+	*/
+
+	bool adaptive;
+	int min_runs,max_runs;
+	double target_error,confidence_z;
+
+	/*
+		Grid refinement: the grid above is only the coarsest level, and the
+		intervals where a spanning probability enters [refine_low, refine_high]
+		are bisected, at most 'refine_levels' times, see refine.c.
+	*/
+
+	bool refine;
+	int refine_levels;
+	double refine_low,refine_high;
+
+	/*
+		Compute budget, in seconds of wall-clock time: when positive, the number
+		of runs at each point is chosen so as to minimize the overall statistical
+		error within the budget, see budget.c.
+	*/
+
+	double budget;
+
+	/*
+		Memory budget, in MB: when positive, the worker threads are capped,
+		or the batch is moved to a leaner engine, so that all the simulation
+		contexts fit in it, see governor.c.
+	*/
+
+	double memory_budget;
+
+	int minmillipperp,maxmillipperp,incmillipperp;
+	int minmillip,maxmillip,incmillip;
+
+	/*
+		Optionally, explicit lists of values replacing the grid above, along
+		either direction: the points are then all their combinations.
+	*/
+
+	double *ps,*pperps;
+	int nr_ps,nr_pperps;
+
+	/*
+		Save every single run to the binary event log, see evlog.c, which
+		is opened along with the output files, in 'evlog'.
+	*/
+
+	bool event_log;
+	struct evlog_t *evlog;
+
+	/*
+		If not NULL, the executors copy there the statistics of their
+		workers when they are done, one entry per worker.
+	*/
+
+	struct worker_stats_t *worker_stats;
+
+	bool verbose;
+};
+
+#define TWO_LAYER_PERCOLATION		(1)
+#define SINGLE_LAYER_PERCOLATION	(2)
+
+void config_defaults(struct config_t *config);
+
+double get_time(void);
+int ifactorial(int n);
+
+void seed_rng(gsl_rng *rng);
+int get_random_value(double p,gsl_rng *rng_ctx);
+
+void reset_stats(struct statistics_t *st);
+void add_stats(struct statistics_t *total,struct statistics_t *st);
+void count_percolation(struct statistics_t *st,int result);
+void stats_swap_dual(struct statistics_t *st);
+bool point_converged(struct config_t *config,struct statistics_t *total);
+
+size_t stats_compact_size(struct config_t *config);
+void stats_compact(struct config_t *config,struct statistics_t *st,void *buffer);
+void stats_expand(struct config_t *config,const void *buffer,struct statistics_t *st);
+
+struct nclusters_t *lattice_init(struct config_t *config,struct arena_t *arena);
+void lattice_fini(struct nclusters_t *ncs);
+void lattice_estimate(struct config_t *config,struct arena_estimate_t *estimate);
+void generate_bonds(struct config_t *config,struct nclusters_t *ncs,double p,double pperp,gsl_rng *rng);
+int analyze_bonds(struct config_t *config,struct nclusters_t *ncs,gsl_rng *rng,struct statistics_t *stat);
+
+struct simulation_ctx_t;
+
+int do_run(struct simulation_ctx_t *ctx,struct config_t *config,double p,double pperp,gsl_rng *rng,struct statistics_t *stat);
+
+#endif //__SIMULATION_H__
@@ -0,0 +1,144 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "common.h"
+#include "simulation.h"
+#include "pipeline.h"
+#include "store.h"
+
+/*
+	A content-addressed store of results: a directory with a file for every point
+	ever simulated, named after a hash of the physical configuration, holding the
+	raw sums of the statistics (in the compact form, see stats_compact()) rather
+	than the averages, so that more runs can always be added.
+
+	A batch using the store starts each point from what is there, and only runs
+	the samples that are missing, see do_batches(); the file is then replaced
+	with the new totals.
+*/
+
+#define STORE_MAGIC	"MLSTORE1"
+
+/*
+	What identifies a point: p and pperp are rounded, so that the same values
+	coming from a grid or from a list give the same key.
+*/
+
+struct store_key_t
+{
+	int32_t xdim,ydim,nrlayers;
+	int32_t pbcz,measure_jumps,engine;
+	int64_t nanop,nanopperp;
+	uint64_t size;
+};
+
+static void store_key(struct config_t *config,struct point_t *point,struct store_key_t *key)
+{
+	memset(key,0,sizeof(struct store_key_t));
+
+	key->xdim=config->xdim;
+	key->ydim=config->ydim;
+	key->nrlayers=config->nrlayers;
+	key->pbcz=config->pbcz;
+	key->measure_jumps=config->measure_jumps;
+	key->engine=config->engine;
+	key->nanop=llround(1e9*point->p);
+	key->nanopperp=llround(1e9*point->pperp);
+	key->size=stats_compact_size(config);
+}
+
+static void store_filename(const char *path,struct store_key_t *key,char *filename,size_t length)
+{
+	uint64_t hash=fnv_add(FNV_OFFSET_BASIS,key,sizeof(struct store_key_t));
+
+	snprintf(filename,length,"%s/%016" PRIx64 ".bin",path,hash);
+}
+
+bool store_init(const char *path)
+{
+	if((mkdir(path,0777)!=0)&&(errno!=EEXIST))
+	{
+		fprintf(stderr,"Couldn't create the result store %s\n",path);
+		return false;
+	}
+
+	return true;
+}
+
+/*
+	Loads the raw sums for a point into 'total', a buffer of stats_compact_size()
+	bytes, returning false if the point is not in the store.
+*/
+
+bool store_load(const char *path,struct config_t *config,struct point_t *point,void *total)
+{
+	struct store_key_t key,saved_key;
+	char filename[1024],magic[8];
+
+	store_key(config,point,&key);
+	store_filename(path,&key,filename,1024);
+
+	FILE *in=fopen(filename,"rb");
+
+	if(!in)
+		return false;
+
+	bool ok=(fread(magic,8,1,in)==1)&&(memcmp(magic,STORE_MAGIC,8)==0)&&
+	        (fread(&saved_key,sizeof(struct store_key_t),1,in)==1)&&
+	        (memcmp(&key,&saved_key,sizeof(struct store_key_t))==0)&&
+	        (fread(total,key.size,1,in)==1);
+
+	fclose(in);
+
+	if(ok==false)
+		fprintf(stderr,"Warning: ignoring %s, which is either corrupted or a hash collision.\n",filename);
+
+	return ok;
+}
+
+/*
+	Replaces the entry for a point: the file is written under a temporary name
+	first, so that other processes never see it half written.
+*/
+
+bool store_save(const char *path,struct config_t *config,struct point_t *point,const void *total)
+{
+	struct store_key_t key;
+	char filename[1024],tmpfile[1100];
+
+	store_key(config,point,&key);
+	store_filename(path,&key,filename,1024);
+	snprintf(tmpfile,1100,"%s.%ld.tmp",filename,(long)(getpid()));
+
+	FILE *out=fopen(tmpfile,"wb");
+
+	if(!out)
+	{
+		fprintf(stderr,"Warning: couldn't write to the result store %s\n",path);
+		return false;
+	}
+
+	bool ok=(fwrite(STORE_MAGIC,8,1,out)==1)&&
+	        (fwrite(&key,sizeof(struct store_key_t),1,out)==1)&&
+	        (fwrite(total,key.size,1,out)==1);
+
+	if(fclose(out)!=0)
+		ok=false;
+
+	if((ok==false)||(rename(tmpfile,filename)!=0))
+	{
+		fprintf(stderr,"Warning: couldn't write %s\n",filename);
+		remove(tmpfile);
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,13 @@
+#ifndef __STORE_H__
+#define __STORE_H__
+
+#include <stdbool.h>
+
+#include "simulation.h"
+#include "pipeline.h"
+
+bool store_init(const char *path);
+bool store_load(const char *path,struct config_t *config,struct point_t *point,void *total);
+bool store_save(const char *path,struct config_t *config,struct point_t *point,const void *total);
+
+#endif //__STORE_H__
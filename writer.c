@@ -0,0 +1,384 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <sched.h>
+
+#include "common.h"
+#include "clusters.h"
+#include "simulation.h"
+#include "batch.h"
+#include "store.h"
+#include "writer.h"
+
+/*
+	The output writer: the workers hand over the finished points, and a
+	dedicated thread formats them, writes them to the output files and saves
+	them to the result store, so that the workers never wait on I/O.
+
+	Handing over a point is wait-free: the item is linked to the end of a
+	multiple-producer, single-consumer queue (Vyukov's intrusive queue) with
+	a single atomic exchange, and the writer thread is woken up through a
+	semaphore. The output files are fully buffered, see batch.c, and flushed
+	whenever the queue is empty: the rows are written in large blocks, but
+	still end up in the files as soon as the writer has nothing else to do.
+
+	The rows of a grid are written in the order of the points, whatever the
+	order in which they are done, so that the output files are the same at
+	every run.
+*/
+
+static void writer_push(struct writer_t *writer,struct writer_item_t *item)
+{
+	atomic_store_explicit(&item->next,NULL,memory_order_relaxed);
+
+	struct writer_item_t *prev=atomic_exchange_explicit(&writer->head,item,memory_order_acq_rel);
+	atomic_store_explicit(&prev->next,item,memory_order_release);
+
+	sem_post(&writer->nr_items);
+}
+
+/*
+	Returns NULL if the next item has been pushed, but not linked to the list yet.
+*/
+
+static struct writer_item_t *writer_try_pop(struct writer_t *writer)
+{
+	struct writer_item_t *tail=writer->tail;
+	struct writer_item_t *next=atomic_load_explicit(&tail->next,memory_order_acquire);
+
+	if(tail==&writer->stub)
+	{
+		if(next==NULL)
+			return NULL;
+
+		writer->tail=next;
+		tail=next;
+		next=atomic_load_explicit(&next->next,memory_order_acquire);
+	}
+
+	if(next!=NULL)
+	{
+		writer->tail=next;
+		return tail;
+	}
+
+	if(tail!=atomic_load_explicit(&writer->head,memory_order_acquire))
+		return NULL;
+
+	/*
+		The last item is about to be taken: the stub goes back to the end of the list.
+	*/
+
+	atomic_store_explicit(&writer->stub.next,NULL,memory_order_relaxed);
+
+	struct writer_item_t *prev=atomic_exchange_explicit(&writer->head,&writer->stub,memory_order_acq_rel);
+	atomic_store_explicit(&prev->next,&writer->stub,memory_order_release);
+
+	next=atomic_load_explicit(&tail->next,memory_order_acquire);
+
+	if(next!=NULL)
+	{
+		writer->tail=next;
+		return tail;
+	}
+
+	return NULL;
+}
+
+static void writer_flush(struct writer_t *writer)
+{
+	while(writer->dirty!=NULL)
+	{
+		struct writer_stream_t *stream=writer->dirty;
+
+		fflush(stream->outputs->out);
+
+		if(stream->outputs->out2)
+			fflush(stream->outputs->out2);
+
+		if(stream->outputs->out3)
+			fflush(stream->outputs->out3);
+
+		if(stream->outputs->out4)
+			fflush(stream->outputs->out4);
+
+		if(stream->outputs->out5)
+			fflush(stream->outputs->out5);
+
+		if(stream->outputs->out6)
+			fflush(stream->outputs->out6);
+
+#ifdef ML_INSTRUMENT
+		if(stream->outputs->instr)
+			fflush(stream->outputs->instr);
+#endif
+
+		stream->dirty=false;
+		writer->dirty=stream->next_dirty;
+	}
+}
+
+/*
+	Waits for the next item, flushing the files first if there is none.
+*/
+
+static struct writer_item_t *writer_pop(struct writer_t *writer)
+{
+	if(sem_trywait(&writer->nr_items)!=0)
+	{
+		writer_flush(writer);
+
+		while(sem_wait(&writer->nr_items)!=0);
+	}
+
+	/*
+		The item has been counted, so it will be linked very soon.
+	*/
+
+	struct writer_item_t *ret;
+
+	while((ret=writer_try_pop(writer))==NULL)
+		sched_yield();
+
+	return ret;
+}
+
+static void writer_free_item(struct writer_item_t *item)
+{
+	if(item->total)
+		free(item->total);
+
+	free(item);
+}
+
+static void writer_emit(struct writer_t *writer,struct writer_item_t *item)
+{
+	struct writer_stream_t *stream=item->stream;
+
+	stats_expand(stream->config,item->total,writer->scratch);
+	write_point(stream->config,stream->outputs,item->point.p,item->point.pperp,writer->scratch);
+
+	if(stream->dirty==false)
+	{
+		stream->dirty=true;
+		stream->next_dirty=writer->dirty;
+		writer->dirty=stream;
+	}
+}
+
+static void writer_process(struct writer_t *writer,struct writer_item_t *item)
+{
+	struct writer_stream_t *stream=item->stream;
+
+	if((item->store!=NULL)&&(store_save(item->store,stream->config,&item->point,item->total)==false))
+		fprintf(stderr,"Warning: couldn't write to the result store %s\n",item->store);
+
+	if(stream->nr_points<=0)
+	{
+		writer_emit(writer,item);
+		writer_free_item(item);
+		return;
+	}
+
+	assert((item->index>=0)&&(item->index<stream->nr_points));
+	assert(stream->held[item->index]==NULL);
+
+	stream->held[item->index]=item;
+
+	while((stream->next<stream->nr_points)&&
+	      ((stream->held[stream->next]!=NULL)||(stream->skipped[stream->next]==true)))
+	{
+		struct writer_item_t *next=stream->held[stream->next];
+
+		if(next!=NULL)
+		{
+			writer_emit(writer,next);
+			writer_free_item(next);
+			stream->held[stream->next]=NULL;
+		}
+
+		stream->next++;
+	}
+}
+
+static void *writer_thread(void *arg)
+{
+	struct writer_t *writer=arg;
+
+	while(true)
+	{
+		struct writer_item_t *item=writer_pop(writer);
+
+		if(item->stream!=NULL)
+		{
+			writer_process(writer,item);
+			continue;
+		}
+
+		if(item->synced!=NULL)
+		{
+			writer_flush(writer);
+			sem_post(item->synced);
+			writer_free_item(item);
+			continue;
+		}
+
+		writer_free_item(item);
+		break;
+	}
+
+	return NULL;
+}
+
+static struct writer_item_t *writer_new_item(void)
+{
+	struct writer_item_t *ret=malloc(sizeof(struct writer_item_t));
+	assert(ret);
+
+	ret->stream=NULL;
+	ret->index=0;
+	ret->total=NULL;
+	ret->store=NULL;
+	ret->synced=NULL;
+
+	return ret;
+}
+
+struct writer_t *writer_init(void)
+{
+	struct writer_t *ret=malloc(sizeof(struct writer_t));
+	assert(ret);
+
+	atomic_store(&ret->stub.next,NULL);
+	atomic_store(&ret->head,&ret->stub);
+	ret->tail=&ret->stub;
+
+	ret->dirty=NULL;
+	ret->scratch=malloc(sizeof(struct statistics_t));
+	assert(ret->scratch);
+
+	sem_init(&ret->nr_items,0,0);
+	pthread_create(&ret->thread,NULL,writer_thread,ret);
+
+	return ret;
+}
+
+/*
+	Writes out everything that has been submitted, and stops the writer thread.
+*/
+
+void writer_fini(struct writer_t *writer)
+{
+	writer_push(writer,writer_new_item());
+	pthread_join(writer->thread,NULL);
+
+	sem_destroy(&writer->nr_items);
+
+	if(writer->scratch)
+		free(writer->scratch);
+
+	free(writer);
+}
+
+struct writer_stream_t *writer_stream_open(struct writer_t *writer,struct config_t *config,struct outputs_t *outputs,int nr_points)
+{
+	struct writer_stream_t *ret=malloc(sizeof(struct writer_stream_t));
+	assert(ret);
+
+	ret->writer=writer;
+	ret->config=config;
+	ret->outputs=outputs;
+	ret->nr_points=nr_points;
+	ret->next=0;
+	ret->held=calloc(MAX(nr_points,1),sizeof(struct writer_item_t *));
+	ret->skipped=calloc(MAX(nr_points,1),sizeof(bool));
+	ret->dirty=false;
+	ret->next_dirty=NULL;
+	assert(ret->held&&ret->skipped);
+
+	return ret;
+}
+
+/*
+	Marks a point that will never be submitted, e.g. because it has been written
+	already by a previous execution. To be called before submitting any point.
+*/
+
+void writer_stream_skip(struct writer_stream_t *stream,int index)
+{
+	if((index>=0)&&(index<stream->nr_points))
+		stream->skipped[index]=true;
+}
+
+/*
+	To be called after writer_sync(), the points still held are dropped.
+*/
+
+void writer_stream_close(struct writer_stream_t *stream)
+{
+	for(int c=0;c<stream->nr_points;c++)
+		if(stream->held[c])
+			writer_free_item(stream->held[c]);
+
+	if(stream->held)
+		free(stream->held);
+
+	if(stream->skipped)
+		free(stream->skipped);
+
+	free(stream);
+}
+
+/*
+	Hands over a finished point: 'total' is copied, and the call never blocks.
+*/
+
+void writer_submit(struct writer_stream_t *stream,int index,struct point_t *point,struct statistics_t *total,const char *store)
+{
+	struct writer_item_t *item=writer_new_item();
+
+	item->stream=stream;
+	item->index=index;
+	item->point=*point;
+	item->store=store;
+	item->total=malloc(stats_compact_size(stream->config));
+	assert(item->total);
+
+	stats_compact(stream->config,total,item->total);
+
+	writer_push(stream->writer,item);
+}
+
+/*
+	Waits until everything submitted so far has been processed, and the files
+	flushed: unless more points are submitted, the writer thread stays idle.
+*/
+
+void writer_sync(struct writer_t *writer)
+{
+	sem_t synced;
+	sem_init(&synced,0,0);
+
+	struct writer_item_t *item=writer_new_item();
+	item->synced=&synced;
+
+	writer_push(writer,item);
+
+	while(sem_wait(&synced)!=0);
+
+	sem_destroy(&synced);
+}
+
+/*
+	The compact statistics of a point that is done, but not written yet because
+	it is waiting for the ones before it, or NULL. Only valid after writer_sync().
+*/
+
+const char *writer_held(struct writer_stream_t *stream,int index)
+{
+	if((index<0)||(index>=stream->nr_points)||(stream->held[index]==NULL))
+		return NULL;
+
+	return stream->held[index]->total;
+}
@@ -0,0 +1,94 @@
+#ifndef __WRITER_H__
+#define __WRITER_H__
+
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+#include "clusters.h"
+#include "simulation.h"
+#include "pipeline.h"
+
+struct outputs_t;
+
+/*
+	The output writer, see writer.c.
+*/
+
+struct writer_item_t
+{
+	_Atomic(struct writer_item_t *) next;
+
+	/*
+		A finished point, with its statistics in compact form, to be saved
+		to 'store' too, if not NULL. Without a stream, the item is either a
+		request to flush everything, if 'synced' is not NULL, or to quit.
+	*/
+
+	struct writer_stream_t *stream;
+	int index;
+	struct point_t point;
+	char *total;
+	const char *store;
+
+	sem_t *synced;
+};
+
+/*
+	The output files of a batch, and the points not written yet: with 'nr_points'
+	positive, the rows are written in the order of their indices, the points
+	arriving early are held until the ones before them are written, and the
+	points in 'skipped' are never expected. Otherwise, the rows are written as
+	they arrive.
+*/
+
+struct writer_stream_t
+{
+	struct writer_t *writer;
+	struct config_t *config;
+	struct outputs_t *outputs;
+
+	int nr_points,next;
+	struct writer_item_t **held;
+	bool *skipped;
+
+	bool dirty;
+	struct writer_stream_t *next_dirty;
+};
+
+struct writer_t
+{
+	/*
+		A multiple-producer, single-consumer queue: the producers exchange
+		'head', only the writer thread touches 'tail', and 'stub' keeps the
+		list from ever being empty. 'nr_items' counts the items pushed.
+	*/
+
+	_Atomic(struct writer_item_t *) head;
+	struct writer_item_t *tail;
+	struct writer_item_t stub;
+
+	sem_t nr_items;
+	pthread_t thread;
+
+	/*
+		Only used by the writer thread.
+	*/
+
+	struct writer_stream_t *dirty;
+	struct statistics_t *scratch;
+};
+
+struct writer_t *writer_init(void);
+void writer_fini(struct writer_t *writer);
+
+struct writer_stream_t *writer_stream_open(struct writer_t *writer,struct config_t *config,struct outputs_t *outputs,int nr_points);
+void writer_stream_skip(struct writer_stream_t *stream,int index);
+void writer_stream_close(struct writer_stream_t *stream);
+
+void writer_submit(struct writer_stream_t *stream,int index,struct point_t *point,struct statistics_t *total,const char *store);
+void writer_sync(struct writer_t *writer);
+const char *writer_held(struct writer_stream_t *stream,int index);
+
+#endif //__WRITER_H__